@@ -1,11 +1,20 @@
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <sys/param.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
+#include <stdio.h>
 #include <dirent.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
+#include "driver/sdspi_host.h"
+#include "diskio_sdmmc.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "card_reader.h"
 
@@ -13,6 +22,37 @@ static const char *TAG = "card_reader";
 static SemaphoreHandle_t card_reader_mutex;
 static sdmmc_card_t *card;
 
+// Bus frequencies tried after mounting, from the fastest
+static const uint32_t probe_freqs_khz[] = { SDMMC_FREQ_HIGHSPEED, SDMMC_FREQ_26M };
+#define PROBE_SECTORS 32
+
+// Size of the DMA buffer image data is read into, a multiple of the cluster size is used
+#define IMAGE_BUFFER_SIZE (32 * 1024)
+
+struct card_reader_image {
+    FIL file;
+    size_t size;
+    size_t offset;          // Offset of the next byte to be read from the card
+    uint32_t cluster_size;  // In bytes
+    LBA_t sector;           // Next sector of the current contiguous extent
+    uint32_t extent_left;   // Sectors remaining in the current contiguous extent
+    uint8_t *buffer;
+    size_t buffer_size;
+};
+
+// Entries grouped by their first character, digits, letters and the rest
+#define INDEX_BUCKETS (10 + 26 + 1)
+
+/* Names of the selectable entries packed one after another and the offset of every name in
+   group order, both in PSRAM. Nothing is written to the card. */
+#if !CONFIG_SPIRAM
+#error "The card index is kept in PSRAM, enable CONFIG_SPIRAM"
+#endif
+static char *s_index_names;
+static uint32_t *s_index_offsets;
+static uint32_t s_index_count;
+static uint32_t s_bucket_start[INDEX_BUCKETS + 1];
+
 #define SD_HOST       SPI2_HOST
 #define PIN_NUM_MISO  13
 #define PIN_NUM_MOSI  15
@@ -20,6 +60,66 @@ static sdmmc_card_t *card;
 #define PIN_NUM_CS    2
 #define PIN_NUM_CD    3
 static card_reader_config_t s_config;
+static char s_mount_point[16];
+
+static void card_detect_isr(void *arg)
+{
+    s_config.detect_cb(s_config.detect_cb_arg);
+}
+
+static void index_close(void)
+{
+    free(s_index_names);
+    free(s_index_offsets);
+    s_index_names = NULL;
+    s_index_offsets = NULL;
+    s_index_count = 0;
+}
+
+/*
+ * Raises the bus frequency above the one the card was initialized at, as long as a
+ * multi-sector read returns the same data as at the initial frequency.
+ */
+static void probe_bus_frequency(void)
+{
+    const uint32_t initial_freq_khz = card->real_freq_khz;
+    const size_t probe_size = PROBE_SECTORS * card->csd.sector_size;
+
+    uint8_t *reference = heap_caps_malloc(probe_size, MALLOC_CAP_DMA);
+    uint8_t *probe = heap_caps_malloc(probe_size, MALLOC_CAP_DMA);
+    if (reference == NULL || probe == NULL ||
+            sdmmc_read_sectors(card, reference, 0, PROBE_SECTORS) != ESP_OK) {
+        ESP_LOGW(TAG, "Frequency probe skipped, running at %"PRIu32" kHz", initial_freq_khz);
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < sizeof(probe_freqs_khz) / sizeof(probe_freqs_khz[0]); i++) {
+        const uint32_t freq_khz = probe_freqs_khz[i];
+        if (freq_khz <= initial_freq_khz) {
+            break;
+        }
+
+        if (sdspi_host_set_card_clk(card->host.slot, freq_khz) != ESP_OK) {
+            continue;
+        }
+
+        if (sdmmc_read_sectors(card, probe, 0, PROBE_SECTORS) == ESP_OK &&
+                memcmp(reference, probe, probe_size) == 0) {
+            card->real_freq_khz = freq_khz;
+            ESP_LOGI(TAG, "SD card bus running at %"PRIu32" kHz", freq_khz);
+            goto cleanup;
+        }
+
+        ESP_LOGW(TAG, "Read verify failed at %"PRIu32" kHz", freq_khz);
+    }
+
+    // Nothing faster passed, go back to the frequency the card was initialized at
+    sdspi_host_set_card_clk(card->host.slot, initial_freq_khz);
+
+cleanup:
+    free(reference);
+    free(probe);
+}
 
 esp_err_t card_reader_mount(const char *mount_point)
 {
@@ -27,9 +127,8 @@ esp_err_t card_reader_mount(const char *mount_point)
         ESP_LOGE(TAG, "Failed to take mutex.");
         return ESP_FAIL;
     }
-    // By default, SD card frequency is initialized to SDMMC_FREQ_DEFAULT (20MHz)
-    // For setting a specific frequency, use host.max_freq_khz (range 400kHz - 20MHz for SDSPI)
-    // Example: for fixed frequency of 10MHz, use host.max_freq_khz = 10000;
+    // The card is initialized at SDMMC_FREQ_DEFAULT (20MHz), probe_bus_frequency() raises it
+    // afterwards if the card keeps up.
     sdmmc_host_t host = SDSPI_HOST_DEFAULT();
     host.slot = s_config.host;
 
@@ -52,6 +151,9 @@ esp_err_t card_reader_mount(const char *mount_point)
         return ret;
     }
 
+    strlcpy(s_mount_point, mount_point, sizeof(s_mount_point));
+    probe_bus_frequency();
+
     ESP_LOGI(TAG, "SD card mounted successfully");
     xSemaphoreGive(card_reader_mutex);
     return ESP_OK;
@@ -64,6 +166,7 @@ esp_err_t card_reader_unmount(const char *mount_point)
         return ESP_FAIL;
     }
 
+    index_close();
     esp_err_t ret = esp_vfs_fat_sdcard_unmount(mount_point, card);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to unmount SD card VFAT filesystem. Error: %s", esp_err_to_name(ret));
@@ -105,7 +208,7 @@ void card_reader_init(card_reader_config_t *config)
         .sclk_io_num = s_config.pin_num_clk,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
-        .max_transfer_sz = 4000,
+        .max_transfer_sz = IMAGE_BUFFER_SIZE,
     };
 
     ESP_ERROR_CHECK(spi_bus_initialize(s_config.host, &bus_cfg, SDSPI_DEFAULT_DMA));
@@ -114,73 +217,330 @@ void card_reader_init(card_reader_config_t *config)
         .pin_bit_mask = 1ULL << s_config.pin_num_cd,
                              .mode = GPIO_MODE_INPUT,
                              .pull_up_en = GPIO_PULLUP_ENABLE,
-                             .intr_type = GPIO_INTR_DISABLE
+                             .intr_type = s_config.detect_cb ? GPIO_INTR_ANYEDGE : GPIO_INTR_DISABLE
     };
     ESP_ERROR_CHECK(gpio_config(&io_conf));
+
+    if (s_config.detect_cb) {
+        // The ISR service may already be installed by another component
+        esp_err_t ret = gpio_install_isr_service(0);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            ESP_ERROR_CHECK(ret);
+        }
+        ESP_ERROR_CHECK(gpio_isr_handler_add(s_config.pin_num_cd, card_detect_isr, NULL));
+    }
 }
 
-char *card_reader_get_entries(const char *mount_point)
+static bool is_selectable(const struct dirent *entry)
+{
+    if (entry->d_name[0] == '.') {
+        // Skip hidden files
+        return false;
+    }
+
+    size_t name_length = strlen(entry->d_name);
+    if (name_length >= CARD_READER_NAME_MAX) {
+        return false;
+    }
+
+    // Project directories and bundles
+    return entry->d_type == DT_DIR ||
+           (name_length > strlen(BUNDLE_EXTENSION) &&
+            strcasecmp(&entry->d_name[name_length - strlen(BUNDLE_EXTENSION)], BUNDLE_EXTENSION) == 0);
+}
+
+// Digits, letters regardless of case, everything else
+static uint32_t index_bucket(const char *name)
+{
+    const char c = name[0];
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'Z') {
+        return 10 + c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+        return 10 + c - 'a';
+    }
+    return INDEX_BUCKETS - 1;
+}
+
+esp_err_t card_reader_index_build(const char *mount_point, uint32_t *count)
 {
     if (xSemaphoreTake(card_reader_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "Failed to take mutex.");
-        return NULL;
+        return ESP_FAIL;
     }
 
-    DIR *dir;
-    if ((dir = opendir(mount_point)) == NULL) {
-        perror("opendir");
+    index_close();
+    *count = 0;
+
+    DIR *dir = opendir(mount_point);
+    if (dir == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", mount_point);
         xSemaphoreGive(card_reader_mutex);
-        return NULL;
+        return ESP_FAIL;
     }
 
+    // The first pass sizes the groups, the second one copies every name into its group
+    uint32_t fill[INDEX_BUCKETS] = {0};
+    uint32_t name_bytes[INDEX_BUCKETS] = {0};
     struct dirent *entry;
-    char *dir_names = NULL;
-    size_t total_length = 0;
     while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') {
-            // Skip hidden files
-            continue;
+        if (is_selectable(entry)) {
+            const uint32_t bucket = index_bucket(entry->d_name);
+            fill[bucket]++;
+            name_bytes[bucket] += strlen(entry->d_name) + 1;
         }
+    }
+
+    uint32_t total = 0;
+    uint32_t total_bytes = 0;
+    uint32_t bytes_start[INDEX_BUCKETS + 1];
+    for (uint32_t i = 0; i < INDEX_BUCKETS; i++) {
+        s_bucket_start[i] = total;
+        bytes_start[i] = total_bytes;
+        total += fill[i];
+        total_bytes += name_bytes[i];
+        fill[i] = 0;
+        name_bytes[i] = 0;
+    }
+    s_bucket_start[INDEX_BUCKETS] = total;
+    bytes_start[INDEX_BUCKETS] = total_bytes;
+
+    // The last byte is the empty name of entries removed since the first pass
+    s_index_names = heap_caps_malloc(total_bytes + 1, MALLOC_CAP_SPIRAM);
+    s_index_offsets = heap_caps_malloc(MAX(total, 1) * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    if (s_index_names == NULL || s_index_offsets == NULL) {
+        ESP_LOGE(TAG, "No PSRAM for an index of %"PRIu32" entries", total);
+        index_close();
+        closedir(dir);
+        xSemaphoreGive(card_reader_mutex);
+        return ESP_ERR_NO_MEM;
+    }
+    s_index_names[total_bytes] = '\0';
+    for (uint32_t i = 0; i < total; i++) {
+        s_index_offsets[i] = total_bytes;
+    }
 
-        if (entry->d_type != DT_DIR) {
-            // Entry is not a directory
+    rewinddir(dir);
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_selectable(entry)) {
             continue;
         }
 
-        size_t name_length = strlen(entry->d_name);
-        dir_names = realloc(dir_names, total_length + name_length + 1); // +1 for '\n'
-        if (dir_names == NULL) {
-            perror("realloc");
-            closedir(dir);
-            xSemaphoreGive(card_reader_mutex);
-            return NULL;
+        const uint32_t bucket = index_bucket(entry->d_name);
+        const size_t size = strlen(entry->d_name) + 1;
+        const uint32_t offset = bytes_start[bucket] + name_bytes[bucket];
+        if (fill[bucket] == s_bucket_start[bucket + 1] - s_bucket_start[bucket] ||
+                offset + size > bytes_start[bucket + 1]) {
+            continue; // Created or renamed since the first pass
         }
+        memcpy(&s_index_names[offset], entry->d_name, size);
+        s_index_offsets[s_bucket_start[bucket] + fill[bucket]++] = offset;
+        name_bytes[bucket] += size;
+    }
+    closedir(dir);
 
-        strcpy(dir_names + total_length, entry->d_name);
-        total_length += name_length;
-        dir_names[total_length] = '\n';
-        total_length++;
+    s_index_count = total;
+    *count = total;
+    ESP_LOGI(TAG, "Indexed %"PRIu32" entries in %"PRIu32" bytes", total, total_bytes);
+
+    xSemaphoreGive(card_reader_mutex);
+    return ESP_OK;
+}
+
+esp_err_t card_reader_index_get(uint32_t index, char *name, size_t name_size)
+{
+    if (xSemaphoreTake(card_reader_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex.");
+        return ESP_FAIL;
     }
 
-    // Null-terminate the final string (remove the last '\n')
-    if (dir_names != NULL) {
-        dir_names[total_length - 1] = '\0';
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    if (s_index_offsets != NULL && index < s_index_count) {
+        strlcpy(name, &s_index_names[s_index_offsets[index]], name_size);
+        ret = ESP_OK;
     }
 
-    closedir(dir);
+    xSemaphoreGive(card_reader_mutex);
+    return ret;
+}
+
+static uint32_t find_group(uint32_t index, bool forward)
+{
+    uint32_t bucket = INDEX_BUCKETS - 1;
+    while (bucket > 0 && s_bucket_start[bucket] > index) {
+        bucket--;
+    }
+
+    if (!forward) {
+        if (index > s_bucket_start[bucket] || bucket == 0) {
+            return s_bucket_start[bucket];
+        }
+        // Start of the previous group that is not empty
+        while (bucket > 0 && s_bucket_start[bucket - 1] == s_bucket_start[bucket]) {
+            bucket--;
+        }
+        return bucket > 0 ? s_bucket_start[bucket - 1] : 0;
+    }
+
+    const uint32_t next = s_bucket_start[bucket + 1];
+    return next < s_index_count ? next : index;
+}
+
+uint32_t card_reader_index_next_group(uint32_t index, bool forward)
+{
+    if (xSemaphoreTake(card_reader_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex.");
+        return index;
+    }
+
+    uint32_t next = index;
+    if (s_index_count != 0) {
+        next = find_group(index, forward);
+    }
 
     xSemaphoreGive(card_reader_mutex);
-    return dir_names;
+    return next;
 }
 
-void card_reader_free_entries(char *dir_names)
+/* Looks up the cluster the given offset lies in. Seeking to a cluster boundary leaves the
+   file at the end of the previous cluster, so seek one byte past it. */
+static esp_err_t image_locate(card_reader_image_t *image, size_t offset)
 {
+    if (f_lseek(&image->file, offset + 1) != FR_OK) {
+        return ESP_FAIL;
+    }
+
+    FATFS *fs = image->file.obj.fs;
+    DWORD cluster = image->file.clust;
+    image->sector = fs->database + (LBA_t)fs->csize * (cluster - 2);
+    image->extent_left = fs->csize;
+
+    // Extend the span over the following clusters for as long as they are contiguous
+    for (size_t next = offset + image->cluster_size; next < image->size;
+            next += image->cluster_size) {
+        if (f_lseek(&image->file, next + 1) != FR_OK) {
+            return ESP_FAIL;
+        }
+        if (image->file.clust != cluster + 1) {
+            break;
+        }
+        cluster++;
+        image->extent_left += fs->csize;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t card_reader_image_open(const char *path, card_reader_image_t **image)
+{
+    size_t mount_point_len = strlen(s_mount_point);
+    if (card == NULL || strncmp(path, s_mount_point, mount_point_len) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    card_reader_image_t *img = calloc(1, sizeof(card_reader_image_t));
+    if (img == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
     if (xSemaphoreTake(card_reader_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "Failed to take mutex.");
-        return;
+        free(img);
+        return ESP_FAIL;
     }
 
-    free(dir_names);
+    // FATFS addresses the card through its drive number instead of the VFS mount point
+    char fat_path[strlen(path) + 4];
+    snprintf(fat_path, sizeof(fat_path), "%u:%s", ff_diskio_get_pdrv_card(card),
+             path + mount_point_len);
+
+    if (f_open(&img->file, fat_path, FA_READ) != FR_OK) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        xSemaphoreGive(card_reader_mutex);
+        free(img);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FATFS *fs = img->file.obj.fs;
+    img->size = f_size(&img->file);
+    img->cluster_size = fs->csize * card->csd.sector_size;
+
+    // Whole clusters are read at once, so the buffer holds at least one of them
+    img->buffer_size = MAX(IMAGE_BUFFER_SIZE / img->cluster_size, 1) * img->cluster_size;
+    img->buffer = heap_caps_malloc(img->buffer_size, MALLOC_CAP_DMA);
+    if (img->buffer == NULL) {
+        f_close(&img->file);
+        xSemaphoreGive(card_reader_mutex);
+        free(img);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreGive(card_reader_mutex);
+
+    *image = img;
+    return ESP_OK;
+}
+
+size_t card_reader_image_size(const card_reader_image_t *image)
+{
+    return image->size;
+}
+
+esp_err_t card_reader_image_read(card_reader_image_t *image, const uint8_t **data, size_t *size)
+{
+    *size = 0;
+    if (image->offset >= image->size) {
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(card_reader_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex.");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (image->extent_left == 0) {
+        ret = image_locate(image, image->offset);
+    }
+
+    if (ret == ESP_OK) {
+        // Sectors go straight from the card into the DMA buffer, bypassing the FATFS cache
+        const uint32_t sector_size = card->csd.sector_size;
+        const size_t left = image->size - image->offset;
+        const uint32_t sectors = MIN(MIN(image->extent_left, image->buffer_size / sector_size),
+                                     (left + sector_size - 1) / sector_size);
+
+        ret = sdmmc_read_sectors(card, image->buffer, image->sector, sectors);
+        if (ret == ESP_OK) {
+            image->sector += sectors;
+            image->extent_left -= sectors;
+
+            *data = image->buffer;
+            *size = MIN((size_t)sectors * sector_size, left);
+            image->offset += *size;
+        }
+    }
 
     xSemaphoreGive(card_reader_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read image. Error: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+void card_reader_image_close(card_reader_image_t *image)
+{
+    if (image == NULL) {
+        return;
+    }
+
+    if (xSemaphoreTake(card_reader_mutex, portMAX_DELAY) == pdTRUE) {
+        f_close(&image->file);
+        xSemaphoreGive(card_reader_mutex);
+    }
+
+    free(image->buffer);
+    free(image);
 }
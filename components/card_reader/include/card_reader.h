@@ -1,6 +1,10 @@
 #pragma once
 
 #define MOUNT_POINT "/sdcard"
+// Files with this extension are listed next to the project directories
+#define BUNDLE_EXTENSION ".esfpkg"
+// Longest listed name including the terminator, longer ones are skipped
+#define CARD_READER_NAME_MAX 64
 
 #include "driver/spi_master.h"
 
@@ -8,6 +12,9 @@
 extern "C" {
 #endif
 
+// Called from the GPIO ISR whenever the card detect pin changes, the pin may still bounce
+typedef void (*card_reader_detect_cb_t)(void *arg);
+
 typedef struct {
     spi_host_device_t host;
     uint32_t pin_num_miso;
@@ -15,14 +22,32 @@ typedef struct {
     uint32_t pin_num_clk;
     uint32_t pin_num_cs;
     uint32_t pin_num_cd;
+    card_reader_detect_cb_t detect_cb;  // Optional
+    void *detect_cb_arg;
 } card_reader_config_t;
 
+/* Image file opened for sequential reading straight from the card */
+typedef struct card_reader_image card_reader_image_t;
+
 void card_reader_init(card_reader_config_t *config);
 bool card_reader_is_card_inserted(void);
 esp_err_t card_reader_mount(const char *mount_point);
 esp_err_t card_reader_unmount(const char *mount_point);
-char *card_reader_get_entries(const char *mount_point);
-void card_reader_free_entries(char *dir_names);
+
+/* Collects the names of the project directories and bundles in the root of the card into an
+   index in PSRAM, grouped by their first character. Names are read back one by one.
+   Returns ESP_ERR_NO_MEM when there is no PSRAM to hold the index. */
+esp_err_t card_reader_index_build(const char *mount_point, uint32_t *count);
+esp_err_t card_reader_index_get(uint32_t index, char *name, size_t name_size);
+// First entry of the next or previous group of the same first character
+uint32_t card_reader_index_next_group(uint32_t index, bool forward);
+
+esp_err_t card_reader_image_open(const char *path, card_reader_image_t **image);
+size_t card_reader_image_size(const card_reader_image_t *image);
+/* Returns the next part of the image in a DMA capable buffer owned by the image, which stays
+   valid until the next call. size is set to zero at the end of the image. */
+esp_err_t card_reader_image_read(card_reader_image_t *image, const uint8_t **data, size_t *size);
+void card_reader_image_close(card_reader_image_t *image);
 
 #ifdef __cplusplus
 }
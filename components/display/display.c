@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <esp_log.h>
 #include "esp_lcd_panel_io.h"
@@ -27,9 +29,17 @@
 
 #define STATUS_CIRCLE_INIT_SIZE 250
 #define STATUS_CIRCLE_END_SIZE 100
+#define STATUS_CIRCLE_ANIMATION_TIME 150
 
 #define DISPLAY_ANIMATION_TIME 300
 
+// Refresh period while data is being transferred, menus keep the default rate
+#define FLASHING_REFRESH_PERIOD_MS 66
+
+// Entries materialized in the roller around the selected one, the rest stays on the card
+#define SELECTOR_WINDOW 7
+#define SELECTOR_MARGIN 2
+
 static lv_obj_t *selector = NULL;
 static lv_obj_t *flasher = NULL;
 static lv_obj_t *not_ready = NULL;
@@ -44,6 +54,21 @@ static lv_obj_t *arc_selector = NULL;
 static lv_obj_t *label_not_ready = NULL;
 static lv_obj_t *label_flasher = NULL;
 static lv_obj_t *label_success = NULL;
+static lv_obj_t *label_instruction = NULL;
+static lv_obj_t *label_percent = NULL;
+
+static lv_display_t *s_display;
+static bool s_throttled;
+static uint8_t s_progress;  // Shown progress, only read and written by the flashing task
+
+static selector_entry_cb_t s_entry_cb;
+static void *s_entry_cb_arg;
+static uint32_t s_entry_count;
+static uint32_t s_selected;
+static uint32_t s_window_start;
+static uint32_t s_window_count;
+static char s_window_names[SELECTOR_WINDOW][SELECTOR_NAME_MAX];
+static char s_window_options[SELECTOR_WINDOW * SELECTOR_NAME_MAX];
 
 static const char *TAG = "display";
 
@@ -91,7 +116,7 @@ static void selector_screen_init(void)
     lv_obj_set_style_arc_color(arc_selector, lv_color_black(), LV_PART_MAIN);
     lv_obj_set_style_arc_width(arc_selector, 5, LV_PART_INDICATOR);
 
-    lv_obj_t *label_instruction = lv_label_create(selector);
+    label_instruction = lv_label_create(selector);
     lv_obj_set_style_text_color(label_instruction, lv_color_white(), LV_PART_MAIN);
     lv_obj_set_style_text_align(label_instruction, LV_TEXT_ALIGN_CENTER, 0);
     lv_label_set_text(label_instruction, LV_SYMBOL_RIGHT "\nRotate to select");
@@ -123,6 +148,11 @@ static void flasher_screen_init(void)
     lv_obj_set_size(arc_progress, 100, 100);
     lv_obj_center(arc_progress);
 
+    label_percent = lv_label_create(flasher);
+    lv_obj_set_style_text_color(label_percent, lv_color_white(), LV_PART_MAIN);
+    lv_label_set_text(label_percent, "0%");
+    lv_obj_center(label_percent);
+
     label_flasher = lv_label_create(flasher);
     lv_obj_set_style_text_color(label_flasher, lv_color_white(), LV_PART_MAIN);
     lv_obj_align(label_flasher, LV_ALIGN_TOP_MID, 0, 20);
@@ -179,12 +209,27 @@ static void success_screen_init(void)
     lvgl_port_unlock();
 }
 
-static void screens_init(void)
+/* Only the not ready screen is built at boot, the others are built on first use. All of them
+   have to be called with the LVGL lock held. */
+static void selector_screen_ensure(void)
 {
-    not_ready_screen_init();
-    selector_screen_init();
-    flasher_screen_init();
-    success_screen_init();
+    if (selector == NULL) {
+        selector_screen_init();
+    }
+}
+
+static void flasher_screen_ensure(void)
+{
+    if (flasher == NULL) {
+        flasher_screen_init();
+    }
+}
+
+static void success_screen_ensure(void)
+{
+    if (success == NULL) {
+        success_screen_init();
+    }
 }
 
 static void panel_init(display_config_t *display_config, esp_lcd_panel_io_handle_t *io_handle, esp_lcd_panel_handle_t *panel_handle)
@@ -194,8 +239,8 @@ static void panel_init(display_config_t *display_config, esp_lcd_panel_io_handle
         .pin_bit_mask = 1ULL << display_config->pin_num_bk_light,
     };
     ESP_ERROR_CHECK(gpio_config(&bk_gpio_config));
-    gpio_set_level(display_config->pin_num_bk_light, 1);
-
+    // Off until the first frame is drawn, so the panel never shows what was left in its memory
+    gpio_set_level(display_config->pin_num_bk_light, 0);
 
     ESP_LOGI(TAG, "Initialize SPI bus");
     spi_bus_config_t buscfg = {
@@ -254,7 +299,8 @@ static void lvgl_init(lvgl_config_t *lvgl_config, esp_lcd_panel_io_handle_t *io_
         .hres = LCD_H_RES,
         .vres = LCD_V_RES,
         .monochrome = false,
-        .color_format = LV_COLOR_FORMAT_RGB565,
+        // Rendered in the byte order the panel expects, so flushes go to DMA untouched
+        .color_format = LV_COLOR_FORMAT_RGB565_SWAPPED,
         .rotation = {
             .swap_xy = false,
             .mirror_x = true,
@@ -262,10 +308,9 @@ static void lvgl_init(lvgl_config_t *lvgl_config, esp_lcd_panel_io_handle_t *io_
         },
         .flags = {
             .buff_dma = true,
-            .swap_bytes = true,
         }
     };
-    lvgl_port_add_disp(&disp_cfg);
+    s_display = lvgl_port_add_disp(&disp_cfg);
 }
 
 void display_init(display_config_t *display_config, lvgl_config_t *lvgl_config)
@@ -275,56 +320,201 @@ void display_init(display_config_t *display_config, lvgl_config_t *lvgl_config)
 
     panel_init(display_config, &io_handle, &panel_handle);
     lvgl_init(lvgl_config, &io_handle, &panel_handle);
-    screens_init();
+
+    not_ready_screen_init();
+    lvgl_port_lock(0);
+    lv_label_set_text(label_not_ready, "Starting...");
+    lv_screen_load(not_ready);
+    lv_refr_now(s_display);
+    lvgl_port_unlock();
+    gpio_set_level(display_config->pin_num_bk_light, 1);
+}
+
+// Has to be called with the LVGL lock held
+static void display_set_throttled(bool throttled)
+{
+    if (throttled == s_throttled) {
+        return;
+    }
+
+    lv_timer_t *refresh_timer = lv_display_get_refr_timer(s_display);
+    if (refresh_timer != NULL) {
+        lv_timer_set_period(refresh_timer, throttled ? FLASHING_REFRESH_PERIOD_MS : LV_DEF_REFR_PERIOD);
+    }
+    s_throttled = throttled;
 }
 
 void flasher_screen_progress(uint8_t progress)
 {
+    // Most calls do not change the shown value, those need neither the lock nor a redraw
+    if (progress == s_progress) {
+        return;
+    }
+
     lvgl_port_lock(0);
+    flasher_screen_ensure();
+    // The transfer is running, redraws only compete with it for core 0 and the SPI bus
+    display_set_throttled(true);
+    s_progress = progress;
+    // Only the arc segment between the old and the new value and the label are invalidated
     lv_arc_set_value(arc_progress, progress);
+    lv_label_set_text_fmt(label_percent, "%u%%", progress);
     lvgl_port_unlock();
 }
 
 void flasher_screen_text(const char *text)
 {
     lvgl_port_lock(0);
+    flasher_screen_ensure();
     lv_label_set_text(label_flasher, text);
     lvgl_port_unlock();
 }
 
-void selector_roller_change(selector_direction_t direction)
+/* Loads the names of the window starting at start, reusing the ones already loaded.
+   Has to be called with the LVGL lock held, which also guards the selector state. */
+static void selector_window_load(uint32_t start)
 {
-    lvgl_port_lock(0);
-    if (direction == UP) {
-        if (lv_roller_get_selected(roller1) != 0) {
-            lv_roller_set_selected(roller1, lv_roller_get_selected(roller1) - 1, LV_ANIM_ON);
+    const uint32_t count = MIN(SELECTOR_WINDOW, s_entry_count - start);
+    const uint32_t old_start = s_window_start;
+    const uint32_t old_end = s_window_start + s_window_count;
+    char names[SELECTOR_WINDOW][SELECTOR_NAME_MAX];
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t index = start + i;
+        if (index >= old_start && index < old_end) {
+            memcpy(names[i], s_window_names[index - old_start], SELECTOR_NAME_MAX);
+        } else if (s_entry_cb(index, names[i], SELECTOR_NAME_MAX, s_entry_cb_arg) != ESP_OK) {
+            strcpy(names[i], "?");
         }
-    } else {
-        lv_roller_set_selected(roller1, lv_roller_get_selected(roller1) + 1, LV_ANIM_ON);
     }
-    lv_arc_set_value(arc_selector, lv_roller_get_selected(roller1));
+    memcpy(s_window_names, names, sizeof(names[0]) * count);
+    s_window_start = start;
+    s_window_count = count;
+
+    size_t length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        length += snprintf(&s_window_options[length], sizeof(s_window_options) - length,
+                           i == 0 ? "%s" : "\n%s", s_window_names[i]);
+    }
+    lv_roller_set_options(roller1, s_window_options, LV_ROLLER_MODE_NORMAL);
+}
+
+// Keeps SELECTOR_MARGIN entries materialized on both sides of the selection
+static void selector_select(uint32_t index, lv_anim_enable_t anim)
+{
+    const uint32_t previous = s_selected;
+    s_selected = index;
+
+    if (index < s_window_start + SELECTOR_MARGIN || index + SELECTOR_MARGIN >= s_window_start + s_window_count) {
+        // All entries fit in the window when there are no more than SELECTOR_WINDOW of them
+        uint32_t start = 0;
+        if (s_entry_count > SELECTOR_WINDOW) {
+            start = index > SELECTOR_WINDOW / 2 ? index - SELECTOR_WINDOW / 2 : 0;
+            start = MIN(start, s_entry_count - SELECTOR_WINDOW);
+        }
+        if (start != s_window_start || s_window_count == 0) {
+            selector_window_load(start);
+            // Put the roller back where it was, so it scrolls from there without a jump
+            if (previous >= s_window_start && previous < s_window_start + s_window_count) {
+                lv_roller_set_selected(roller1, previous - s_window_start, LV_ANIM_OFF);
+            }
+        }
+    }
+
+    lv_roller_set_selected(roller1, index - s_window_start, anim);
+    lv_arc_set_value(arc_selector, index);
     lv_obj_invalidate(arc_selector);
     lv_obj_invalidate(roller1);
+}
+
+void selector_roller_move(int32_t steps)
+{
+    lvgl_port_lock(0);
+    selector_screen_ensure();
+    if (s_entry_count != 0 && steps != 0) {
+        int64_t index = (int64_t)s_selected + steps;
+        index = index < 0 ? 0 : MIN(index, (int64_t)s_entry_count - 1);
+        if (index != s_selected) {
+            selector_select(index, LV_ANIM_ON);
+        }
+    }
     lvgl_port_unlock();
 }
 
+void selector_screen_select(uint32_t index)
+{
+    lvgl_port_lock(0);
+    selector_screen_ensure();
+    if (index < s_entry_count) {
+        selector_select(index, LV_ANIM_OFF);
+    }
+    lvgl_port_unlock();
+}
+
+uint32_t selector_screen_get_selected_index(void)
+{
+    lvgl_port_lock(0);
+    uint32_t index = s_selected;
+    lvgl_port_unlock();
+    return index;
+}
+
 void selector_screen_get_selected(char *buf, uint32_t buf_size)
 {
     lvgl_port_lock(0);
-    lv_roller_get_selected_str(roller1, buf, buf_size);
+    if (s_entry_count != 0) {
+        strlcpy(buf, s_window_names[s_selected - s_window_start], buf_size);
+    } else {
+        buf[0] = '\0';
+    }
+    lvgl_port_unlock();
+}
+
+void selector_screen_set_entries(uint32_t count, selector_entry_cb_t entry_cb, void *arg)
+{
+    lvgl_port_lock(0);
+    selector_screen_ensure();
+    s_entry_cb = entry_cb;
+    s_entry_cb_arg = arg;
+    s_entry_count = count;
+    s_selected = 0;
+    s_window_start = 0;
+    s_window_count = 0;
+    lv_arc_set_range(arc_selector, 0, count > 1 ? count - 1 : 1);
+    if (count != 0) {
+        selector_select(0, LV_ANIM_OFF);
+    } else {
+        lv_roller_set_options(roller1, "No projects", LV_ROLLER_MODE_NORMAL);
+        lv_arc_set_value(arc_selector, 0);
+    }
     lvgl_port_unlock();
 }
 
-void selector_screen_set_options(char *options)
+void selector_screen_set_letter_mode(bool enabled)
 {
     lvgl_port_lock(0);
-    lv_roller_set_options(roller1, options, LV_ROLLER_MODE_NORMAL);
-    lv_arc_set_range(arc_selector, 0, lv_roller_get_option_cnt(roller1) - 1);
+    selector_screen_ensure();
+    lv_label_set_text(label_instruction, enabled ? LV_SYMBOL_RIGHT "\nRotate to jump by letter" :
+                      LV_SYMBOL_RIGHT "\nRotate to select");
     lvgl_port_unlock();
 }
 
+static void status_circle_size_cb(void *circle, int32_t size)
+{
+    lv_obj_set_size(circle, size, size);
+}
+
+static void status_circle_completed_cb(lv_anim_t *anim)
+{
+    lv_obj_remove_flag(lv_anim_get_user_data(anim), LV_OBJ_FLAG_HIDDEN);
+    lv_obj_remove_flag(label_success, LV_OBJ_FLAG_HIDDEN);
+}
+
 void display_status(const char *text, screen_t screen)
 {
+    lvgl_port_lock(0);
+    success_screen_ensure();
+
     lv_color_t bg_color;
     lv_obj_t *sign;
     if (screen == FLASH_SUCCESS) {
@@ -334,30 +524,37 @@ void display_status(const char *text, screen_t screen)
         bg_color = lv_palette_main(LV_PALETTE_RED);
         sign = cross_sign;
     }
-    lvgl_port_lock(0);
+    // A result shown right after the previous one restarts the animation
+    lv_anim_delete(circle_success, status_circle_size_cb);
     lv_obj_set_size(circle_success, STATUS_CIRCLE_INIT_SIZE, STATUS_CIRCLE_INIT_SIZE);
     lv_obj_set_style_bg_color(circle_success, bg_color, LV_PART_MAIN);
     lv_obj_add_flag(check_sign, LV_OBJ_FLAG_HIDDEN);
     lv_obj_add_flag(cross_sign, LV_OBJ_FLAG_HIDDEN);
-    lv_label_set_text(label_success, "");
-    lv_screen_load_anim(success, LV_SCR_LOAD_ANIM_FADE_ON, DISPLAY_ANIMATION_TIME, 0, 0);
-    lvgl_port_unlock();
-    uint16_t circle_success_size1 = STATUS_CIRCLE_INIT_SIZE;
-    while (circle_success_size1 > STATUS_CIRCLE_END_SIZE) {
-        circle_success_size1 -= 10;
-        lvgl_port_lock(0);
-        lv_obj_set_size(circle_success, circle_success_size1, circle_success_size1);
-        lvgl_port_unlock();
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-    }
-    lvgl_port_lock(0);
+    lv_obj_add_flag(label_success, LV_OBJ_FLAG_HIDDEN);
     lv_label_set_text(label_success, text);
-    lv_obj_remove_flag(sign, LV_OBJ_FLAG_HIDDEN);
+    lv_screen_load_anim(success, LV_SCR_LOAD_ANIM_FADE_ON, DISPLAY_ANIMATION_TIME, 0, 0);
+
+    // Runs on the LVGL task, the caller can go on with the next job straight away
+    lv_anim_t anim;
+    lv_anim_init(&anim);
+    lv_anim_set_var(&anim, circle_success);
+    lv_anim_set_exec_cb(&anim, status_circle_size_cb);
+    lv_anim_set_values(&anim, STATUS_CIRCLE_INIT_SIZE, STATUS_CIRCLE_END_SIZE);
+    lv_anim_set_duration(&anim, STATUS_CIRCLE_ANIMATION_TIME);
+    lv_anim_set_user_data(&anim, sign);
+    lv_anim_set_completed_cb(&anim, status_circle_completed_cb);
+    lv_anim_start(&anim);
     lvgl_port_unlock();
 }
 
 void screen_set(screen_t screen, const char *text)
 {
+    if (screen != FLASHER) {
+        lvgl_port_lock(0);
+        display_set_throttled(false);
+        lvgl_port_unlock();
+    }
+
     switch (screen) {
     case NOT_READY:
         lvgl_port_lock(0);
@@ -368,11 +565,16 @@ void screen_set(screen_t screen, const char *text)
         break;
     case SELECTOR:
         lvgl_port_lock(0);
+        selector_screen_ensure();
         lv_screen_load_anim(selector, LV_SCR_LOAD_ANIM_FADE_ON, DISPLAY_ANIMATION_TIME, 0, 0);
         lvgl_port_unlock();
         break;
     case FLASHER:
         lvgl_port_lock(0);
+        flasher_screen_ensure();
+        s_progress = 0;
+        lv_arc_set_value(arc_progress, 0);
+        lv_label_set_text(label_percent, "0%");
         lv_label_set_text(label_flasher, text);
         lv_screen_load_anim(flasher, LV_SCR_LOAD_ANIM_FADE_ON, DISPLAY_ANIMATION_TIME, 0, 0);
         lvgl_port_unlock();
@@ -32,17 +32,28 @@ typedef enum {
     FLASH_ERROR,
 } screen_t;
 
-typedef enum {
-    UP,
-    DOWN,
-} selector_direction_t;
+// Longest entry name shown by the selector, including the terminator
+#define SELECTOR_NAME_MAX 64
+
+// Copies the name of an entry into buf, called with the LVGL lock held
+typedef esp_err_t (*selector_entry_cb_t)(uint32_t index, char *buf, size_t buf_size, void *arg);
 
 void display_init(display_config_t *display_config, lvgl_config_t *lvgl_config);
+// FLASHER also resets the progress, so it is only set by the flashing task, once per job
 void screen_set(screen_t screen, const char *text);
-void selector_roller_change(selector_direction_t direction);
+// Moves the selection by steps entries, down for positive ones, and stops at both ends
+void selector_roller_move(int32_t steps);
+void selector_screen_select(uint32_t index);
+uint32_t selector_screen_get_selected_index(void);
+// buf is set to an empty string if there is nothing to select
 void selector_screen_get_selected(char *buf, uint32_t buf_size);
-void selector_screen_set_options(char *options);
+/* Only a small window of entries around the selected one is kept in the roller, names are
+   requested from entry_cb as the selection moves */
+void selector_screen_set_entries(uint32_t count, selector_entry_cb_t entry_cb, void *arg);
+void selector_screen_set_letter_mode(bool enabled);
+// Only called by the flashing task, which owns the shown progress
 void flasher_screen_progress(uint8_t progress);
+void flasher_screen_text(const char *text);
 
 #ifdef __cplusplus
 }
@@ -1,27 +1,48 @@
 #include <stdio.h>
+#include <stdatomic.h>
 #include "encoder.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/pulse_cnt.h"
 #include "iot_button.h"
-#include "freertos/queue.h"
 
 #define PCNT_HIGH_LIMIT 4
 #define PCNT_LOW_LIMIT -4
+// Detents further apart than this start a new spin, its velocity is zero
+#define SPIN_TIMEOUT_US 150000
 
 static const char *TAG = "encoder";
-QueueHandle_t encoder_state_queue = NULL;
+static encoder_event_cb_t s_event_cb;
+static void *s_event_cb_arg;
+
+// Detents since the last encoder_take_delta(), right is positive
+static atomic_int s_delta;
+static atomic_uint s_velocity;          // Detents per second, smoothed
+static atomic_llong s_last_detent_us;
+static int s_last_direction;            // Only touched by the PCNT ISR
+static bool s_long_pressed;             // Only touched by the button task
 
 static bool example_pcnt_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx)
 {
-    BaseType_t high_task_wakeup = pdFALSE;
-    encoder_t enc;
-    if (edata->watch_point_value == PCNT_HIGH_LIMIT) {
-        enc = ENCODER_MOVE_RIGHT;
-    } else if (edata->watch_point_value == PCNT_LOW_LIMIT) {
-        enc = ENCODER_MOVE_LEFT;
+    const int direction = edata->watch_point_value == PCNT_HIGH_LIMIT ? 1 : -1;
+    const int64_t now = esp_timer_get_time();
+    const int64_t interval = now - atomic_load(&s_last_detent_us);
+
+    if (direction != s_last_direction || interval > SPIN_TIMEOUT_US) {
+        atomic_store(&s_velocity, 0);
+    } else {
+        // Averaged with the previous value, so one uneven detent does not make the roller jump
+        const uint32_t velocity = 1000000 / (interval > 0 ? interval : 1);
+        atomic_store(&s_velocity, (atomic_load(&s_velocity) + velocity) / 2);
     }
-    xQueueOverwriteFromISR(encoder_state_queue, &enc, &high_task_wakeup);
-    return (high_task_wakeup == pdTRUE);
+    s_last_direction = direction;
+    atomic_store(&s_last_detent_us, now);
+    atomic_fetch_add(&s_delta, direction);
+
+    if (s_event_cb) {
+        s_event_cb(direction > 0 ? ENCODER_MOVE_RIGHT : ENCODER_MOVE_LEFT, s_event_cb_arg);
+    }
+    return false;
 }
 
 static void dial_init(uint32_t encoder_a_pin, uint32_t encoder_b_pin)
@@ -70,10 +91,31 @@ static void dial_init(uint32_t encoder_a_pin, uint32_t encoder_b_pin)
     ESP_ERROR_CHECK(pcnt_unit_start(pcnt_unit));
 }
 
-static void button_single_click_cb(void *arg, void *usr_data)
+static void button_event(encoder_t enc)
 {
-    encoder_t enc = ENCODER_CLICKED;
-    xQueueOverwriteFromISR(encoder_state_queue, &enc, NULL);
+    if (s_event_cb) {
+        s_event_cb(enc, s_event_cb_arg);
+    }
+}
+
+static void button_press_down_cb(void *arg, void *usr_data)
+{
+    s_long_pressed = false;
+    button_event(ENCODER_PRESSED);
+}
+
+// Reported on release, without waiting for the click classification of iot_button
+static void button_press_up_cb(void *arg, void *usr_data)
+{
+    if (!s_long_pressed) {
+        button_event(ENCODER_CLICKED);
+    }
+}
+
+static void button_long_press_cb(void *arg, void *usr_data)
+{
+    s_long_pressed = true;
+    button_event(ENCODER_LONG_PRESSED);
 }
 
 static esp_err_t button_init(uint32_t encoder_btn_pin)
@@ -93,24 +135,27 @@ static esp_err_t button_init(uint32_t encoder_btn_pin)
     }
     ESP_LOGI(TAG, "create button success");
 
-    ESP_ERROR_CHECK(iot_button_register_cb(btn_handle, BUTTON_SINGLE_CLICK, button_single_click_cb, NULL));
+    ESP_ERROR_CHECK(iot_button_register_cb(btn_handle, BUTTON_PRESS_DOWN, button_press_down_cb, NULL));
+    ESP_ERROR_CHECK(iot_button_register_cb(btn_handle, BUTTON_PRESS_UP, button_press_up_cb, NULL));
+    ESP_ERROR_CHECK(iot_button_register_cb(btn_handle, BUTTON_LONG_PRESS_START, button_long_press_cb, NULL));
     return ESP_OK;
 }
 
 esp_err_t encoder_init(encoder_config_t *config)
 {
-    encoder_state_queue = xQueueCreate(1, sizeof(encoder_t));
+    s_event_cb = config->event_cb;
+    s_event_cb_arg = config->event_cb_arg;
     dial_init(config->encoder_a_pin, config->encoder_b_pin);
     ESP_ERROR_CHECK(button_init(config->encoder_btn_pin));
     return ESP_OK;
 }
 
-encoder_t encoder_get_value(void)
+int32_t encoder_take_delta(uint32_t *velocity)
 {
-    encoder_t enc;
-    if (xQueueReceive(encoder_state_queue, &enc, 0) == pdTRUE) {
-        return enc;
+    const int32_t delta = atomic_exchange(&s_delta, 0);
+    if (velocity != NULL) {
+        const bool spinning = esp_timer_get_time() - atomic_load(&s_last_detent_us) <= SPIN_TIMEOUT_US;
+        *velocity = spinning ? atomic_load(&s_velocity) : 0;
     }
-
-    return ENCODER_NO_MOVE;
-}
\ No newline at end of file
+    return delta;
+}
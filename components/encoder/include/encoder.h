@@ -6,21 +6,31 @@
 extern "C" {
 #endif
 
-typedef struct {
-    uint32_t encoder_a_pin;
-    uint32_t encoder_b_pin;
-    uint32_t encoder_btn_pin;
-} encoder_config_t;
-
 typedef enum {
     ENCODER_NO_MOVE = 0,
     ENCODER_CLICKED = 1,
     ENCODER_MOVE_LEFT = 2,
     ENCODER_MOVE_RIGHT = 3,
+    ENCODER_LONG_PRESSED = 4,
+    ENCODER_PRESSED = 5,            // Button went down, followed by CLICKED or LONG_PRESSED
 } encoder_t;
 
+/* Called from an ISR for every detent and from the button timer task for the button. Moves
+   are only a wake up, the detents themselves are collected with encoder_take_delta(). */
+typedef void (*encoder_event_cb_t)(encoder_t event, void *arg);
+
+typedef struct {
+    uint32_t encoder_a_pin;
+    uint32_t encoder_b_pin;
+    uint32_t encoder_btn_pin;
+    encoder_event_cb_t event_cb;    // Optional
+    void *event_cb_arg;
+} encoder_config_t;
+
 esp_err_t encoder_init(encoder_config_t *config);
-encoder_t encoder_get_value(void);
+/* Returns the detents turned since the last call, right is positive, and clears them. velocity
+   is set to the current speed of the spin in detents per second, zero once the dial stops. */
+int32_t encoder_take_delta(uint32_t *velocity);
 
 #ifdef __cplusplus
 }
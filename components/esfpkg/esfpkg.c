@@ -0,0 +1,235 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "mbedtls/sha256.h"
+#include "esfpkg.h"
+
+#define REGION_MD5_SIZE 16
+
+static const char *TAG = "esfpkg";
+
+struct esfpkg {
+    esfpkg_read_cb_t read_cb;
+    void *ctx;
+    const uint8_t *chunk;
+    size_t chunk_left;
+    size_t position;            // Bytes of the bundle consumed so far
+    esfpkg_header_t header;
+    uint8_t *manifest;
+    const esfpkg_image_t *images;
+    uint32_t region_total;
+    uint32_t current;           // Image whose payload is being read
+    size_t payload_left;
+    bool payload_started;
+};
+
+static esp_err_t next_chunk(esfpkg_t *pkg)
+{
+    if (pkg->chunk_left != 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = pkg->read_cb(pkg->ctx, &pkg->chunk, &pkg->chunk_left);
+    if (ret == ESP_OK && pkg->chunk_left == 0) {
+        ESP_LOGE(TAG, "Bundle is truncated");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ret;
+}
+
+static esp_err_t copy(esfpkg_t *pkg, void *dest, size_t size)
+{
+    uint8_t *out = dest;
+    while (size > 0) {
+        esp_err_t ret = next_chunk(pkg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        const size_t part = MIN(size, pkg->chunk_left);
+        memcpy(out, pkg->chunk, part);
+        out += part;
+        pkg->chunk += part;
+        pkg->chunk_left -= part;
+        pkg->position += part;
+        size -= part;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t skip(esfpkg_t *pkg, size_t size)
+{
+    while (size > 0) {
+        esp_err_t ret = next_chunk(pkg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        const size_t part = MIN(size, pkg->chunk_left);
+        pkg->chunk += part;
+        pkg->chunk_left -= part;
+        pkg->position += part;
+        size -= part;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t check_manifest(esfpkg_t *pkg)
+{
+    const esfpkg_header_t *header = &pkg->header;
+
+    if (header->magic != ESFPKG_MAGIC || header->version != ESFPKG_VERSION) {
+        ESP_LOGE(TAG, "Not a bundle, or an unsupported version");
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    const uint32_t table_size = header->image_count * sizeof(esfpkg_image_t);
+    if (header->image_count == 0 || header->image_count > ESFPKG_MAX_IMAGES ||
+            header->alignment == 0 || (header->alignment & (header->alignment - 1)) != 0 ||
+            header->region_size == 0 || header->manifest_size < table_size ||
+            (header->manifest_size - table_size) % REGION_MD5_SIZE != 0) {
+        ESP_LOGE(TAG, "Malformed bundle header");
+        return ESP_ERR_INVALID_ARG;
+    }
+    pkg->region_total = (header->manifest_size - table_size) / REGION_MD5_SIZE;
+
+    uint8_t digest[32];
+    mbedtls_sha256(pkg->manifest, header->manifest_size, digest, 0);
+    if (memcmp(digest, header->manifest_sha256, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "Manifest digest does not match");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    size_t payload_end = sizeof(esfpkg_header_t) + header->manifest_size;
+    uint32_t region_index = 0;
+    for (uint32_t i = 0; i < header->image_count; i++) {
+        const esfpkg_image_t *image = &pkg->images[i];
+        const uint32_t regions = esfpkg_get_region_count(pkg, i);
+        const bool erased = image->flags & ESFPKG_IMAGE_ERASED;
+
+        if (image->offset < payload_end || image->offset % header->alignment != 0 ||
+                image->size % 4 != 0 || image->region_index != region_index ||
+                region_index + regions > pkg->region_total ||
+                (erased && (image->stored_size != 0 || image->address % ESFPKG_SECTOR_SIZE != 0 ||
+                            image->size % ESFPKG_SECTOR_SIZE != 0)) ||
+                (!erased && !(image->flags & ESFPKG_IMAGE_DEFLATE) && image->stored_size != image->size)) {
+            ESP_LOGE(TAG, "Malformed manifest entry %"PRIu32, i);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        payload_end = image->offset + image->stored_size;
+        region_index += regions;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esfpkg_open(esfpkg_read_cb_t read_cb, void *ctx, esfpkg_t **pkg)
+{
+    esfpkg_t *p = calloc(1, sizeof(esfpkg_t));
+    if (p == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    p->read_cb = read_cb;
+    p->ctx = ctx;
+
+    esp_err_t ret = copy(p, &p->header, sizeof(p->header));
+    if (ret == ESP_OK) {
+        if (p->header.magic != ESFPKG_MAGIC ||
+                p->header.manifest_size > ESFPKG_MAX_IMAGES * sizeof(esfpkg_image_t) + 64 * 1024) {
+            ESP_LOGE(TAG, "Not a bundle, or the manifest is too large");
+            ret = ESP_ERR_INVALID_SIZE;
+        } else {
+            p->manifest = malloc(MAX(p->header.manifest_size, 1));
+            ret = p->manifest ? copy(p, p->manifest, p->header.manifest_size) : ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (ret == ESP_OK) {
+        p->images = (const esfpkg_image_t *)p->manifest;
+        ret = check_manifest(p);
+    }
+
+    if (ret != ESP_OK) {
+        esfpkg_close(p);
+        return ret;
+    }
+
+    *pkg = p;
+    return ESP_OK;
+}
+
+const esfpkg_header_t *esfpkg_get_header(const esfpkg_t *pkg)
+{
+    return &pkg->header;
+}
+
+const esfpkg_image_t *esfpkg_get_image(const esfpkg_t *pkg, uint32_t index)
+{
+    return index < pkg->header.image_count ? &pkg->images[index] : NULL;
+}
+
+uint32_t esfpkg_get_region_count(const esfpkg_t *pkg, uint32_t index)
+{
+    const esfpkg_image_t *image = &pkg->images[index];
+    if (image->flags & ESFPKG_IMAGE_ERASED) {
+        return 0;
+    }
+    return (image->size + pkg->header.region_size - 1) / pkg->header.region_size;
+}
+
+const uint8_t *esfpkg_get_region_md5(const esfpkg_t *pkg, uint32_t index, uint32_t region)
+{
+    const uint8_t *digests = pkg->manifest + pkg->header.image_count * sizeof(esfpkg_image_t);
+    return &digests[(pkg->images[index].region_index + region) * REGION_MD5_SIZE];
+}
+
+esp_err_t esfpkg_read_payload(esfpkg_t *pkg, uint32_t index, const uint8_t **data, size_t *size)
+{
+    *size = 0;
+
+    if (index >= pkg->header.image_count || index < pkg->current) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (index > pkg->current || !pkg->payload_started) {
+        const esfpkg_image_t *image = &pkg->images[index];
+        esp_err_t ret = skip(pkg, image->offset - pkg->position);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        pkg->current = index;
+        pkg->payload_left = image->stored_size;
+        pkg->payload_started = true;
+    }
+
+    if (pkg->payload_left == 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = next_chunk(pkg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    *data = pkg->chunk;
+    *size = MIN(pkg->payload_left, pkg->chunk_left);
+    pkg->chunk += *size;
+    pkg->chunk_left -= *size;
+    pkg->position += *size;
+    pkg->payload_left -= *size;
+    return ESP_OK;
+}
+
+void esfpkg_close(esfpkg_t *pkg)
+{
+    if (pkg == NULL) {
+        return;
+    }
+
+    free(pkg->manifest);
+    free(pkg);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Firmware bundle (.esfpkg) layout, all values are little endian:
+ *
+ *   esfpkg_header_t
+ *   esfpkg_image_t[image_count]       manifest, ordered by payload offset
+ *   uint8_t region_md5[regions][16]   manifest, MD5 of every region_size bytes of each image
+ *   payloads, each starting at a multiple of alignment, padded with 0xFF
+ *
+ * The bundle is written by tools/esfpkg.py and read front to back in a single pass. The packer
+ * splits images at runs of erased sectors, so one build image may span several entries.
+ */
+
+#define ESFPKG_MAGIC 0x50465345 // "ESFP"
+#define ESFPKG_VERSION 1
+#define ESFPKG_MAX_IMAGES 64
+
+// Payload is a zlib stream, size is the size once inflated. Not produced by the packer yet.
+#define ESFPKG_IMAGE_DEFLATE (1U << 0)
+/* Sectors that are all 0xFF, only erased. The entry has no payload and no region digests,
+   address and size are multiples of ESFPKG_SECTOR_SIZE. */
+#define ESFPKG_IMAGE_ERASED (1U << 1)
+#define ESFPKG_SECTOR_SIZE 4096
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t image_count;
+    uint32_t chip;              // target_chip_t of esp-serial-flasher
+    uint32_t alignment;         // Payloads start at multiples of this, a power of two
+    uint32_t region_size;       // Bytes covered by one region digest
+    uint32_t manifest_size;     // Bytes of the image table and region digests
+    uint32_t flags;
+    uint32_t reserved;
+    char name[32];              // Project name, zero terminated
+    uint8_t manifest_sha256[32];
+} esfpkg_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t address;           // Flash address
+    uint32_t size;              // Size in flash, a multiple of 4
+    uint32_t offset;            // Offset of the payload in the bundle
+    uint32_t stored_size;       // Size of the payload in the bundle
+    uint32_t flags;             // ESFPKG_IMAGE_*
+    uint32_t region_index;      // First region digest of this image
+    uint8_t md5[16];            // Same digest the target reports after flashing
+    uint8_t sha256[32];
+    char name[24];              // Zero terminated
+} esfpkg_image_t;
+
+_Static_assert(sizeof(esfpkg_header_t) == 96, "esfpkg_header_t has to match tools/esfpkg.py");
+_Static_assert(sizeof(esfpkg_image_t) == 96, "esfpkg_image_t has to match tools/esfpkg.py");
+
+// Hands out the next part of the bundle file, size is zero at its end
+typedef esp_err_t (*esfpkg_read_cb_t)(void *ctx, const uint8_t **data, size_t *size);
+
+typedef struct esfpkg esfpkg_t;
+
+// Reads and verifies the header and manifest
+esp_err_t esfpkg_open(esfpkg_read_cb_t read_cb, void *ctx, esfpkg_t **pkg);
+const esfpkg_header_t *esfpkg_get_header(const esfpkg_t *pkg);
+const esfpkg_image_t *esfpkg_get_image(const esfpkg_t *pkg, uint32_t index);
+uint32_t esfpkg_get_region_count(const esfpkg_t *pkg, uint32_t index);
+const uint8_t *esfpkg_get_region_md5(const esfpkg_t *pkg, uint32_t index, uint32_t region);
+/* Hands out the payload of an image in parts, size is zero at its end. Images have to be
+   read in increasing order, the ones in between are skipped. */
+esp_err_t esfpkg_read_payload(esfpkg_t *pkg, uint32_t index, const uint8_t **data, size_t *size);
+void esfpkg_close(esfpkg_t *pkg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,10 @@ from datetime import datetime
 This python module generates esp_stubs.c/h files from a given version and url, with
 <stub_download_url>/v<stub_version>/esp32xx.json as the required format.
 
+Only the stubs of the targets in the comma separated target list are fetched, an empty list
+selects all of them. Each stub is guarded by the SERIAL_FLASHER_TARGET_ define of its chip,
+so the stubs of chips left out of a build do not end up in it.
+
 It is also possible to override stub generation to use a local folder for testing purposes.
 """
 
@@ -16,7 +20,8 @@ It is also possible to override stub generation to use a local folder for testin
 stub_version = sys.argv[1]
 stub_download_url = sys.argv[2]
 root_path = sys.argv[3]
-stub_override_path = sys.argv[4] if len(sys.argv) == 5 else None
+selected_targets = [target for target in sys.argv[4].split(",") if target]
+stub_override_path = sys.argv[5] if len(sys.argv) == 6 else None
 
 template_path = os.path.join(root_path, "cmake")
 priv_inc_path = os.path.join(root_path, "private_include")
@@ -27,21 +32,19 @@ hfile_path = os.path.join(priv_inc_path, "esp_stubs.h")
 cfile_path = os.path.join(src_path, "esp_stubs.c")
 current_year = datetime.now().year
 
-# Matches order of target_chip_t enumeration
-files_to_download = [
-    None,  # ESP8266_CHIP
-    "esp32.json",  # ESP32_CHIP
-    "esp32s2.json",  # ESP32S2_CHIP
-    "esp32c3.json",  # ESP32C3_CHIP
-    "esp32s3.json",  # ESP32S3_CHIP
-    "esp32c2.json",  # ESP32C2_CHIP
-    None,  # ESP32_RESERVED0_CHIP
-    "esp32h2.json",  # ESP32H2_CHIP
-    "esp32c6.json",  # ESP32C6_CHIP
+# Chips with a flasher stub, in the order of target_chip_t enumeration
+stub_targets = [
+    "esp32",
+    "esp32s2",
+    "esp32c3",
+    "esp32s3",
+    "esp32c2",
+    "esp32h2",
+    "esp32c6",
 ]
 
 
-def read_stub_json(json_file):
+def read_stub_json(json_file, target):
     stub = json.load(json_file)
     entry = stub["entry"]
     text = base64.b64decode(stub["text"])
@@ -59,8 +62,9 @@ def read_stub_json(json_file):
     data_size = 0 if data is None else len(data)
     data_start = 0 if data_start is None else data_start
 
-    stub_data = f"""    // {file_to_download}
-    {{
+    stub_data = f"""#if SERIAL_FLASHER_TARGET_{target.upper()}
+    // {target}.json
+    [{target.upper()}_CHIP] = {{
         .header = {{
             .entrypoint = {entry},
         }},
@@ -77,6 +81,7 @@ def read_stub_json(json_file):
             }},
         }},
     }},
+#endif
 
 """
     return stub_data
@@ -104,21 +109,21 @@ if __name__ == "__main__":
             c_template.format(
                 current_year=current_year,
                 stub_version=stub_version,
-                max_chip_number=len(files_to_download),
             )
         )
 
-        for file_to_download in files_to_download:
-            if file_to_download is None:
-                cfile.write("    // placeholder\n" "    {},\n" "\n")
+        for target in stub_targets:
+            if selected_targets and target not in selected_targets:
+                continue
+
+            file_to_download = f"{target}.json"
+            if stub_override_path:
+                with open(f"{stub_override_path}/{file_to_download}") as file_path:
+                    cfile.write(read_stub_json(file_path, target))
             else:
-                if stub_override_path:
-                    with open(f"{stub_override_path}/{file_to_download}") as file_path:
-                        cfile.write(read_stub_json(file_path))
-                else:
-                    with urllib.request.urlopen(
-                        f"{stub_download_url}/v{stub_version}/{file_to_download}"
-                    ) as url:
-                        cfile.write(read_stub_json(url))
+                with urllib.request.urlopen(
+                    f"{stub_download_url}/v{stub_version}/{file_to_download}"
+                ) as url:
+                    cfile.write(read_stub_json(url, target))
 
         cfile.write("};\n" "\n" "#endif\n")
@@ -1,6 +1,7 @@
 macro(serial_flasher_pull_stubs)
     set(ONE_VALUE_KEYWORDS VERSION SOURCE PATH_OVERRIDE)
-    cmake_parse_arguments(FLASHER_STUB "" "${ONE_VALUE_KEYWORDS}" "" "${ARGN}")
+    set(MULTI_VALUE_KEYWORDS TARGETS)
+    cmake_parse_arguments(FLASHER_STUB "" "${ONE_VALUE_KEYWORDS}" "${MULTI_VALUE_KEYWORDS}" "${ARGN}")
 
     # Don't make this mandatory, some users might not have Python installed
     find_package(Python COMPONENTS Interpreter)
@@ -14,6 +15,9 @@ macro(serial_flasher_pull_stubs)
         set(FLASHER_STUB_SOURCE "https://github.com/esp-rs/esp-flasher-stub/releases/download")
     endif()
 
+    # Only the stubs of the selected targets are fetched, all of them if none are given
+    string(REPLACE ";" "," FLASHER_STUB_TARGET_LIST "${FLASHER_STUB_TARGETS}")
+
     execute_process(
     COMMAND
         ${Python_EXECUTABLE}
@@ -21,6 +25,7 @@ macro(serial_flasher_pull_stubs)
         ${FLASHER_STUB_VERSION}
         ${FLASHER_STUB_SOURCE}
         ${CMAKE_CURRENT_SOURCE_DIR}
+        "${FLASHER_STUB_TARGET_LIST}"
         ${FLASHER_STUB_PATH_OVERRIDE}
     )
 endmacro()
@@ -113,5 +113,7 @@ void app_main(void)
 
         /* Wait for device disconnection and start over */
         xSemaphoreTake(device_disconnected_sem, portMAX_DELAY);
+        vSemaphoreDelete(device_disconnected_sem);
+        loader_port_esp32_usb_cdc_acm_deinit();
     }
 }
@@ -0,0 +1,922 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "daemon.h"
+#include "esp_loader.h"
+#include "linux_port.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAX_CLIENTS 32
+#define MAX_LINE 4096
+// Finished jobs kept for WAIT
+#define JOB_HISTORY 64
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+typedef struct image {
+    struct image *next;
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    const uint8_t *data;        // Read only mapping, shared by all jobs and workers
+    uint32_t size;
+    unsigned refs;
+    bool md5_known;             // Read back from a target after a verified write
+    uint8_t md5[16];
+} image_t;
+
+typedef struct job {
+    struct job *next;
+    uint32_t id;
+    unsigned tasks;
+    unsigned succeeded;
+    unsigned failed;
+    unsigned waiters;
+    unsigned image_count;
+    uint32_t address[DAEMON_MAX_IMAGES];
+    image_t *image[DAEMON_MAX_IMAGES];
+} job_t;
+
+typedef struct device {
+    struct device *next;
+    char path[PATH_MAX];
+    bool removed;
+    bool busy;
+    int chip;
+    unsigned jobs;
+    unsigned failed;
+    uint64_t written;
+    uint64_t skipped;
+    uint64_t last_rate;         // Bytes per second of the last job writing any data
+} device_t;
+
+// One job on one device, any idle device takes a task without one
+typedef struct task {
+    struct task *next;
+    job_t *job;
+    device_t *device;
+} task_t;
+
+// Sent by a worker process to its thread over a pipe
+typedef enum {
+    REPORT_CHIP,
+    REPORT_WRITTEN,
+    REPORT_SKIPPED,
+    REPORT_DIGEST,
+    REPORT_RESULT,
+} report_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t image;
+    uint32_t value;
+    uint8_t md5[16];
+} report_t;
+
+static daemon_config_t s_config;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_work = PTHREAD_COND_INITIALIZER;    // New task, device removed or stop
+static pthread_cond_t s_done = PTHREAD_COND_INITIALIZER;    // Job, worker or client ended
+static bool s_stopping;
+
+static image_t *s_images;
+static job_t *s_jobs;
+static task_t *s_tasks;
+static device_t *s_devices;
+static uint32_t s_next_job_id = 1;
+static unsigned s_workers;
+
+static char s_socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int s_listen = -1;
+static pthread_t s_accept_thread;
+static int s_clients[MAX_CLIENTS];
+static unsigned s_client_count;
+
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* ---------------------------------------------------------------------------------------- */
+/* Images, all called with s_lock held                                                      */
+/* ---------------------------------------------------------------------------------------- */
+
+static void image_free(image_t *image)
+{
+    munmap((void *)image->data, image->size);
+    free(image->path);
+    free(image);
+}
+
+static image_t *image_get(const char *path)
+{
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || st.st_size > UINT32_MAX) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // The same file, unchanged since it was mapped, is shared together with its digest
+    for (image_t **link = &s_images; *link != NULL;) {
+        image_t *image = *link;
+        if (image->dev == st.st_dev && image->ino == st.st_ino && image->size == st.st_size &&
+                image->mtime.tv_sec == st.st_mtim.tv_sec &&
+                image->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            close(fd);
+            image->refs++;
+            return image;
+        }
+
+        // Older versions of the file are dropped once no job uses them
+        if (image->refs == 0 && strcmp(image->path, path) == 0) {
+            *link = image->next;
+            image_free(image);
+        } else {
+            link = &image->next;
+        }
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    image_t *image = calloc(1, sizeof(image_t));
+    char *image_path = strdup(path);
+    if (image == NULL || image_path == NULL) {
+        munmap(data, st.st_size);
+        free(image_path);
+        free(image);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    image->path = image_path;
+    image->dev = st.st_dev;
+    image->ino = st.st_ino;
+    image->mtime = st.st_mtim;
+    image->data = data;
+    image->size = st.st_size;
+    image->refs = 1;
+    image->next = s_images;
+    s_images = image;
+    return image;
+}
+
+/* ---------------------------------------------------------------------------------------- */
+/* Jobs and tasks, all called with s_lock held                                              */
+/* ---------------------------------------------------------------------------------------- */
+
+static bool job_finished(const job_t *job)
+{
+    return job->succeeded + job->failed == job->tasks;
+}
+
+static void job_release(job_t *job)
+{
+    for (unsigned i = 0; i < job->image_count; i++) {
+        job->image[i]->refs--;
+    }
+}
+
+static job_t *job_find(uint32_t id)
+{
+    for (job_t *job = s_jobs; job != NULL; job = job->next) {
+        if (job->id == id) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// Keeps the newest JOB_HISTORY finished jobs, besides the running ones
+static void jobs_prune(void)
+{
+    unsigned finished = 0;
+    for (job_t **link = &s_jobs; *link != NULL;) {
+        job_t *job = *link;
+        if (job_finished(job) && job->waiters == 0 && ++finished > JOB_HISTORY) {
+            *link = job->next;
+            free(job);
+        } else {
+            link = &job->next;
+        }
+    }
+}
+
+static void task_finish(task_t *task, bool success)
+{
+    job_t *job = task->job;
+    if (success) {
+        job->succeeded++;
+    } else {
+        job->failed++;
+    }
+
+    if (job_finished(job)) {
+        job_release(job);
+        pthread_cond_broadcast(&s_done);
+    }
+    free(task);
+}
+
+static void task_queue(job_t *job, device_t *device)
+{
+    task_t *task = calloc(1, sizeof(task_t));
+    if (task == NULL) {
+        job->tasks++;
+        job->failed++;
+        return;
+    }
+    task->job = job;
+    task->device = device;
+    job->tasks++;
+
+    task_t **link = &s_tasks;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = task;
+}
+
+// Fails the queued tasks of a removed device, or all of them on stop
+static void tasks_fail(const device_t *device)
+{
+    for (task_t **link = &s_tasks; *link != NULL;) {
+        task_t *task = *link;
+        if (device == NULL || task->device == device) {
+            *link = task->next;
+            task_finish(task, false);
+        } else {
+            link = &task->next;
+        }
+    }
+}
+
+static task_t *task_take(const device_t *device)
+{
+    for (task_t **link = &s_tasks; *link != NULL; link = &(*link)->next) {
+        task_t *task = *link;
+        if (task->device == NULL || task->device == device) {
+            *link = task->next;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------- */
+/* Worker process, a fresh copy of the daemon with no other thread running                  */
+/* ---------------------------------------------------------------------------------------- */
+
+static void report(int fd, report_type_t type, unsigned image, uint32_t value, const uint8_t *md5)
+{
+    report_t message = { .type = type, .image = image, .value = value };
+    if (md5 != NULL) {
+        memcpy(message.md5, md5, sizeof(message.md5));
+    }
+    // Smaller than PIPE_BUF, so written at once
+    (void)!write(fd, &message, sizeof(message));
+}
+
+static esp_loader_error_t write_image(const image_t *image, uint32_t address, unsigned index, int fd)
+{
+    const uint32_t block_size = s_config.block_size;
+    RETURN_ON_ERROR( esp_loader_flash_start(address, image->size, block_size) );
+
+    for (uint32_t written = 0; written < image->size;) {
+        const uint32_t size = MIN(block_size, image->size - written);
+
+        /* The loader pads a short block in place up to block_size, the mapping is read only
+           and shared, so that block is written from a copy */
+        if (size < block_size) {
+            static uint8_t last_block[DAEMON_MAX_BLOCK_SIZE];
+            memcpy(last_block, &image->data[written], size);
+            RETURN_ON_ERROR( esp_loader_flash_write(last_block, size) );
+        } else {
+            RETURN_ON_ERROR( esp_loader_flash_write((void *)&image->data[written], size) );
+        }
+
+        written += size;
+        report(fd, REPORT_WRITTEN, index, size, NULL);
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t flash_job(const job_t *job, int fd)
+{
+    esp_loader_connect_args_t connect_args = ESP_LOADER_CONNECT_DEFAULT();
+    RETURN_ON_ERROR( esp_loader_connect_with_stub(&connect_args) );
+    report(fd, REPORT_CHIP, 0, esp_loader_get_target(), NULL);
+
+    if (s_config.higher_baudrate != 0 && s_config.higher_baudrate != s_config.baudrate) {
+        RETURN_ON_ERROR( esp_loader_change_transmission_rate_stub(s_config.baudrate,
+                         s_config.higher_baudrate) );
+        RETURN_ON_ERROR( loader_port_change_transmission_rate(s_config.higher_baudrate) );
+    }
+
+    for (unsigned i = 0; i < job->image_count; i++) {
+        const image_t *image = job->image[i];
+        const uint32_t address = job->address[i];
+        uint8_t md5[16];
+
+        // A region already holding the image is left as it is
+        if (image->md5_known &&
+                esp_loader_flash_md5(address, image->size, md5) == ESP_LOADER_SUCCESS &&
+                memcmp(md5, image->md5, sizeof(md5)) == 0) {
+            report(fd, REPORT_SKIPPED, i, image->size, NULL);
+            continue;
+        }
+
+        RETURN_ON_ERROR( write_image(image, address, i, fd) );
+
+        /* The first target to take an image checks it against the digest of the written data,
+           the digest it reads back then serves every later job */
+        if (image->md5_known) {
+            RETURN_ON_ERROR( esp_loader_flash_md5(address, image->size, md5) );
+            if (memcmp(md5, image->md5, sizeof(md5)) != 0) {
+                return ESP_LOADER_ERROR_INVALID_MD5;
+            }
+        } else {
+            RETURN_ON_ERROR( esp_loader_flash_verify() );
+            RETURN_ON_ERROR( esp_loader_flash_md5(address, image->size, md5) );
+            report(fd, REPORT_DIGEST, i, 0, md5);
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static void worker_process(const device_t *device, const job_t *job, int fd)
+{
+    const loader_linux_config_t config = {
+        .device = device->path,
+        .baudrate = s_config.baudrate,
+    };
+
+    esp_loader_error_t err = loader_port_linux_init(&config);
+    if (err == ESP_LOADER_SUCCESS) {
+        err = flash_job(job, fd);
+        esp_loader_reset_target();
+        loader_port_linux_deinit();
+    }
+
+    report(fd, REPORT_RESULT, 0, err, NULL);
+    _exit(0);
+}
+
+/* ---------------------------------------------------------------------------------------- */
+/* Worker threads, one per device                                                           */
+/* ---------------------------------------------------------------------------------------- */
+
+static bool read_report(int fd, report_t *message)
+{
+    uint8_t *data = (uint8_t *)message;
+    size_t received = 0;
+
+    while (received < sizeof(*message)) {
+        const ssize_t result = read(fd, data + received, sizeof(*message) - received);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        received += result;
+    }
+    return true;
+}
+
+static bool run_task(device_t *device, const task_t *task)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return false;
+    }
+
+    const uint64_t start_ms = now_ms();
+    const pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Keeps the pipes, sockets and devices of the other workers and clients open no longer
+        close_range(3, fds[1] - 1, 0);
+        close_range(fds[1] + 1, ~0U, 0);
+        worker_process(device, task->job, fds[1]);
+    }
+    close(fds[1]);
+
+    esp_loader_error_t result = ESP_LOADER_ERROR_FAIL;
+    uint64_t written = 0;
+    report_t message;
+    bool ended = false;
+    while (!ended && read_report(fds[0], &message)) {
+        pthread_mutex_lock(&s_lock);
+        switch (message.type) {
+        case REPORT_CHIP:
+            device->chip = message.value;
+            break;
+        case REPORT_WRITTEN:
+            device->written += message.value;
+            written += message.value;
+            break;
+        case REPORT_SKIPPED:
+            device->skipped += message.value;
+            break;
+        case REPORT_DIGEST:
+            if (message.image < task->job->image_count) {
+                image_t *image = task->job->image[message.image];
+                memcpy(image->md5, message.md5, sizeof(image->md5));
+                image->md5_known = true;
+            }
+            break;
+        case REPORT_RESULT:
+            // Not waiting for the end of the pipe, a process forked meanwhile may hold it open
+            result = message.value;
+            ended = true;
+            break;
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    if (written > 0) {
+        const uint64_t elapsed_ms = MAX(now_ms() - start_ms, 1);
+        pthread_mutex_lock(&s_lock);
+        device->last_rate = written * 1000 / elapsed_ms;
+        pthread_mutex_unlock(&s_lock);
+    }
+
+    if (result != ESP_LOADER_SUCCESS) {
+        fprintf(stderr, "%s: job %u failed with error %d\n", device->path, task->job->id, result);
+    }
+    return result == ESP_LOADER_SUCCESS;
+}
+
+static void *worker_thread(void *arg)
+{
+    device_t *device = arg;
+
+    pthread_mutex_lock(&s_lock);
+    while (!s_stopping && !device->removed) {
+        task_t *task = task_take(device);
+        if (task == NULL) {
+            pthread_cond_wait(&s_work, &s_lock);
+            continue;
+        }
+
+        device->busy = true;
+        pthread_mutex_unlock(&s_lock);
+        const bool success = run_task(device, task);
+        pthread_mutex_lock(&s_lock);
+        device->busy = false;
+        device->jobs++;
+        if (!success) {
+            device->failed++;
+        }
+        task_finish(task, success);
+    }
+
+    for (device_t **link = &s_devices; *link != NULL; link = &(*link)->next) {
+        if (*link == device) {
+            *link = device->next;
+            break;
+        }
+    }
+    free(device);
+    s_workers--;
+    pthread_cond_broadcast(&s_done);
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+static device_t *device_find(const char *path)
+{
+    for (device_t *device = s_devices; device != NULL; device = device->next) {
+        if (!device->removed && strcmp(device->path, path) == 0) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+int daemon_add_device(const char *path)
+{
+    if (strlen(path) >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    if (s_stopping || device_find(path) != NULL) {
+        pthread_mutex_unlock(&s_lock);
+        errno = EEXIST;
+        return -1;
+    }
+
+    device_t *device = calloc(1, sizeof(device_t));
+    if (device == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        errno = ENOMEM;
+        return -1;
+    }
+    strcpy(device->path, path);
+    device->chip = ESP_UNKNOWN_CHIP;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int err = pthread_create(&thread, &attr, worker_thread, device);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        pthread_mutex_unlock(&s_lock);
+        free(device);
+        errno = err;
+        return -1;
+    }
+
+    device->next = s_devices;
+    s_devices = device;
+    s_workers++;
+    pthread_mutex_unlock(&s_lock);
+
+    fprintf(stderr, "%s: added\n", path);
+    return 0;
+}
+
+void daemon_remove_device(const char *path)
+{
+    pthread_mutex_lock(&s_lock);
+    device_t *device = device_find(path);
+    if (device != NULL) {
+        device->removed = true;
+        tasks_fail(device);
+        pthread_cond_broadcast(&s_work);
+        fprintf(stderr, "%s: removed\n", path);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+/* ---------------------------------------------------------------------------------------- */
+/* Control socket                                                                           */
+/* ---------------------------------------------------------------------------------------- */
+
+static void reply(int fd, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void reply(int fd, const char *format, ...)
+{
+    char line[MAX_LINE];
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    (void)!send(fd, line, MIN((size_t)length, sizeof(line) - 1), MSG_NOSIGNAL);
+}
+
+// FLASH <device path | any | all> <address> <file> [<address> <file> ...]
+static void command_flash(int fd, char *args)
+{
+    char *save;
+    const char *target = strtok_r(args, " ", &save);
+    if (target == NULL) {
+        reply(fd, "ERR missing target\n");
+        return;
+    }
+
+    job_t *job = calloc(1, sizeof(job_t));
+    if (job == NULL) {
+        reply(fd, "ERR out of memory\n");
+        return;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    const char *error = NULL;
+    for (char *token; error == NULL && (token = strtok_r(NULL, " ", &save)) != NULL;) {
+        char *end;
+        const unsigned long address = strtoul(token, &end, 0);
+        const char *path = strtok_r(NULL, " ", &save);
+        if (*end != '\0' || address > UINT32_MAX || address % 4096 != 0 || path == NULL) {
+            error = "images are given as <sector aligned address> <file>";
+        } else if (job->image_count == DAEMON_MAX_IMAGES) {
+            error = "too many images";
+        } else if ((job->image[job->image_count] = image_get(path)) == NULL) {
+            error = strerror(errno);
+        } else {
+            job->address[job->image_count++] = address;
+        }
+    }
+    if (error == NULL && job->image_count == 0) {
+        error = "no image";
+    }
+
+    device_t *device = NULL;
+    if (error == NULL && strcmp(target, "any") != 0 && strcmp(target, "all") != 0 &&
+            (device = device_find(target)) == NULL) {
+        error = "unknown device";
+    }
+
+    if (error == NULL) {
+        if (strcmp(target, "all") == 0) {
+            for (device_t *each = s_devices; each != NULL; each = each->next) {
+                if (!each->removed) {
+                    task_queue(job, each);
+                }
+            }
+        } else {
+            task_queue(job, device);
+        }
+        if (job->tasks == 0) {
+            error = "no device";
+        }
+    }
+
+    if (error != NULL) {
+        job_release(job);
+        pthread_mutex_unlock(&s_lock);
+        free(job);
+        reply(fd, "ERR %s\n", error);
+        return;
+    }
+
+    job->id = s_next_job_id++;
+    job->next = s_jobs;
+    s_jobs = job;
+    jobs_prune();
+    const uint32_t id = job->id;
+    pthread_cond_broadcast(&s_work);
+    if (job_finished(job)) {
+        job_release(job);
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    reply(fd, "OK %u\n", id);
+}
+
+// WAIT <job>, answers once every task of the job has ended
+static void command_wait(int fd, const char *args)
+{
+    char *end;
+    const unsigned long id = strtoul(args, &end, 0);
+
+    pthread_mutex_lock(&s_lock);
+    job_t *job = *end == '\0' ? job_find(id) : NULL;
+    if (job == NULL) {
+        pthread_mutex_unlock(&s_lock);
+        reply(fd, "ERR unknown job\n");
+        return;
+    }
+
+    job->waiters++;
+    while (!job_finished(job) && !s_stopping) {
+        pthread_cond_wait(&s_done, &s_lock);
+    }
+    job->waiters--;
+    const bool finished = job_finished(job);
+    const unsigned succeeded = job->succeeded;
+    const unsigned failed = job->failed;
+    pthread_mutex_unlock(&s_lock);
+
+    if (!finished) {
+        reply(fd, "ERR stopping\n");
+    } else {
+        reply(fd, "OK %lu %u %u\n", id, succeeded, failed);
+    }
+}
+
+// STATUS, one line per device followed by OK
+static void command_status(int fd)
+{
+    pthread_mutex_lock(&s_lock);
+    for (const device_t *device = s_devices; device != NULL; device = device->next) {
+        reply(fd, "DEVICE %s %s chip=%d jobs=%u failed=%u written=%" PRIu64 " skipped=%" PRIu64
+              " rate=%" PRIu64 "\n", device->path,
+              device->removed ? "removed" : device->busy ? "busy" : "idle", device->chip,
+              device->jobs, device->failed, device->written, device->skipped, device->last_rate);
+    }
+    pthread_mutex_unlock(&s_lock);
+    reply(fd, "OK\n");
+}
+
+static void command(int fd, char *line)
+{
+    char *args = strchr(line, ' ');
+    if (args != NULL) {
+        *args++ = '\0';
+    } else {
+        args = line + strlen(line);
+    }
+
+    if (strcmp(line, "FLASH") == 0) {
+        command_flash(fd, args);
+    } else if (strcmp(line, "WAIT") == 0) {
+        command_wait(fd, args);
+    } else if (strcmp(line, "STATUS") == 0) {
+        command_status(fd);
+    } else {
+        reply(fd, "ERR unknown command\n");
+    }
+}
+
+static void *client_thread(void *arg)
+{
+    const int fd = (intptr_t)arg;
+    char line[MAX_LINE];
+    size_t length = 0;
+
+    for (;;) {
+        const ssize_t received = recv(fd, &line[length], sizeof(line) - 1 - length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        length += received;
+        line[length] = '\0';
+
+        char *start = line;
+        for (char *end; (end = strchr(start, '\n')) != NULL; start = end + 1) {
+            *end = '\0';
+            if (end > start && end[-1] == '\r') {
+                end[-1] = '\0';
+            }
+            command(fd, start);
+        }
+
+        length -= start - line;
+        memmove(line, start, length);
+        if (length == sizeof(line) - 1) {
+            reply(fd, "ERR line too long\n");
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&s_lock);
+    for (unsigned i = 0; i < s_client_count; i++) {
+        if (s_clients[i] == fd) {
+            s_clients[i] = s_clients[--s_client_count];
+            break;
+        }
+    }
+    close(fd);
+    pthread_cond_broadcast(&s_done);
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+static void *accept_thread(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        const int fd = accept4(s_listen, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&s_lock);
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (s_stopping || s_client_count == MAX_CLIENTS ||
+                pthread_create(&thread, &attr, client_thread, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+        } else {
+            s_clients[s_client_count++] = fd;
+        }
+        pthread_attr_destroy(&attr);
+        pthread_mutex_unlock(&s_lock);
+    }
+    return NULL;
+}
+
+int daemon_start(const daemon_config_t *config)
+{
+    if (config->block_size == 0 || config->block_size > DAEMON_MAX_BLOCK_SIZE ||
+            strlen(config->socket_path) >= sizeof(s_socket_path)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    s_config = *config;
+    strcpy(s_socket_path, config->socket_path);
+    s_config.socket_path = s_socket_path;
+    s_stopping = false;
+
+    s_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s_listen < 0) {
+        return -1;
+    }
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strcpy(address.sun_path, s_socket_path);
+    unlink(s_socket_path);
+
+    if (bind(s_listen, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            listen(s_listen, MAX_CLIENTS) < 0) {
+        goto fail;
+    }
+
+    const int err = pthread_create(&s_accept_thread, NULL, accept_thread, NULL);
+    if (err != 0) {
+        errno = err;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    close(s_listen);
+    s_listen = -1;
+    return -1;
+}
+
+void daemon_stop(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_stopping = true;
+    tasks_fail(NULL);
+    pthread_cond_broadcast(&s_work);
+    pthread_cond_broadcast(&s_done);
+    pthread_mutex_unlock(&s_lock);
+
+    // Wakes the accept thread, then the clients blocked in recv
+    shutdown(s_listen, SHUT_RDWR);
+    pthread_join(s_accept_thread, NULL);
+    close(s_listen);
+    s_listen = -1;
+    unlink(s_socket_path);
+
+    pthread_mutex_lock(&s_lock);
+    for (unsigned i = 0; i < s_client_count; i++) {
+        shutdown(s_clients[i], SHUT_RDWR);
+    }
+    while (s_client_count > 0 || s_workers > 0) {
+        pthread_cond_wait(&s_done, &s_lock);
+    }
+
+    while (s_jobs != NULL) {
+        job_t *job = s_jobs;
+        s_jobs = job->next;
+        free(job);
+    }
+    while (s_images != NULL) {
+        image_t *image = s_images;
+        s_images = image->next;
+        image_free(image);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
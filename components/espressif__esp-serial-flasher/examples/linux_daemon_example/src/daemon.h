@@ -0,0 +1,65 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Images written by one job
+#define DAEMON_MAX_IMAGES 16
+#define DAEMON_MAX_BLOCK_SIZE 0x10000
+
+typedef struct {
+    const char *socket_path;    /*!< Unix socket the jobs are submitted to */
+    uint32_t baudrate;          /*!< Rate the targets are connected at */
+    uint32_t higher_baudrate;   /*!< Rate once the stub runs, 0 keeps baudrate */
+    uint32_t block_size;        /*!< Bytes per FLASH_DATA block, up to DAEMON_MAX_BLOCK_SIZE */
+} daemon_config_t;
+
+/**
+  * @brief Starts accepting jobs on the socket.
+  *
+  * Each device gets a worker thread. The loader keeps its state in globals, so a worker
+  * runs every job in a child process of its own, which inherits the images mapped by the
+  * daemon instead of reading them again.
+  *
+  * @return 0 on success, -1 with errno set otherwise.
+  */
+int daemon_start(const daemon_config_t *config);
+
+/**
+  * @brief Fails the queued jobs, waits for the running ones and closes the socket.
+  */
+void daemon_stop(void);
+
+/**
+  * @brief Adds a serial device, its worker picks up queued jobs right away.
+  *
+  * @return 0 on success, -1 if the device is already known.
+  */
+int daemon_add_device(const char *path);
+
+/**
+  * @brief Removes a serial device, once its current job, if any, has ended.
+  */
+void daemon_remove_device(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,164 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "hotplug.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+// Multicast group of the events sent by the kernel, udev forwards them to group 2
+#define KERNEL_EVENTS 1
+
+int hotplug_open(void)
+{
+    const int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                          NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_nl address = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = KERNEL_EVENTS,
+    };
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool is_serial_name(const char *name)
+{
+    return strncmp(name, "ttyACM", 6) == 0 || strncmp(name, "ttyUSB", 6) == 0;
+}
+
+hotplug_action_t hotplug_parse(const char *message, size_t size, char *name, size_t name_size)
+{
+    const char *action = NULL;
+    const char *subsystem = NULL;
+    const char *devname = NULL;
+
+    // The header, e.g. add@/devices/..., is followed by NUL terminated KEY=value strings
+    for (size_t offset = 0; offset < size;) {
+        const char *field = &message[offset];
+        const size_t length = strnlen(field, size - offset);
+
+        if (strncmp(field, "ACTION=", 7) == 0) {
+            action = field + 7;
+        } else if (strncmp(field, "SUBSYSTEM=", 10) == 0) {
+            subsystem = field + 10;
+        } else if (strncmp(field, "DEVNAME=", 8) == 0) {
+            devname = field + 8;
+        }
+        offset += length + 1;
+    }
+
+    // A field cut by the end of the message is not terminated
+    if (size == 0 || message[size - 1] != '\0' || action == NULL || subsystem == NULL ||
+            devname == NULL || strcmp(subsystem, "tty") != 0) {
+        return HOTPLUG_NONE;
+    }
+
+    // DEVNAME is relative to /dev
+    const char *base = strrchr(devname, '/');
+    base = base != NULL ? base + 1 : devname;
+    if (!is_serial_name(base) || strlen(base) >= name_size) {
+        return HOTPLUG_NONE;
+    }
+    strcpy(name, base);
+
+    if (strcmp(action, "add") == 0) {
+        return HOTPLUG_ADD;
+    }
+    if (strcmp(action, "remove") == 0) {
+        return HOTPLUG_REMOVE;
+    }
+    return HOTPLUG_NONE;
+}
+
+static bool read_id(const char *dir, const char *file, unsigned *id)
+{
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    const bool found = fscanf(f, "%x", id) == 1;
+    fclose(f);
+    return found;
+}
+
+bool hotplug_match(const hotplug_filter_t *filter, const char *name)
+{
+    if (!is_serial_name(name)) {
+        return false;
+    }
+    if (filter->id_count == 0) {
+        return true;
+    }
+
+    char link[PATH_MAX];
+    char dir[PATH_MAX];
+    snprintf(link, sizeof(link), "/sys/class/tty/%s/device", name);
+    if (realpath(link, dir) == NULL) {
+        return false;
+    }
+
+    // The interface the tty belongs to sits below the USB device holding the IDs
+    unsigned vid;
+    unsigned pid;
+    while (!read_id(dir, "idVendor", &vid) || !read_id(dir, "idProduct", &pid)) {
+        char *parent = strrchr(dir, '/');
+        if (parent == NULL || parent == dir) {
+            return false;
+        }
+        *parent = '\0';
+    }
+
+    for (size_t i = 0; i < filter->id_count; i++) {
+        if (filter->ids[i].vid == vid && filter->ids[i].pid == pid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void hotplug_scan(const hotplug_filter_t *filter, void (*add)(const char *path))
+{
+    DIR *dir = opendir("/sys/class/tty");
+    if (dir == NULL) {
+        return;
+    }
+
+    for (struct dirent *entry; (entry = readdir(dir)) != NULL;) {
+        if (hotplug_match(filter, entry->d_name)) {
+            char path[sizeof("/dev/") + sizeof(entry->d_name)];
+            snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+            add(path);
+        }
+    }
+    closedir(dir);
+}
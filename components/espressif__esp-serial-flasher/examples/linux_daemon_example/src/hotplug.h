@@ -0,0 +1,78 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOTPLUG_MAX_IDS 16
+
+typedef enum {
+    HOTPLUG_NONE,
+    HOTPLUG_ADD,
+    HOTPLUG_REMOVE,
+} hotplug_action_t;
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+} hotplug_id_t;
+
+typedef struct {
+    hotplug_id_t ids[HOTPLUG_MAX_IDS];  /*!< USB IDs of the bridges to pick up */
+    size_t id_count;                    /*!< 0 picks up every ttyACM and ttyUSB device */
+} hotplug_filter_t;
+
+/**
+  * @brief Opens a socket receiving the kernel uevents, the ones udev acts on.
+  *
+  * @return Socket descriptor, -1 with errno set on failure.
+  */
+int hotplug_open(void);
+
+/**
+  * @brief Parses a uevent of a USB serial device.
+  *
+  * @param message[in]      Uevent as received, a header followed by KEY=value strings.
+  * @param size[in]         Size of the uevent.
+  * @param name[out]        Kernel name of the device, e.g. ttyACM0.
+  * @param name_size[in]    Size of the name buffer.
+  *
+  * @return HOTPLUG_ADD or HOTPLUG_REMOVE, HOTPLUG_NONE for any other event.
+  */
+hotplug_action_t hotplug_parse(const char *message, size_t size, char *name, size_t name_size);
+
+/**
+  * @brief Checks the USB IDs of a serial device against the filter.
+  *
+  * The IDs are read from the USB device the tty belongs to in sysfs, so a device already
+  * gone no longer matches.
+  */
+bool hotplug_match(const hotplug_filter_t *filter, const char *name);
+
+/**
+  * @brief Calls add with the device path of every matching serial device present.
+  */
+void hotplug_scan(const hotplug_filter_t *filter, void (*add)(const char *path));
+
+#ifdef __cplusplus
+}
+#endif
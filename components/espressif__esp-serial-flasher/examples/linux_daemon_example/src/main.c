@@ -0,0 +1,179 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "daemon.h"
+#include "hotplug.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+
+#define DEFAULT_SOCKET "/run/esp-flasher.sock"
+#define DEFAULT_BAUDRATE 115200
+#define DEFAULT_HIGHER_BAUDRATE 921600
+#define DEFAULT_BLOCK_SIZE 0x4000
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-s socket] [-b baudrate] [-B baudrate] [-k block size]\n"
+            "          [-m vid:pid]... [-d device]...\n"
+            "  -s  Socket the jobs are submitted to, " DEFAULT_SOCKET " by default\n"
+            "  -b  Baud rate the targets are connected at\n"
+            "  -B  Baud rate once the stub runs, 0 keeps the first one\n"
+            "  -k  Bytes per flash block\n"
+            "  -m  USB IDs of the serial bridges picked up, every ttyACM and ttyUSB by default\n"
+            "  -d  Fixed device, disables the device discovery\n", name);
+}
+
+static void add_device(const char *path)
+{
+    if (daemon_add_device(path) < 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    }
+}
+
+static void handle_uevent(int fd, const hotplug_filter_t *filter)
+{
+    char message[8192];
+    ssize_t size;
+
+    while ((size = recv(fd, message, sizeof(message), 0)) > 0) {
+        char name[NAME_MAX];
+        char path[PATH_MAX];
+
+        const hotplug_action_t action = hotplug_parse(message, size, name, sizeof(name));
+        if (action == HOTPLUG_NONE) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/dev/%s", name);
+
+        if (action == HOTPLUG_ADD && hotplug_match(filter, name)) {
+            add_device(path);
+        } else if (action == HOTPLUG_REMOVE) {
+            daemon_remove_device(path);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    daemon_config_t config = {
+        .socket_path = DEFAULT_SOCKET,
+        .baudrate = DEFAULT_BAUDRATE,
+        .higher_baudrate = DEFAULT_HIGHER_BAUDRATE,
+        .block_size = DEFAULT_BLOCK_SIZE,
+    };
+    hotplug_filter_t filter = { 0 };
+    const char *devices[64];
+    size_t device_count = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:b:B:k:m:d:h")) != -1) {
+        unsigned vid;
+        unsigned pid;
+
+        switch (option) {
+        case 's':
+            config.socket_path = optarg;
+            break;
+        case 'b':
+            config.baudrate = strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            config.higher_baudrate = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            config.block_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (filter.id_count == HOTPLUG_MAX_IDS ||
+                    sscanf(optarg, "%x:%x", &vid, &pid) != 2 || vid > 0xffff || pid > 0xffff) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            filter.ids[filter.id_count++] = (hotplug_id_t) {
+                vid, pid
+            };
+            break;
+        case 'd':
+            if (device_count == sizeof(devices) / sizeof(devices[0])) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            devices[device_count++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // Handled through the signal descriptor, the worker threads inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    const int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    if (daemon_start(&config) < 0) {
+        fprintf(stderr, "%s: %s\n", config.socket_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    int uevent_fd = -1;
+    if (device_count > 0) {
+        for (size_t i = 0; i < device_count; i++) {
+            add_device(devices[i]);
+        }
+    } else {
+        // Opened before the scan, so no device plugged in meanwhile is missed
+        uevent_fd = hotplug_open();
+        if (uevent_fd < 0) {
+            fprintf(stderr, "uevent socket: %s\n", strerror(errno));
+        }
+        hotplug_scan(&filter, add_device);
+    }
+
+    fprintf(stderr, "Waiting for jobs on %s\n", config.socket_path);
+
+    for (;;) {
+        struct pollfd fds[] = {
+            { signal_fd, POLLIN, 0 },
+            { uevent_fd, POLLIN, 0 },
+        };
+        if (poll(fds, uevent_fd < 0 ? 1 : 2, -1) < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            handle_uevent(uevent_fd, &filter);
+        }
+    }
+
+    fprintf(stderr, "Stopping\n");
+    daemon_stop();
+    return EXIT_SUCCESS;
+}
@@ -49,22 +49,69 @@ typedef enum {
     ESP_LOADER_ERROR_INVALID_TARGET,   /*!< Connected target is invalid */
     ESP_LOADER_ERROR_UNSUPPORTED_CHIP, /*!< Attached chip is not supported */
     ESP_LOADER_ERROR_UNSUPPORTED_FUNC, /*!< Function is not supported on attached target */
-    ESP_LOADER_ERROR_INVALID_RESPONSE  /*!< Internal error */
+    ESP_LOADER_ERROR_INVALID_RESPONSE, /*!< Internal error */
+    ESP_LOADER_ERROR_INVALID_DIGEST    /*!< Computed and expected SHA-256 does not match */
 } esp_loader_error_t;
 
+/* Targets the library is built for, selected by SERIAL_FLASHER_TARGETS. Builds which do not
+   select any get all of them. */
+#ifndef SERIAL_FLASHER_TARGET_ESP8266
+#define SERIAL_FLASHER_TARGET_ESP8266 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32
+#define SERIAL_FLASHER_TARGET_ESP32 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32S2
+#define SERIAL_FLASHER_TARGET_ESP32S2 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32C3
+#define SERIAL_FLASHER_TARGET_ESP32C3 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32S3
+#define SERIAL_FLASHER_TARGET_ESP32S3 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32C2
+#define SERIAL_FLASHER_TARGET_ESP32C2 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32H2
+#define SERIAL_FLASHER_TARGET_ESP32H2 1
+#endif
+#ifndef SERIAL_FLASHER_TARGET_ESP32C6
+#define SERIAL_FLASHER_TARGET_ESP32C6 1
+#endif
+
 /**
  * @brief Supported targets
+ *
+ * @note  Only the targets selected for the build are declared, so code referring to one left
+ *        out of the build does not compile. The values do not depend on the selection.
  */
 typedef enum {
+#if SERIAL_FLASHER_TARGET_ESP8266
     ESP8266_CHIP = 0,
+#endif
+#if SERIAL_FLASHER_TARGET_ESP32
     ESP32_CHIP   = 1,
+#endif
+#if SERIAL_FLASHER_TARGET_ESP32S2
     ESP32S2_CHIP = 2,
+#endif
+#if SERIAL_FLASHER_TARGET_ESP32C3
     ESP32C3_CHIP = 3,
+#endif
+#if SERIAL_FLASHER_TARGET_ESP32S3
     ESP32S3_CHIP = 4,
+#endif
+#if SERIAL_FLASHER_TARGET_ESP32C2
     ESP32C2_CHIP = 5,
+#endif
     ESP32_RESERVED0_CHIP = 6, // Reserved for future use
+#if SERIAL_FLASHER_TARGET_ESP32H2
     ESP32H2_CHIP = 7,
+#endif
+#if SERIAL_FLASHER_TARGET_ESP32C6
     ESP32C6_CHIP = 8,
+#endif
     ESP_MAX_CHIP = 9,
     ESP_UNKNOWN_CHIP = 9
 } target_chip_t;
@@ -113,6 +160,15 @@ typedef struct {
                                100 millisecond delay is inserted after each try. */
 } esp_loader_connect_args_t;
 
+/**
+ * @brief Register access of a batch run by esp_loader_run_register_batch()
+ */
+typedef struct {
+    bool write;         /*!< WRITE_REG if true, READ_REG otherwise. */
+    uint32_t address;   /*!< Address of the register. */
+    uint32_t value;     /*!< Value written, or the value read once the batch completes. */
+} esp_loader_reg_op_t;
+
 #define ESP_LOADER_CONNECT_DEFAULT() { \
   .sync_timeout = 100, \
   .trials = 10, \
@@ -127,6 +183,7 @@ typedef struct {
   *     - ESP_LOADER_SUCCESS Success
   *     - ESP_LOADER_ERROR_TIMEOUT Timeout
   *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_CHIP Target is not one the library is built for
   */
 esp_loader_error_t esp_loader_connect(esp_loader_connect_args_t *connect_args);
 
@@ -151,9 +208,29 @@ target_chip_t esp_loader_get_target(void);
   *     - ESP_LOADER_SUCCESS Success
   *     - ESP_LOADER_ERROR_TIMEOUT Timeout
   *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_CHIP Target is not one the library is built for
   */
 esp_loader_error_t esp_loader_connect_with_stub(esp_loader_connect_args_t *connect_args);
 
+/**
+  * @brief Connects to the target while using the flasher stub, reusing a stub still running
+  *        from a previous session
+  *
+  * @note  Before anything else, the stub is asked for a no-op, waiting up to sync_timeout
+  *        for the answer. If it answers, the target is neither reset nor is the stub uploaded
+  *        again, so the transmission rate must still be the one the stub was left at.
+  *        Otherwise this is esp_loader_connect_with_stub().
+  *
+  * @param connect_args[in] Timing parameters to be used for connecting to target.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_CHIP Target is not one the library is built for
+  */
+esp_loader_error_t esp_loader_connect_reuse_stub(esp_loader_connect_args_t *connect_args);
+
 #ifdef SERIAL_FLASHER_INTERFACE_UART
 /**
   * @brief Connects to the target running in secure download mode
@@ -173,10 +250,49 @@ esp_loader_error_t esp_loader_connect_with_stub(esp_loader_connect_args_t *conne
   *     - ESP_LOADER_SUCCESS Success
   *     - ESP_LOADER_ERROR_TIMEOUT Timeout
   *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_CHIP Target is not one the library is built for
   */
 esp_loader_error_t esp_loader_connect_secure_download_mode(esp_loader_connect_args_t *connect_args,
         uint32_t flash_size, target_chip_t target_chip);
 #endif /* SERIAL_FLASHER_INTERFACE_UART */
+#endif /* SERIAL_FLASHER_INTERFACE_UART || SERIAL_FLASHER_INTERFACE_USB */
+
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+/**
+  * @brief Flash writer executed from the RAM of the target
+  */
+typedef struct {
+    uint32_t entrypoint;                        /*!< Address the helper is started from */
+    const esp_loader_bin_segment_t *segments;   /*!< RAM segments of the helper */
+    uint32_t segment_count;
+} esp_loader_flash_helper_t;
+
+/**
+  * @brief Connects to the target and starts a flash writer helper in its RAM
+  *
+  * The ROM loader can only download to RAM over SPI. The helper is loaded with
+  * esp_loader_mem_start(), esp_loader_mem_write() and esp_loader_mem_finish(), it then has to
+  * take over the SPI slave peripheral and answer the commands of the flasher stub, in particular
+  * FLASH_BEGIN, FLASH_DATA, FLASH_END, SPI_SET_PARAMS and SPI_FLASH_MD5 with a raw 16 byte digest,
+  * and ERASE_REGION if esp_loader_flash_erase_region() is used.
+  * Once it has started, the handshake with the slave is repeated and the flash functions of
+  * this library become available.
+  *
+  * @note  The block size passed to esp_loader_flash_start() is limited by the receive buffer
+  *        the helper makes available in the slave.
+  *
+  * @param connect_args[in] Timing parameters to be used for connecting to target.
+  * @param helper[in]       Helper image, has to remain valid while connected.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_PARAM The helper has no segments
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  */
+esp_loader_error_t esp_loader_connect_with_flash_helper(esp_loader_connect_args_t *connect_args,
+        const esp_loader_flash_helper_t *helper);
+#endif /* SERIAL_FLASHER_INTERFACE_SPI */
 
 /**
   * @brief Initiates flash operation
@@ -192,9 +308,29 @@ esp_loader_error_t esp_loader_connect_secure_download_mode(esp_loader_connect_ar
   *     - ESP_LOADER_SUCCESS Success
   *     - ESP_LOADER_ERROR_TIMEOUT Timeout
   *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC The SPI interface is used without a flash helper
   */
 esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size, uint32_t block_size);
 
+/**
+  * @brief Erases a region of flash without writing it
+  *
+  * Erased flash reads as 0xFF, so runs of 0xFF in an image can be erased with this function
+  * instead of being transferred. The stub erases the region with a single command, the ROM
+  * loader as part of an empty flash operation, which ends any operation started before.
+  *
+  * @param offset[in] Start of the region. Must be 4 KiB aligned.
+  * @param size[in]   Size of the region. Must be a multiple of 4 KiB.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_PARAM The region is not sector aligned
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC The SPI interface is used without a flash helper
+  */
+esp_loader_error_t esp_loader_flash_erase_region(uint32_t offset, uint32_t size);
+
 /**
   * @brief Writes supplied data to target's flash memory.
   *
@@ -237,6 +373,8 @@ esp_loader_error_t esp_loader_flash_finish(bool reboot);
   */
 esp_loader_error_t esp_loader_flash_detect_size(uint32_t *flash_size);
 
+#if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
+
 /**
   * @brief Reads from the target flash.
   *
@@ -383,6 +521,28 @@ esp_loader_error_t esp_loader_write_register(uint32_t address, uint32_t reg_valu
   */
 esp_loader_error_t esp_loader_read_register(uint32_t address, uint32_t *reg_value);
 
+/**
+  * @brief Runs a sequence of register reads and writes.
+  *
+  * The operations are executed in order. Over UART and USB the commands are sent back to
+  * back and the responses are collected afterwards, so a whole sequence costs about one round
+  * trip instead of one per register. Over SPI they are sent one by one.
+  *
+  * @note  A read cannot depend on the result of an earlier read of the same batch, split
+  *        such sequences into several batches.
+  *
+  * @param ops[inout]   Operations, the value of each read is filled in.
+  * @param count[in]    Number of operations.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error, reported after all responses of
+  *       the batch have been received
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC The target is running in secure download mode
+  */
+esp_loader_error_t esp_loader_run_register_batch(esp_loader_reg_op_t *ops, uint32_t count);
+
 /**
   * @brief Change baud rate.
   *
@@ -419,6 +579,50 @@ esp_loader_error_t esp_loader_change_transmission_rate(uint32_t transmission_rat
 #if MD5_ENABLED
 esp_loader_error_t esp_loader_flash_verify(void);
 #endif
+
+/**
+  * @brief Reads the MD5 digest of a flash region, as computed by the target.
+  *
+  * @note  This function is only available if MD5_ENABLED is set. Together with a digest
+  *        computed earlier, it tells whether a region already holds an image, without
+  *        transferring the image.
+  *
+  * @param address[in]  Address of the region.
+  * @param size[in]     Size of the region.
+  * @param md5[out]     Raw 16 byte digest.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC Unsupported on the target
+  */
+#if MD5_ENABLED
+esp_loader_error_t esp_loader_flash_md5(uint32_t address, uint32_t size, uint8_t *md5);
+#endif
+
+/**
+  * @brief Verify that the written image is the expected one and that it reached target's
+  *        flash intact. The SHA-256 digest of the data passed to esp_loader_flash_write() is
+  *        computed on the host, by the SHA accelerator where there is one, and compared with
+  *        expected_sha256. The flash contents are then checked by the target itself, as in
+  *        esp_loader_flash_verify(), without reading the image back.
+  *
+  * @param expected_sha256[in]  SHA-256 digest of the whole image, 32 bytes.
+  *
+  * @note  This function is only available if SERIAL_FLASHER_SHA256_VERIFY is set.
+  *        It is called instead of esp_loader_flash_verify(), not in addition to it.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_INVALID_DIGEST SHA-256 of the written data does not match
+  *     - ESP_LOADER_ERROR_INVALID_MD5 Flash contents do not match the written data
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout
+  *     - ESP_LOADER_ERROR_INVALID_RESPONSE Internal error
+  */
+#if SERIAL_FLASHER_SHA256_VERIFY
+esp_loader_error_t esp_loader_flash_verify_sha256(const uint8_t *expected_sha256);
+#endif
 /**
   * @brief Toggles reset pin.
   */
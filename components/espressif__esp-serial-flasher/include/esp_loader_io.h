@@ -15,7 +15,9 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_loader.h"
 
 #ifdef __cplusplus
@@ -53,6 +55,31 @@ esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_
   */
 esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout);
 
+/**
+  * @brief Gives access to received data without copying it.
+  *
+  * @note  Can be defined by the port, together with loader_port_consume(), to let the SLIP
+  *        decoder read straight from the receive buffers. A weak implementation reading
+  *        one byte at a time with loader_port_read() is used otherwise.
+  *
+  * @param data[out]    Set to the received data, valid until loader_port_consume().
+  * @param size[out]    Set to the number of bytes available, at least one.
+  * @param timeout[in]  Timeout in milliseconds.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success, followed by one loader_port_consume() call
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout elapsed
+  */
+esp_loader_error_t loader_port_peek(const uint8_t **data, size_t *size, uint32_t timeout);
+
+/**
+  * @brief Releases data returned by loader_port_peek(), the bytes not consumed are returned
+  *        again by the next call.
+  *
+  * @param size[in]     Number of bytes read, from the start of the data.
+  */
+void loader_port_consume(size_t size);
+
 /**
   * @brief Delay in milliseconds.
   *
@@ -105,6 +132,57 @@ void loader_port_debug_print(const char *str);
   * @brief Sets the chip select to a defined level
   */
 void loader_port_spi_set_cs(uint32_t level);
+
+/**
+  * @brief Part of the data written in an SPI transaction
+  */
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+} loader_spi_segment_t;
+
+/**
+  * @brief Transaction with the SPI slave of the target
+  *
+  * The transaction starts with the preamble (command, address and dummy phase), followed
+  * by either all of the tx segments or by reading rx_size bytes, with CS held low throughout.
+  */
+typedef struct {
+    uint8_t cmd;
+    uint8_t addr;
+    bool qpi;                           /*!< All phases use four data lines */
+    const loader_spi_segment_t *tx;
+    uint32_t tx_count;
+    uint8_t *rx;                        /*!< Aligned to 32 bits */
+    uint32_t rx_size;
+} loader_spi_transaction_t;
+
+/**
+  * @brief Performs one transaction with the SPI slave of the target.
+  *
+  * @note  Can be defined by the port to send the whole transaction as a single DMA
+  *        transfer. A weak implementation built on loader_port_spi_set_cs(),
+  *        loader_port_write() and loader_port_read() is used otherwise, which does
+  *        not support QPI.
+  *
+  * @param transaction[in]  Transaction to perform.
+  * @param timeout[in]      Timeout in milliseconds.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Timeout elapsed
+  *     - ESP_LOADER_ERROR_UNSUPPORTED_FUNC QPI requested, but not supported
+  *     - ESP_LOADER_ERROR_FAIL Transfer failed
+  */
+esp_loader_error_t loader_port_spi_transaction(const loader_spi_transaction_t *transaction,
+        uint32_t timeout);
+
+/**
+  * @brief Tells whether the port has all four data lines connected to the target.
+  *
+  * @note  Weak function returning false is used, if not defined by the port.
+  */
+bool loader_port_spi_qpi_supported(void);
 #endif /* SERIAL_FLASHER_INTERFACE_SPI */
 
 #ifdef __cplusplus
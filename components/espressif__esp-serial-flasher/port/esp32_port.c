@@ -19,7 +19,10 @@
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "esp_idf_version.h"
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/param.h>
 
 #if SERIAL_FLASHER_DEBUG_TRACE
 static void transfer_debug_print(const uint8_t *data, uint16_t size, bool write)
@@ -37,12 +40,140 @@ static void transfer_debug_print(const uint8_t *data, uint16_t size, bool write)
 }
 #endif
 
+#define SLIP_DELIMITER 0xC0
+
+#define DEFAULT_RX_BUFFER_SIZE 400
+#define DEFAULT_QUEUE_SIZE 20
+#define PATTERN_QUEUE_SIZE 20
+
+/* Interrupt once the FIFO holds this many bytes, instead of after every few bytes */
+#define RX_FULL_THRESHOLD 96
+/* Interrupt after this many symbol times of silence on the line */
+#define RX_TIMEOUT_SYMBOLS 10
+
+/* An opening delimiter is held back while the rest of the frame keeps arriving, but never
+   longer than this after the line has gone quiet */
+#define FRAME_IDLE_MS 10
+
 static int64_t s_time_end;
 static int32_t s_uart_port;
 static int32_t s_reset_trigger_pin;
 static int32_t s_gpio0_trigger_pin;
 static bool s_peripheral_needs_deinit;
 
+/* Frame reception, used when the port owns the UART event queue */
+static QueueHandle_t s_uart_queue;
+static uint32_t s_rx_buffer_size;
+static uint8_t *s_rx_buffer;
+static size_t s_rx_head;
+static size_t s_rx_tail;
+static bool s_in_frame;         /* An odd number of delimiters has been handed out */
+static bool s_opening_pending;  /* A frame has started in the driver buffer */
+
+static void rx_reset(void)
+{
+    s_rx_head = 0;
+    s_rx_tail = 0;
+    s_in_frame = false;
+    s_opening_pending = false;
+
+    if (s_uart_queue != NULL) {
+        uart_flush_input(s_uart_port);
+        xQueueReset(s_uart_queue);
+        uart_pattern_queue_reset(s_uart_port, PATTERN_QUEUE_SIZE);
+    }
+}
+
+/* Moves up to size bytes from the driver buffer to the local one, which has to be empty */
+static esp_loader_error_t rx_fetch(size_t size)
+{
+    const int read = uart_read_bytes(s_uart_port, s_rx_buffer, MIN(size, s_rx_buffer_size), 0);
+    if (read < 0) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    for (int i = 0; i < read; i++) {
+        if (s_rx_buffer[i] == SLIP_DELIMITER) {
+            s_in_frame = !s_in_frame;
+        }
+    }
+
+    s_rx_head = 0;
+    s_rx_tail = read;
+    s_opening_pending = false;
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t rx_fetch_all(void)
+{
+    size_t buffered = 0;
+    uart_get_buffered_data_len(s_uart_port, &buffered);
+
+    return rx_fetch(buffered);
+}
+
+/* Waits until the driver buffer holds a complete frame, so the task reading from the target
+   wakes up once per frame. The UART detects the delimiters and reports their positions. */
+static esp_loader_error_t rx_wait_for_frame(uint32_t timeout)
+{
+    const int64_t time_end = esp_timer_get_time() + (int64_t)timeout * 1000;
+
+    while (true) {
+        const int64_t remaining_ms = MAX(time_end - esp_timer_get_time(), 0) / 1000;
+        TickType_t wait = pdMS_TO_TICKS(remaining_ms);
+        if (s_opening_pending) {
+            wait = MIN(wait, pdMS_TO_TICKS(FRAME_IDLE_MS));
+        }
+
+        uart_event_t event;
+        if (xQueueReceive(s_uart_queue, &event, wait) != pdTRUE) {
+            if (s_opening_pending) {
+                // The line went quiet in the middle of what seemed to be a frame
+                return rx_fetch_all();
+            }
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+
+        switch (event.type) {
+        case UART_PATTERN_DET: {
+            const int pos = uart_pattern_pop_pos(s_uart_port);
+            if (pos < 0) {
+                // The position queue overflowed, hand out everything received so far
+                return rx_fetch_all();
+            }
+
+            /* A delimiter at the start of the buffer opens the next frame, unless the body of
+               the current one has already been handed out */
+            if (pos == 0 && !s_in_frame && !s_opening_pending) {
+                s_opening_pending = true;
+                break;
+            }
+
+            return rx_fetch(pos + 1);
+        }
+
+        case UART_DATA: {
+            // Frames larger than half of the buffer are handed out in parts
+            size_t buffered = 0;
+            uart_get_buffered_data_len(s_uart_port, &buffered);
+            if (buffered >= s_rx_buffer_size / 2) {
+                return rx_fetch_all();
+            }
+            break;
+        }
+
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            rx_reset();
+            return ESP_LOADER_ERROR_FAIL;
+
+        default:
+            break;
+        }
+    }
+}
+
 esp_loader_error_t loader_port_esp32_init(const loader_esp32_config_t *config)
 {
     s_uart_port = config->uart_port;
@@ -62,10 +193,11 @@ esp_loader_error_t loader_port_esp32_init(const loader_esp32_config_t *config)
 #endif
         };
 
-        int rx_buffer_size = config->rx_buffer_size ? config->rx_buffer_size : 400;
+        int rx_buffer_size = config->rx_buffer_size ? config->rx_buffer_size : DEFAULT_RX_BUFFER_SIZE;
         int tx_buffer_size = config->tx_buffer_size ? config->tx_buffer_size : 400;
-        QueueHandle_t *uart_queue = config->uart_queue ? config->uart_queue : NULL;
-        int queue_size = config->queue_size ? config->queue_size : 0;
+        // Without an application supplied queue, the port uses the events itself
+        QueueHandle_t *uart_queue = config->uart_queue ? config->uart_queue : &s_uart_queue;
+        int queue_size = config->queue_size ? config->queue_size : DEFAULT_QUEUE_SIZE;
 
         if ( uart_param_config(s_uart_port, &uart_config) != ESP_OK ) {
             return ESP_LOADER_ERROR_FAIL;
@@ -78,6 +210,22 @@ esp_loader_error_t loader_port_esp32_init(const loader_esp32_config_t *config)
         }
 
         s_peripheral_needs_deinit = true;
+
+        if (config->uart_queue == NULL) {
+            s_rx_buffer_size = rx_buffer_size;
+            s_rx_buffer = malloc(s_rx_buffer_size);
+            if (s_rx_buffer == NULL ||
+                    uart_enable_pattern_det_baud_intr(s_uart_port, SLIP_DELIMITER, 1, 9, 0, 0) != ESP_OK ||
+                    uart_pattern_queue_reset(s_uart_port, PATTERN_QUEUE_SIZE) != ESP_OK ||
+                    uart_set_rx_full_threshold(s_uart_port, RX_FULL_THRESHOLD) != ESP_OK ||
+                    uart_set_rx_timeout(s_uart_port, RX_TIMEOUT_SYMBOLS) != ESP_OK) {
+                loader_port_esp32_deinit();
+                return ESP_LOADER_ERROR_FAIL;
+            }
+            rx_reset();
+        } else {
+            s_uart_queue = NULL;
+        }
     }
 
     // Initialize boot pin selection pins
@@ -96,7 +244,12 @@ void loader_port_esp32_deinit(void)
 {
     if (s_peripheral_needs_deinit) {
         uart_driver_delete(s_uart_port);
+        s_peripheral_needs_deinit = false;
     }
+
+    free(s_rx_buffer);
+    s_rx_buffer = NULL;
+    s_uart_queue = NULL;
 }
 
 
@@ -118,8 +271,36 @@ esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_
 }
 
 
+static esp_loader_error_t read_frames(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    size_t received = 0;
+
+    while (received < size) {
+        if (s_rx_head == s_rx_tail) {
+            RETURN_ON_ERROR( rx_wait_for_frame(timeout) );
+            continue;
+        }
+
+        const size_t to_copy = MIN(size - received, s_rx_tail - s_rx_head);
+        memcpy(&data[received], &s_rx_buffer[s_rx_head], to_copy);
+        s_rx_head += to_copy;
+        received += to_copy;
+    }
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    transfer_debug_print(data, size, false);
+#endif
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
 esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout)
 {
+    if (s_uart_queue != NULL) {
+        return read_frames(data, size, timeout);
+    }
+
     int read = uart_read_bytes(s_uart_port, data, size, pdMS_TO_TICKS(timeout));
 
     if (read < 0) {
@@ -144,6 +325,7 @@ void loader_port_enter_bootloader(void)
     loader_port_reset_target();
     loader_port_delay_ms(SERIAL_FLASHER_BOOT_HOLD_TIME_MS);
     gpio_set_level(s_gpio0_trigger_pin, SERIAL_FLASHER_BOOT_INVERT ? 0 : 1);
+    rx_reset();
 }
 
 
@@ -34,7 +34,8 @@ typedef struct {
     uint32_t tx_buffer_size;    /*!< Set to zero for default TX buffer size */
     uint32_t queue_size;        /*!< Set to zero for default UART queue size */
     QueueHandle_t *uart_queue;  /*!< Set to NULL, if UART queue handle is not
-                                   necessary. Otherwise, it will be assigned here */
+                                   necessary. Otherwise, it will be assigned here
+                                   and data is read without frame detection */
     bool dont_initialize_peripheral; /* Use if the peripheral has already been initialized,
                                         useful when using the peripheral for multiple
                                         purposes (e.g. monitoring) */
@@ -43,6 +44,10 @@ typedef struct {
 /**
   * @brief Initializes serial interface.
   *
+  * Unless the application takes the UART event queue or initializes the peripheral itself,
+  * the UART detects the SLIP delimiters and the reading task is woken up once per received
+  * frame, instead of for every few bytes.
+  *
   * @param baud_rate[in]       Communication speed.
   *
   * @return
@@ -19,7 +19,15 @@
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "esp_idf_version.h"
+#include "esp_heap_caps.h"
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include "esp_memory_utils.h"
+#else
+#include "soc/soc_memory_layout.h"
+#endif
+#include <string.h>
 #include <unistd.h>
+#include <sys/param.h>
 
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
 #define DMA_CHAN SPI_DMA_CH_AUTO
@@ -29,6 +37,12 @@
 
 #define WORD_ALIGNED(ptr) ((size_t)ptr % sizeof(size_t) == 0)
 
+#define MAX_TRANSFER_SIZE (4096 * 4)
+
+/* Dummy phase length of the slave protocol in SPI clocks, it is shorter on multiple lines */
+#define DUMMY_CYCLES_SINGLE 8
+#define DUMMY_CYCLES_QPI 4
+
 #if SERIAL_FLASHER_DEBUG_TRACE
 static void dec_to_hex_str(const uint8_t dec, uint8_t hex_str[3])
 {
@@ -71,6 +85,9 @@ static uint32_t s_strap_bit2_pin;
 static uint32_t s_strap_bit3_pin;
 static uint32_t s_spi_cs_pin;
 static bool s_bus_needs_deinit;
+static bool s_qpi_pins_connected;
+/* Segments of a transaction are gathered here, so it goes out as one DMA transfer */
+static uint8_t *s_dma_buffer;
 
 esp_loader_error_t loader_port_esp32_spi_init(const loader_esp32_spi_config_t *config)
 {
@@ -90,7 +107,7 @@ esp_loader_error_t loader_port_esp32_spi_init(const loader_esp32_spi_config_t *c
         s_spi_config.sclk_io_num = config->spi_clk_pin;
         s_spi_config.quadwp_io_num = config->spi_quadwp_pin;
         s_spi_config.quadhd_io_num = config->spi_quadhd_pin;
-        s_spi_config.max_transfer_sz = 4096 * 4;
+        s_spi_config.max_transfer_sz = MAX_TRANSFER_SIZE;
 
         if (spi_bus_initialize(s_spi_bus, &s_spi_config, DMA_CHAN) != ESP_OK) {
             return ESP_LOADER_ERROR_FAIL;
@@ -110,6 +127,15 @@ esp_loader_error_t loader_port_esp32_spi_init(const loader_esp32_spi_config_t *c
         return ESP_LOADER_ERROR_FAIL;
     }
 
+    s_dma_buffer = heap_caps_malloc(MAX_TRANSFER_SIZE, MALLOC_CAP_DMA);
+    if (s_dma_buffer == NULL) {
+        loader_port_esp32_spi_deinit();
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    s_qpi_pins_connected = (int32_t)config->spi_quadwp_pin >= 0 &&
+                           (int32_t)config->spi_quadhd_pin >= 0;
+
     /* Initialize the pins except for the strapping ones */
     gpio_reset_pin(s_reset_trigger_pin);
     gpio_set_pull_mode(s_reset_trigger_pin, GPIO_PULLUP_ONLY);
@@ -133,6 +159,8 @@ void loader_port_esp32_spi_deinit(void)
     if (s_bus_needs_deinit) {
         spi_bus_free(s_spi_bus);
     }
+    heap_caps_free(s_dma_buffer);
+    s_dma_buffer = NULL;
 }
 
 
@@ -202,6 +230,126 @@ esp_loader_error_t loader_port_read(uint8_t *data, const uint16_t size, const ui
 }
 
 
+static esp_loader_error_t convert_error(const esp_err_t err)
+{
+    if (err == ESP_OK) {
+        return ESP_LOADER_SUCCESS;
+    } else if (err == ESP_ERR_TIMEOUT) {
+        return ESP_LOADER_ERROR_TIMEOUT;
+    } else {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+}
+
+
+/* Returns the next part of the written data, gathering the segments into the DMA buffer
+   unless a single segment can be used by the DMA as is */
+static const uint8_t *next_tx_chunk(const loader_spi_transaction_t *transaction,
+                                    uint32_t *segment, uint32_t *offset, size_t *length)
+{
+    const loader_spi_segment_t *tx = transaction->tx;
+
+    if (transaction->tx_count == 1 && esp_ptr_dma_capable(tx[0].data) &&
+            WORD_ALIGNED(tx[0].data) && tx[0].size <= MAX_TRANSFER_SIZE) {
+        *segment = 1;
+        *length = tx[0].size;
+        return tx[0].data;
+    }
+
+    *length = 0;
+    while (*segment < transaction->tx_count && *length < MAX_TRANSFER_SIZE) {
+        const size_t to_copy = MIN(tx[*segment].size - *offset, MAX_TRANSFER_SIZE - *length);
+        memcpy(&s_dma_buffer[*length], &tx[*segment].data[*offset], to_copy);
+        *length += to_copy;
+        *offset += to_copy;
+
+        if (*offset == tx[*segment].size) {
+            (*segment)++;
+            *offset = 0;
+        }
+    }
+
+    return s_dma_buffer;
+}
+
+
+esp_loader_error_t loader_port_spi_transaction(const loader_spi_transaction_t *transaction,
+        const uint32_t timeout)
+{
+    (void) timeout;
+
+    /* The rx data buffer must be aligned to 32 bits due to DMA requirements */
+    if (transaction->rx_size != 0 && !WORD_ALIGNED(transaction->rx)) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
+    }
+
+    const uint32_t line_flags = transaction->qpi ?
+                                SPI_TRANS_MODE_QIO | SPI_TRANS_MULTILINE_CMD | SPI_TRANS_MULTILINE_ADDR : 0;
+
+    /* The preamble is sent in the command, address and dummy phases of the first transfer */
+    spi_transaction_ext_t ext = {
+        .base = {
+            .flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY |
+            line_flags,
+            .cmd = transaction->cmd,
+            .addr = transaction->addr,
+        },
+        .command_bits = 8,
+        .address_bits = 8,
+        .dummy_bits = transaction->qpi ? DUMMY_CYCLES_QPI : DUMMY_CYCLES_SINGLE,
+    };
+
+    uint32_t segment = 0;
+    uint32_t offset = 0;
+    esp_err_t err;
+
+    loader_port_spi_set_cs(0);
+
+    /* Writes larger than the DMA buffer continue in further transfers while CS stays low */
+    do {
+        size_t length = 0;
+        const uint8_t *tx_buffer = next_tx_chunk(transaction, &segment, &offset, &length);
+
+        ext.base.tx_buffer = length != 0 ? tx_buffer : NULL;
+        ext.base.length = length * 8;
+        if (transaction->rx_size != 0) {
+            ext.base.rx_buffer = transaction->rx;
+            ext.base.rxlength = transaction->rx_size * 8;
+        }
+
+        /* Polling avoids the interrupt latency, most transactions are only a few bytes long */
+        err = spi_device_polling_transmit(s_device_h, &ext.base);
+
+        ext.command_bits = 0;
+        ext.address_bits = 0;
+        ext.dummy_bits = 0;
+    } while (err == ESP_OK && segment < transaction->tx_count);
+
+    loader_port_spi_set_cs(1);
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    if (err == ESP_OK) {
+        const uint8_t preamble[] = { transaction->cmd, transaction->addr, 0 };
+        serial_debug_print(preamble, sizeof(preamble), true);
+        for (uint32_t i = 0; i < transaction->tx_count; i++) {
+            serial_debug_print(transaction->tx[i].data, transaction->tx[i].size, true);
+        }
+        if (transaction->rx_size != 0) {
+            serial_debug_print(transaction->rx, transaction->rx_size, false);
+        }
+    }
+#endif
+
+    return convert_error(err);
+}
+
+
+bool loader_port_spi_qpi_supported(void)
+{
+    return s_qpi_pins_connected;
+}
+
+
 void loader_port_enter_bootloader(void)
 {
     /*
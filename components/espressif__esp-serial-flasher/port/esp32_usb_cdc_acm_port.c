@@ -15,16 +15,73 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/param.h>
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "usb/usb_helpers.h"
 #include "esp32_usb_cdc_acm_port.h"
 
 #define ESP_SERIAL_JTAG_PID 0x1001
 
+#define RX_TRANSFER_SIZE 512
+#define RX_DEFAULT_TRANSFER_COUNT 8
+#define TX_TRANSFER_COUNT 4
+#define TX_FLUSH_TIMEOUT_MS 3000
+#define CLIENT_TASK_STACK_SIZE 3072
+#define CLIENT_TASK_PRIORITY 6
+#define CLIENT_MAX_EVENTS 5
+#define CLOSE_TIMEOUT_MS 1000
+
 static const char *TAG = "usb_cdc_acm_port";
 
 static cdc_acm_dev_hdl_t s_acm_device;
-static StreamBufferHandle_t s_rx_stream_buffer;
+
+/* The CDC-ACM driver claims the interfaces, sends the control requests and reports events. The
+ * bulk endpoints are driven by the port through a USB host client and device handle of its
+ * own. The completion callbacks of its transfers run in the client task and never block. */
+static usb_host_client_handle_t s_client;
+static TaskHandle_t s_client_task;
+static SemaphoreHandle_t s_client_task_done;
+static volatile bool s_client_stop;
+static usb_device_handle_t s_device;
+static uint8_t s_ep_in;
+static uint8_t s_ep_out;
+
+/* Set once the device is gone or being closed, port calls fail straight away from then on.
+ * Closing waits for the calls still in progress to return before anything is freed. */
+static atomic_bool s_closed;
+static atomic_uint s_port_calls;
+
+/* Received data lands in IN transfers allocated by the USB host library. Completed transfers
+ * are passed through the filled queue to the reader, which reads the data in place and only
+ * resubmits a transfer once all of it is consumed. When every transfer waits to be read, none
+ * is in flight and the device holds further data back instead of it being dropped. Transfers
+ * failing or cancelled wait in the idle queue until the next flush. */
+static usb_transfer_t **s_rx_transfers;
+static uint32_t s_rx_transfer_count;
+static QueueHandle_t s_rx_filled_queue;
+static QueueHandle_t s_rx_idle_queue;
+static usb_transfer_t *s_rx_transfer;   // Transfer being consumed by the reader
+static size_t s_rx_offset;              // Read position within s_rx_transfer
+static bool s_rx_viewing;               // Data of s_rx_transfer handed out by loader_port_peek()
+static atomic_uint s_rx_in_flight;
+static atomic_uint s_rx_pending_bytes;
+static volatile esp_loader_error_t s_rx_error;
+static loader_esp32_usb_cdc_acm_rx_stats_t s_rx_stats;
+
+/* Written data is collected into one of several OUT transfers, allocated by the USB host
+ * library in DMA capable memory. Full transfers, and the partially filled one once the
+ * response is awaited, are submitted right away, so several are in flight while the caller
+ * goes on encoding the next chunk. Completed transfers return to the free queue. */
+static usb_transfer_t *s_tx_transfers[TX_TRANSFER_COUNT];
+static QueueHandle_t s_tx_free_queue;
+static usb_transfer_t *s_tx_transfer;   // Transfer being filled by the caller
+static volatile esp_loader_error_t s_tx_error;
 static bool s_is_usb_serial_jtag;
 static loader_port_esp32_usb_cdc_acm_callback_t s_acm_host_error_callback;
 static loader_port_esp32_usb_cdc_acm_callback_t s_device_disconnected_callback;
@@ -46,9 +103,466 @@ static void transfer_debug_print(const uint8_t *data, const uint16_t size, const
 }
 #endif
 
-static bool handle_usb_data(const uint8_t *data, size_t data_len, void *arg)
+static void rx_submit(usb_transfer_t *transfer)
+{
+    transfer->num_bytes = RX_TRANSFER_SIZE;
+    atomic_fetch_add(&s_rx_in_flight, 1);
+    if (atomic_load(&s_closed) || usb_host_transfer_submit(transfer) != ESP_OK) {
+        atomic_fetch_sub(&s_rx_in_flight, 1);
+        xQueueSend(s_rx_idle_queue, &transfer, 0);
+    }
+}
+
+static void rx_done(usb_transfer_t *transfer)
+{
+    const unsigned in_flight = atomic_fetch_sub(&s_rx_in_flight, 1) - 1;
+
+    if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+        if (transfer->status != USB_TRANSFER_STATUS_CANCELED &&
+                transfer->status != USB_TRANSFER_STATUS_NO_DEVICE) {
+            s_rx_error = ESP_LOADER_ERROR_FAIL;
+        }
+        xQueueSend(s_rx_idle_queue, &transfer, 0);
+        return;
+    }
+
+    if (transfer->actual_num_bytes == 0) {
+        rx_submit(transfer);
+        return;
+    }
+
+    // The queues hold every transfer, so this never waits
+    const unsigned pending = atomic_fetch_add(&s_rx_pending_bytes, transfer->actual_num_bytes) +
+                             transfer->actual_num_bytes;
+    xQueueSend(s_rx_filled_queue, &transfer, 0);
+
+    const uint32_t filled = uxQueueMessagesWaiting(s_rx_filled_queue);
+    s_rx_stats.slots_high_water = MAX(s_rx_stats.slots_high_water, filled);
+    s_rx_stats.bytes_high_water = MAX(s_rx_stats.bytes_high_water, pending);
+    if (in_flight == 0) {
+        s_rx_stats.backpressure_events++;
+    }
+}
+
+static esp_loader_error_t rx_take_error(void)
+{
+    const esp_loader_error_t err = s_rx_error;
+    s_rx_error = ESP_LOADER_SUCCESS;
+    return err;
+}
+
+static void rx_transfer_release(void)
+{
+    atomic_fetch_sub(&s_rx_pending_bytes, s_rx_transfer->actual_num_bytes - s_rx_offset);
+    rx_submit(s_rx_transfer);
+    s_rx_transfer = NULL;
+    s_rx_offset = 0;
+}
+
+// Gives access to the received data without copying it
+static esp_loader_error_t rx_peek(const uint8_t **data, size_t *size, uint32_t timeout)
+{
+    if (s_rx_transfer == NULL) {
+        RETURN_ON_ERROR(rx_take_error());
+
+        if (xQueueReceive(s_rx_filled_queue, &s_rx_transfer, pdMS_TO_TICKS(timeout)) != pdTRUE) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+        if (s_rx_transfer == NULL) {
+            // Closed, leave the marker for the next reader
+            xQueueSend(s_rx_filled_queue, &s_rx_transfer, 0);
+            return ESP_LOADER_ERROR_FAIL;
+        }
+        s_rx_offset = 0;
+    }
+
+    *data = &s_rx_transfer->data_buffer[s_rx_offset];
+    *size = s_rx_transfer->actual_num_bytes - s_rx_offset;
+    return ESP_LOADER_SUCCESS;
+}
+
+static void rx_consume(size_t size)
+{
+    s_rx_offset += size;
+    atomic_fetch_sub(&s_rx_pending_bytes, size);
+
+    if (s_rx_offset == s_rx_transfer->actual_num_bytes) {
+        rx_transfer_release();
+    }
+}
+
+// Drops the received data and resubmits the transfers which failed
+static void rx_flush(void)
+{
+    if (s_rx_transfer != NULL) {
+        rx_transfer_release();
+    }
+
+    usb_transfer_t *transfer;
+    const UBaseType_t filled = uxQueueMessagesWaiting(s_rx_filled_queue);
+    for (UBaseType_t i = 0; i < filled && xQueueReceive(s_rx_filled_queue, &transfer, 0) == pdTRUE; i++) {
+        if (transfer == NULL) {
+            xQueueSend(s_rx_filled_queue, &transfer, 0);
+            continue;
+        }
+        atomic_fetch_sub(&s_rx_pending_bytes, transfer->actual_num_bytes);
+        rx_submit(transfer);
+    }
+
+    const UBaseType_t idle = uxQueueMessagesWaiting(s_rx_idle_queue);
+    for (UBaseType_t i = 0; i < idle && xQueueReceive(s_rx_idle_queue, &transfer, 0) == pdTRUE; i++) {
+        rx_submit(transfer);
+    }
+
+    rx_take_error();
+}
+
+/* Cancels the transfers in flight, they come back through rx_done() */
+static bool rx_cancel(void)
+{
+    if (s_device == NULL || s_rx_transfers == NULL) {
+        return true;
+    }
+
+    usb_host_endpoint_halt(s_device, s_ep_in);
+    usb_host_endpoint_flush(s_device, s_ep_in);
+
+    const int64_t end = esp_timer_get_time() + CLOSE_TIMEOUT_MS * 1000;
+    while (atomic_load(&s_rx_in_flight) > 0 && esp_timer_get_time() < end) {
+        vTaskDelay(1);
+    }
+
+    usb_host_endpoint_clear(s_device, s_ep_in);
+    return atomic_load(&s_rx_in_flight) == 0;
+}
+
+static void rx_delete(void)
+{
+    if (s_rx_filled_queue != NULL) {
+        vQueueDelete(s_rx_filled_queue);
+        s_rx_filled_queue = NULL;
+    }
+    if (s_rx_idle_queue != NULL) {
+        vQueueDelete(s_rx_idle_queue);
+        s_rx_idle_queue = NULL;
+    }
+    if (s_rx_transfers != NULL) {
+        for (uint32_t i = 0; i < s_rx_transfer_count; i++) {
+            if (s_rx_transfers[i] != NULL) {
+                usb_host_transfer_free(s_rx_transfers[i]);
+            }
+        }
+        free(s_rx_transfers);
+        s_rx_transfers = NULL;
+    }
+    s_rx_transfer_count = 0;
+    s_rx_transfer = NULL;
+    s_rx_offset = 0;
+    s_rx_viewing = false;
+    s_rx_error = ESP_LOADER_SUCCESS;
+    atomic_store(&s_rx_pending_bytes, 0);
+}
+
+static esp_loader_error_t rx_create(uint32_t transfer_count)
+{
+    s_rx_transfers = calloc(transfer_count, sizeof(usb_transfer_t *));
+    // One more entry, for the marker that wakes the reader once the port is closed
+    s_rx_filled_queue = xQueueCreate(transfer_count + 1, sizeof(usb_transfer_t *));
+    s_rx_idle_queue = xQueueCreate(transfer_count, sizeof(usb_transfer_t *));
+
+    if (s_rx_transfers == NULL || s_rx_filled_queue == NULL || s_rx_idle_queue == NULL) {
+        rx_delete();
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    s_rx_transfer_count = transfer_count;
+    for (uint32_t i = 0; i < transfer_count; i++) {
+        if (usb_host_transfer_alloc(RX_TRANSFER_SIZE, 0, &s_rx_transfers[i]) != ESP_OK) {
+            s_rx_transfers[i] = NULL;
+            rx_delete();
+            return ESP_LOADER_ERROR_FAIL;
+        }
+        s_rx_transfers[i]->device_handle = s_device;
+        s_rx_transfers[i]->bEndpointAddress = s_ep_in;
+        s_rx_transfers[i]->callback = rx_done;
+    }
+
+    for (uint32_t i = 0; i < transfer_count; i++) {
+        rx_submit(s_rx_transfers[i]);
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static void tx_done(usb_transfer_t *transfer)
+{
+    if (transfer->status != USB_TRANSFER_STATUS_COMPLETED && s_tx_error == ESP_LOADER_SUCCESS) {
+        s_tx_error = transfer->status == USB_TRANSFER_STATUS_TIMED_OUT ?
+                     ESP_LOADER_ERROR_TIMEOUT : ESP_LOADER_ERROR_FAIL;
+    }
+
+    // The queue holds every transfer, so this never waits
+    transfer->num_bytes = 0;
+    xQueueSend(s_tx_free_queue, &transfer, 0);
+}
+
+static esp_loader_error_t tx_take_error(void)
+{
+    const esp_loader_error_t err = s_tx_error;
+    s_tx_error = ESP_LOADER_SUCCESS;
+    return err;
+}
+
+/* Submits the partially filled transfer without waiting */
+static void tx_submit(void)
+{
+    if (s_tx_transfer == NULL || s_tx_transfer->num_bytes == 0) {
+        return;
+    }
+
+    usb_transfer_t *transfer = s_tx_transfer;
+    s_tx_transfer = NULL;
+    if (atomic_load(&s_closed) || usb_host_transfer_submit(transfer) != ESP_OK) {
+        if (s_tx_error == ESP_LOADER_SUCCESS) {
+            s_tx_error = ESP_LOADER_ERROR_FAIL;
+        }
+        transfer->num_bytes = 0;
+        xQueueSend(s_tx_free_queue, &transfer, 0);
+    }
+}
+
+/* Waits until every transfer not held by the caller is back in the free queue */
+static bool tx_wait_idle(uint32_t timeout_ms)
+{
+    usb_transfer_t *transfers[TX_TRANSFER_COUNT];
+    uint32_t taken = 0;
+    const uint32_t expected = s_tx_transfer != NULL ? TX_TRANSFER_COUNT - 1 : TX_TRANSFER_COUNT;
+    while (taken < expected &&
+            xQueueReceive(s_tx_free_queue, &transfers[taken], pdMS_TO_TICKS(timeout_ms)) == pdTRUE) {
+        taken++;
+    }
+    for (uint32_t i = 0; i < taken; i++) {
+        xQueueSend(s_tx_free_queue, &transfers[i], 0);
+    }
+
+    return taken == expected;
+}
+
+/* Waits until all written data has left the host */
+static esp_loader_error_t tx_flush(void)
+{
+    tx_submit();
+
+    if (!tx_wait_idle(TX_FLUSH_TIMEOUT_MS)) {
+        return ESP_LOADER_ERROR_TIMEOUT;
+    }
+
+    return tx_take_error();
+}
+
+/* Cancels the transfers in flight, they come back through tx_done() */
+static bool tx_cancel(void)
+{
+    if (s_device == NULL || s_tx_free_queue == NULL) {
+        return true;
+    }
+
+    usb_host_endpoint_halt(s_device, s_ep_out);
+    usb_host_endpoint_flush(s_device, s_ep_out);
+    const bool idle = tx_wait_idle(CLOSE_TIMEOUT_MS);
+    usb_host_endpoint_clear(s_device, s_ep_out);
+    return idle;
+}
+
+static void tx_delete(void)
+{
+    if (s_tx_free_queue != NULL) {
+        vQueueDelete(s_tx_free_queue);
+        s_tx_free_queue = NULL;
+    }
+    for (uint32_t i = 0; i < TX_TRANSFER_COUNT; i++) {
+        if (s_tx_transfers[i] != NULL) {
+            usb_host_transfer_free(s_tx_transfers[i]);
+            s_tx_transfers[i] = NULL;
+        }
+    }
+    s_tx_transfer = NULL;
+    s_tx_error = ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t tx_create(size_t buffer_size)
+{
+    s_tx_free_queue = xQueueCreate(TX_TRANSFER_COUNT, sizeof(usb_transfer_t *));
+    if (s_tx_free_queue == NULL) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    for (uint32_t i = 0; i < TX_TRANSFER_COUNT; i++) {
+        if (usb_host_transfer_alloc(buffer_size, 0, &s_tx_transfers[i]) != ESP_OK) {
+            s_tx_transfers[i] = NULL;
+            tx_delete();
+            return ESP_LOADER_ERROR_FAIL;
+        }
+        usb_transfer_t *transfer = s_tx_transfers[i];
+        transfer->device_handle = s_device;
+        transfer->bEndpointAddress = s_ep_out;
+        transfer->callback = tx_done;
+        transfer->num_bytes = 0;
+        xQueueSend(s_tx_free_queue, &transfer, 0);
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static void client_event(const usb_host_client_event_msg_t *event, void *arg)
+{
+    // Removal is reported by the CDC-ACM driver, the handle is closed by the port owner
+}
+
+static void client_task(void *arg)
+{
+    while (!s_client_stop) {
+        usb_host_client_handle_events(s_client, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(s_client_task_done);
+    vTaskDelete(NULL);
+}
+
+// Finds the bulk endpoints of the CDC data interface
+static bool bulk_endpoints_find(usb_device_handle_t device)
+{
+    const usb_config_desc_t *config;
+    if (usb_host_get_active_config_descriptor(device, &config) != ESP_OK) {
+        return false;
+    }
+
+    for (uint8_t number = 0; number < config->bNumInterfaces; number++) {
+        int offset = 0;
+        const usb_intf_desc_t *intf = usb_parse_interface_descriptor(config, number, 0, &offset);
+        if (intf == NULL || intf->bInterfaceClass != USB_CLASS_CDC_DATA) {
+            continue;
+        }
+
+        s_ep_in = 0;
+        s_ep_out = 0;
+        for (int i = 0; i < intf->bNumEndpoints; i++) {
+            int ep_offset = offset;
+            const usb_ep_desc_t *ep = usb_parse_endpoint_descriptor_by_index(intf, i, config->wTotalLength,
+                                      &ep_offset);
+            if (ep == NULL || USB_EP_DESC_GET_XFERTYPE(ep) != USB_TRANSFER_TYPE_BULK) {
+                continue;
+            }
+            if (USB_EP_DESC_GET_EP_DIR(ep)) {
+                s_ep_in = ep->bEndpointAddress;
+            } else {
+                s_ep_out = ep->bEndpointAddress;
+            }
+        }
+        if (s_ep_in != 0 && s_ep_out != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Opens the device already opened by the CDC-ACM driver once more, for the bulk transfers
+static esp_loader_error_t device_open(uint16_t vid, uint16_t pid)
 {
-    return xStreamBufferSend(s_rx_stream_buffer, data, data_len, 0) == data_len;
+    const usb_host_client_config_t client_config = {
+        .is_synchronous = false,
+        .max_num_event_msg = CLIENT_MAX_EVENTS,
+        .async = {
+            .client_event_callback = client_event,
+            .callback_arg = NULL,
+        },
+    };
+    if (usb_host_client_register(&client_config, &s_client) != ESP_OK) {
+        s_client = NULL;
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    s_client_stop = false;
+    s_client_task_done = xSemaphoreCreateBinary();
+    if (s_client_task_done == NULL ||
+            xTaskCreate(client_task, "usb_cdc_port", CLIENT_TASK_STACK_SIZE, NULL, CLIENT_TASK_PRIORITY,
+                        &s_client_task) != pdPASS) {
+        s_client_task = NULL;
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    uint8_t addresses[8];
+    int count = 0;
+    if (usb_host_device_addr_list_fill(sizeof(addresses), addresses, &count) != ESP_OK) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        usb_device_handle_t device;
+        if (usb_host_device_open(s_client, addresses[i], &device) != ESP_OK) {
+            continue;
+        }
+
+        const usb_device_desc_t *desc;
+        if (usb_host_get_device_descriptor(device, &desc) == ESP_OK &&
+                desc->idVendor == vid && desc->idProduct == pid && bulk_endpoints_find(device)) {
+            s_device = device;
+            return ESP_LOADER_SUCCESS;
+        }
+        usb_host_device_close(s_client, device);
+    }
+
+    return ESP_LOADER_ERROR_FAIL;
+}
+
+static void device_close(void)
+{
+    if (s_device != NULL) {
+        usb_host_device_close(s_client, s_device);
+        s_device = NULL;
+    }
+    if (s_client_task != NULL) {
+        s_client_stop = true;
+        usb_host_client_unblock(s_client);
+        xSemaphoreTake(s_client_task_done, portMAX_DELAY);
+        s_client_task = NULL;
+    }
+    if (s_client_task_done != NULL) {
+        vSemaphoreDelete(s_client_task_done);
+        s_client_task_done = NULL;
+    }
+    if (s_client != NULL) {
+        usb_host_client_deregister(s_client);
+        s_client = NULL;
+    }
+}
+
+static bool port_enter(void)
+{
+    atomic_fetch_add(&s_port_calls, 1);
+    if (atomic_load(&s_closed)) {
+        atomic_fetch_sub(&s_port_calls, 1);
+        return false;
+    }
+    return true;
+}
+
+static void port_exit(void)
+{
+    atomic_fetch_sub(&s_port_calls, 1);
+}
+
+/* Makes the port calls fail and wakes the ones waiting for data, never blocks, so that it can
+ * be called from the event callback of the driver */
+static void port_close(void)
+{
+    atomic_store(&s_closed, true);
+
+    usb_transfer_t *wake = NULL;
+    if (s_rx_filled_queue != NULL) {
+        xQueueSend(s_rx_filled_queue, &wake, 0);
+    }
 }
 
 static void handle_usb_event(const cdc_acm_host_dev_event_data_t *event, void *user_ctx)
@@ -62,12 +576,12 @@ static void handle_usb_event(const cdc_acm_host_dev_event_data_t *event, void *u
         break;
 
     case CDC_ACM_HOST_DEVICE_DISCONNECTED:
+        // Only signalled here, the port is closed by its owner, see the header
         ESP_LOGI(TAG, "Device disconnected");
+        port_close();
         if (s_device_disconnected_callback != NULL) {
             s_device_disconnected_callback();
         }
-        esp_loader_error_t deinit_status = loader_port_esp32_usb_cdc_acm_deinit();
-        assert(deinit_status == ESP_LOADER_SUCCESS);
         break;
 
     case CDC_ACM_HOST_SERIAL_STATE:
@@ -85,7 +599,7 @@ static void handle_usb_event(const cdc_acm_host_dev_event_data_t *event, void *u
 
 static void usb_serial_jtag_reset_target(void)
 {
-    xStreamBufferReset(s_rx_stream_buffer);
+    rx_flush();
     cdc_acm_host_set_control_line_state(s_acm_device, false, false);
     loader_port_delay_ms(100);
     cdc_acm_host_set_control_line_state(s_acm_device, false, true);
@@ -95,7 +609,7 @@ static void usb_serial_jtag_reset_target(void)
 
 static void usb_serial_jtag_enter_booloader(void)
 {
-    xStreamBufferReset(s_rx_stream_buffer);
+    rx_flush();
     cdc_acm_host_set_control_line_state(s_acm_device, false, false);
     loader_port_delay_ms(100);
     cdc_acm_host_set_control_line_state(s_acm_device, true, false); // Set boot pin
@@ -114,7 +628,7 @@ static void usb_serial_jtag_enter_booloader(void)
 
 static void usb_serial_converter_reset_target(void)
 {
-    xStreamBufferReset(s_rx_stream_buffer);
+    rx_flush();
     cdc_acm_host_set_control_line_state(s_acm_device, true, true);
     loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
     cdc_acm_host_set_control_line_state(s_acm_device, true, false);
@@ -132,45 +646,130 @@ static void usb_serial_converter_enter_bootloader(void)
 
 static uint32_t s_time_end;
 
+static esp_loader_error_t port_write(const uint8_t *data, const uint16_t size, const uint32_t timeout)
+{
+    RETURN_ON_ERROR(tx_take_error());
+
+    size_t written = 0;
+    while (written < size) {
+        if (s_tx_transfer == NULL &&
+                xQueueReceive(s_tx_free_queue, &s_tx_transfer, pdMS_TO_TICKS(timeout)) != pdTRUE) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+
+        usb_transfer_t *transfer = s_tx_transfer;
+        const size_t to_copy = MIN(size - written, transfer->data_buffer_size - transfer->num_bytes);
+        memcpy(&transfer->data_buffer[transfer->num_bytes], &data[written], to_copy);
+        transfer->num_bytes += to_copy;
+        written += to_copy;
+
+        if (transfer->num_bytes == transfer->data_buffer_size) {
+            tx_submit();
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t port_read(uint8_t *data, const uint16_t size, const uint32_t timeout)
+{
+    // The response can only come once the whole command is out
+    tx_submit();
+    RETURN_ON_ERROR(tx_take_error());
+
+    const TickType_t start = xTaskGetTickCount();
+    const TickType_t timeout_ticks = pdMS_TO_TICKS(timeout);
+    size_t received = 0;
+
+    while (received < size) {
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        const TickType_t wait = elapsed < timeout_ticks ? timeout_ticks - elapsed : 0;
+        const uint8_t *view;
+        size_t available;
+        RETURN_ON_ERROR(rx_peek(&view, &available, pdTICKS_TO_MS(wait)));
+
+        const size_t to_copy = MIN(size - received, available);
+        memcpy(&data[received], view, to_copy);
+        received += to_copy;
+        rx_consume(to_copy);
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
 esp_loader_error_t loader_port_write(const uint8_t *data, const uint16_t size,
                                      const uint32_t timeout)
 {
     assert(data != NULL);
-    assert(s_acm_device != NULL && s_rx_stream_buffer != NULL);
 
-    esp_err_t err = cdc_acm_host_data_tx_blocking(s_acm_device,
-                    (uint8_t *)data,
-                    size,
-                    timeout);
+    if (!port_enter()) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+    const esp_loader_error_t err = port_write(data, size, timeout);
+    port_exit();
 
-    if (err == ESP_OK) {
 #if SERIAL_FLASHER_DEBUG_TRACE
-        transfer_debug_print(data, size, true);
+    transfer_debug_print(data, size, true);
 #endif
-        return ESP_LOADER_SUCCESS;
-    } else if (err == ESP_ERR_TIMEOUT) {
-        return ESP_LOADER_ERROR_TIMEOUT;
-    } else {
-        return ESP_LOADER_ERROR_FAIL;
-    }
+    return err;
 }
 
 
 esp_loader_error_t loader_port_read(uint8_t *data, const uint16_t size, const uint32_t timeout)
 {
     assert(data != NULL);
-    assert(s_acm_device != NULL && s_rx_stream_buffer != NULL);
 
-    size_t received = xStreamBufferReceive(s_rx_stream_buffer, data, size, pdMS_TO_TICKS(timeout));
+    if (!port_enter()) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+    const esp_loader_error_t err = port_read(data, size, timeout);
+    port_exit();
 
-    if (received == size) {
 #if SERIAL_FLASHER_DEBUG_TRACE
+    if (err == ESP_LOADER_SUCCESS) {
         transfer_debug_print(data, size, false);
+    }
 #endif
-        return ESP_LOADER_SUCCESS;
-    } else {
-        return ESP_LOADER_ERROR_TIMEOUT;
+    return err;
+}
+
+
+/* The port stays entered while the view is handed out, so that closing waits for it */
+esp_loader_error_t loader_port_peek(const uint8_t **data, size_t *size, const uint32_t timeout)
+{
+    if (!port_enter()) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    // The response can only come once the whole command is out
+    tx_submit();
+    esp_loader_error_t err = tx_take_error();
+    if (err == ESP_LOADER_SUCCESS) {
+        err = rx_peek(data, size, timeout);
+    }
+
+    if (err != ESP_LOADER_SUCCESS) {
+        port_exit();
+        return err;
     }
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    transfer_debug_print(*data, *size, false);
+#endif
+    s_rx_viewing = true;
+    return ESP_LOADER_SUCCESS;
+}
+
+
+void loader_port_consume(const size_t size)
+{
+    if (!s_rx_viewing) {
+        return;
+    }
+
+    s_rx_viewing = false;
+    rx_consume(size);
+    port_exit();
 }
 
 
@@ -179,25 +778,20 @@ esp_loader_error_t loader_port_esp32_usb_cdc_acm_init(const loader_esp32_usb_cdc
     s_acm_host_error_callback = config->acm_host_error_callback;
     s_device_disconnected_callback = config->device_disconnected_callback;
     s_acm_host_serial_state_callback = config->acm_host_serial_state_callback;
+    atomic_store(&s_closed, false);
 
     /* Different reset and enter bootloader sequences are needed depending on whether the target
      * device is connected via internal USB Serial/JTAG or an USB to serial converter which
      * connects to target UART and BOOT/RST pins. See pages 1207 and 1208 of the ESP32-S3 TRM */
     s_is_usb_serial_jtag = config->device_pid == ESP_SERIAL_JTAG_PID;
 
-    s_rx_stream_buffer = xStreamBufferCreate(1024, 1);
-
-    if (s_rx_stream_buffer == NULL) {
-        ESP_LOGE(TAG, "Could not create the stream buffer for USB data reception");
-        return ESP_LOADER_ERROR_FAIL;
-    }
-
+    // The driver allocates no bulk transfers, the port submits its own
     const cdc_acm_host_device_config_t dev_config = {
         .connection_timeout_ms = config->connection_timeout_ms,
-        .out_buffer_size = config->out_buffer_size,
-        .in_buffer_size = 512,
+        .out_buffer_size = 0,
+        .in_buffer_size = 0,
         .event_cb = handle_usb_event,
-        .data_cb = handle_usb_data
+        .data_cb = NULL
     };
 
     esp_err_t err = cdc_acm_host_open(config->device_vid,
@@ -213,21 +807,61 @@ esp_loader_error_t loader_port_esp32_usb_cdc_acm_init(const loader_esp32_usb_cdc
         return ESP_LOADER_ERROR_FAIL;
     }
 
+    if (device_open(config->device_vid, config->device_pid) != ESP_LOADER_SUCCESS) {
+        ESP_LOGE(TAG, "Could not find the bulk endpoints of the USB device");
+        esp_loader_error_t deinit_status = loader_port_esp32_usb_cdc_acm_deinit();
+        assert(deinit_status == ESP_LOADER_SUCCESS);
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    if (tx_create(config->out_buffer_size) != ESP_LOADER_SUCCESS) {
+        ESP_LOGE(TAG, "Could not create the transmit transfers for USB data transmission");
+        esp_loader_error_t deinit_status = loader_port_esp32_usb_cdc_acm_deinit();
+        assert(deinit_status == ESP_LOADER_SUCCESS);
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    loader_port_esp32_usb_cdc_acm_reset_rx_stats();
+    const uint32_t transfer_count = config->rx_slot_count != 0 ? config->rx_slot_count :
+                                    RX_DEFAULT_TRANSFER_COUNT;
+    if (rx_create(transfer_count) != ESP_LOADER_SUCCESS) {
+        ESP_LOGE(TAG, "Could not create the receive transfers for USB data reception");
+        esp_loader_error_t deinit_status = loader_port_esp32_usb_cdc_acm_deinit();
+        assert(deinit_status == ESP_LOADER_SUCCESS);
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
     return ESP_LOADER_SUCCESS;
 }
 
 
 esp_loader_error_t loader_port_esp32_usb_cdc_acm_deinit(void)
 {
+    port_close();
+
+    // Let the calls still in progress see the port closed and return
+    const int64_t end = esp_timer_get_time() + CLOSE_TIMEOUT_MS * 1000;
+    while (atomic_load(&s_port_calls) > 0) {
+        if (esp_timer_get_time() > end) {
+            ESP_LOGE(TAG, "Port still in use, could not close it");
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+        vTaskDelay(1);
+    }
+
+    if (!tx_cancel() || !rx_cancel()) {
+        ESP_LOGE(TAG, "Transfers still in flight, could not close the port");
+        return ESP_LOADER_ERROR_TIMEOUT;
+    }
+
     s_acm_host_error_callback = NULL;
     s_device_disconnected_callback = NULL;
     s_acm_host_serial_state_callback = NULL;
     s_is_usb_serial_jtag = false;
 
-    if (s_rx_stream_buffer != NULL) {
-        vStreamBufferDelete(s_rx_stream_buffer);
-        s_rx_stream_buffer = NULL;
-    }
+    tx_delete();
+    rx_delete();
+    device_close();
 
     if (s_acm_device != NULL) {
         if (cdc_acm_host_close(s_acm_device) != ESP_OK) {
@@ -241,27 +875,51 @@ esp_loader_error_t loader_port_esp32_usb_cdc_acm_deinit(void)
 }
 
 
+void loader_port_esp32_usb_cdc_acm_get_rx_stats(loader_esp32_usb_cdc_acm_rx_stats_t *stats)
+{
+    *stats = s_rx_stats;
+}
+
+
+void loader_port_esp32_usb_cdc_acm_reset_rx_stats(void)
+{
+    memset(&s_rx_stats, 0, sizeof(s_rx_stats));
+}
+
+
 void loader_port_enter_bootloader(void)
 {
-    assert(s_acm_device != NULL && s_rx_stream_buffer != NULL);
+    if (!port_enter()) {
+        return;
+    }
+
+    tx_flush();
 
     if (s_is_usb_serial_jtag) {
         usb_serial_jtag_enter_booloader();
     } else {
         usb_serial_converter_enter_bootloader();
     }
+
+    port_exit();
 }
 
 
 void loader_port_reset_target(void)
 {
-    assert(s_acm_device != NULL && s_rx_stream_buffer != NULL);
+    if (!port_enter()) {
+        return;
+    }
+
+    tx_flush();
 
     if (s_is_usb_serial_jtag) {
         usb_serial_jtag_reset_target();
     } else {
         usb_serial_converter_reset_target();
     }
+
+    port_exit();
 }
 
 
@@ -289,9 +947,10 @@ void loader_port_debug_print(const char *str)
     printf("DEBUG: %s\n", str);
 }
 
-esp_loader_error_t loader_port_change_transmission_rate(const uint32_t baudrate)
+static esp_loader_error_t change_transmission_rate(const uint32_t baudrate)
 {
-    assert(s_acm_device != NULL && s_rx_stream_buffer != NULL);
+    // Data already written goes out at the old rate
+    RETURN_ON_ERROR(tx_flush());
 
     cdc_acm_line_coding_t line_coding;
     if (cdc_acm_host_line_coding_get(s_acm_device, &line_coding) != ESP_OK) {
@@ -306,3 +965,13 @@ esp_loader_error_t loader_port_change_transmission_rate(const uint32_t baudrate)
 
     return ESP_LOADER_SUCCESS;
 }
+
+esp_loader_error_t loader_port_change_transmission_rate(const uint32_t baudrate)
+{
+    if (!port_enter()) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+    const esp_loader_error_t err = change_transmission_rate(baudrate);
+    port_exit();
+    return err;
+}
@@ -18,7 +18,8 @@
 #include "esp_loader_io.h"
 #include "usb/usb_host.h"
 #include "usb/cdc_acm_host.h"
-#include "freertos/stream_buffer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,18 +31,46 @@ typedef struct {
     uint16_t device_vid;
     uint16_t device_pid;
     uint32_t connection_timeout_ms;
-    uint32_t out_buffer_size; /* Must be larger than max packet size */
+    uint32_t out_buffer_size; /* Must be larger than max packet size, also the size of each
+                                 of the OUT transfers queued by loader_port_write() */
     /* Only set needed callbacks, NULLed ones are ignored .The callbacks are called from
-       the usb library task, so ensure operations done within are thread-safe */
+       the usb library task, so ensure operations done within are thread-safe. After
+       device_disconnected_callback, the port calls fail and the owner closes the port with
+       loader_port_esp32_usb_cdc_acm_deinit() from its own task, never from a callback. */
     loader_port_esp32_usb_cdc_acm_callback_t acm_host_error_callback;
     loader_port_esp32_usb_cdc_acm_callback_t device_disconnected_callback;
     loader_port_esp32_usb_cdc_acm_callback_t acm_host_serial_state_callback;
+    /* Number of 512 byte IN transfers, 0 selects the default of 8. Data is read in place
+       and a transfer is only resubmitted once read, so none is in flight while all wait. */
+    uint32_t rx_slot_count;
 } loader_esp32_usb_cdc_acm_config_t;
 
+typedef struct {
+    uint32_t slots_high_water;    /* Maximum number of IN transfers waiting to be read */
+    uint32_t bytes_high_water;    /* Maximum number of received bytes waiting to be read */
+    uint32_t backpressure_events; /* Number of times no IN transfer was left in flight */
+} loader_esp32_usb_cdc_acm_rx_stats_t;
+
 esp_loader_error_t loader_port_esp32_usb_cdc_acm_init(const loader_esp32_usb_cdc_acm_config_t *config);
 
+/**
+  * @brief Closes the port and frees its resources. Port calls still in progress in other
+  *        tasks fail and are waited for. Must not be called from the port callbacks.
+  */
 esp_loader_error_t loader_port_esp32_usb_cdc_acm_deinit(void);
 
+/**
+  * @brief Returns receive statistics gathered since initialization or the last reset.
+  *
+  * @param stats[out] Receive statistics
+  */
+void loader_port_esp32_usb_cdc_acm_get_rx_stats(loader_esp32_usb_cdc_acm_rx_stats_t *stats);
+
+/**
+  * @brief Resets receive statistics.
+  */
+void loader_port_esp32_usb_cdc_acm_reset_rx_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
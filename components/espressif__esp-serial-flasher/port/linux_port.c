@@ -0,0 +1,336 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_loader_io.h"
+#include "linux_port.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/param.h>
+// termios2 is only available through the kernel headers, which clash with <termios.h>
+#include <asm/termbits.h>
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+static void transfer_debug_print(const uint8_t *data, uint16_t size, bool write)
+{
+    static bool write_prev = false;
+
+    if (write_prev != write) {
+        write_prev = write;
+        printf("\n--- %s ---\n", write ? "WRITE" : "READ");
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        printf("%02x ", data[i]);
+    }
+}
+#endif
+
+#define RX_BUFFER_SIZE 4096
+
+static int s_serial = -1;
+static int s_epoll = -1;
+static uint32_t s_epoll_events;
+static bool s_has_modem_lines;
+static struct timespec s_time_end;
+
+/* The loader mostly reads one byte at a time, so everything available is read at once
+   and handed out from here */
+static uint8_t s_rx_buffer[RX_BUFFER_SIZE];
+static size_t s_rx_head;
+static size_t s_rx_tail;
+
+
+static esp_loader_error_t set_baudrate(uint32_t baudrate)
+{
+    struct termios2 options;
+
+    if (baudrate == 0 || baudrate > LOADER_LINUX_MAX_BAUDRATE) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
+    }
+
+    if (ioctl(s_serial, TCGETS2, &options) < 0) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    // BOTHER takes the rate as is, without mapping it to one of the Bxxx constants
+    options.c_cflag &= ~CBAUD;
+    options.c_cflag |= BOTHER;
+    options.c_cflag &= ~(CBAUD << IBSHIFT);
+    options.c_cflag |= BOTHER << IBSHIFT;
+    options.c_ispeed = baudrate;
+    options.c_ospeed = baudrate;
+
+    if (ioctl(s_serial, TCSETS2, &options) < 0) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t configure_raw(uint32_t baudrate)
+{
+    struct termios2 options;
+
+    if (ioctl(s_serial, TCGETS2, &options) < 0) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    options.c_cflag |= (CLOCAL | CREAD);
+    options.c_cflag &= ~(PARENB | CSTOPB | CSIZE | CRTSCTS);
+    options.c_cflag |= CS8;
+    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
+    options.c_oflag &= ~OPOST;
+    options.c_iflag &= ~(IXON | IXOFF | IXANY); // Turn off s/w flow ctrl
+    options.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL); // Disable any special handling of received bytes
+
+    // Reads never block, waiting is done with epoll
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
+
+    if (ioctl(s_serial, TCSETS2, &options) < 0) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    return set_baudrate(baudrate);
+}
+
+/* Waits for the serial device to become readable or writable */
+static esp_loader_error_t wait_for(uint32_t events, uint32_t timeout)
+{
+    if (s_epoll_events != events) {
+        struct epoll_event event = { .events = events, .data.fd = s_serial };
+        if (epoll_ctl(s_epoll, EPOLL_CTL_MOD, s_serial, &event) < 0) {
+            return ESP_LOADER_ERROR_FAIL;
+        }
+        s_epoll_events = events;
+    }
+
+    struct epoll_event event;
+    int ready;
+    do {
+        ready = epoll_wait(s_epoll, &event, 1, timeout);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready < 0 || (ready > 0 && (event.events & EPOLLERR))) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    return ready == 0 ? ESP_LOADER_ERROR_TIMEOUT : ESP_LOADER_SUCCESS;
+}
+
+/* Drives DTR (IO0) and RTS (EN) together, so the target never sees only one of them change */
+static void set_modem_lines(bool dtr, bool rts)
+{
+    int status;
+
+    if (!s_has_modem_lines || ioctl(s_serial, TIOCMGET, &status) < 0) {
+        return;
+    }
+
+    status = dtr ? (status | TIOCM_DTR) : (status & ~TIOCM_DTR);
+    status = rts ? (status | TIOCM_RTS) : (status & ~TIOCM_RTS);
+
+    ioctl(s_serial, TIOCMSET, &status);
+}
+
+static void rx_flush(void)
+{
+    ioctl(s_serial, TCFLSH, TCIFLUSH);
+    s_rx_head = 0;
+    s_rx_tail = 0;
+}
+
+esp_loader_error_t loader_port_linux_init(const loader_linux_config_t *config)
+{
+    s_serial = open(config->device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (s_serial < 0) {
+        printf("Serial port %s could not be opened: %s\n", config->device, strerror(errno));
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    esp_loader_error_t err = configure_raw(config->baudrate);
+    if (err != ESP_LOADER_SUCCESS) {
+        printf("Serial port could not be configured for %u baud\n", config->baudrate);
+        loader_port_linux_deinit();
+        return err;
+    }
+
+    s_epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = s_serial };
+    if (s_epoll < 0 || epoll_ctl(s_epoll, EPOLL_CTL_ADD, s_serial, &event) < 0) {
+        printf("epoll initialisation failed\n");
+        loader_port_linux_deinit();
+        return ESP_LOADER_ERROR_FAIL;
+    }
+    s_epoll_events = EPOLLIN;
+
+    // Pseudo terminals and some adapters have no modem lines
+    int status;
+    s_has_modem_lines = ioctl(s_serial, TIOCMGET, &status) == 0;
+
+    // Leave the target running, as opening the device might have asserted both lines
+    set_modem_lines(false, false);
+    rx_flush();
+
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_linux_deinit(void)
+{
+    if (s_epoll >= 0) {
+        close(s_epoll);
+        s_epoll = -1;
+    }
+    if (s_serial >= 0) {
+        close(s_serial);
+        s_serial = -1;
+    }
+    s_rx_head = 0;
+    s_rx_tail = 0;
+}
+
+
+esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    size_t written = 0;
+
+    while (written < size) {
+        ssize_t result = write(s_serial, &data[written], size - written);
+
+        if (result > 0) {
+            written += result;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0 && errno != EAGAIN) {
+            return ESP_LOADER_ERROR_FAIL;
+        } else {
+            // Kernel buffer is full, wait until the UART drains some of it
+            RETURN_ON_ERROR( wait_for(EPOLLOUT, timeout) );
+        }
+    }
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    transfer_debug_print(data, size, true);
+#endif
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
+esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    size_t received = 0;
+
+    while (received < size) {
+        if (s_rx_head != s_rx_tail) {
+            const size_t to_copy = MIN(size - received, s_rx_tail - s_rx_head);
+            memcpy(&data[received], &s_rx_buffer[s_rx_head], to_copy);
+            s_rx_head += to_copy;
+            received += to_copy;
+            continue;
+        }
+
+        ssize_t result = read(s_serial, s_rx_buffer, sizeof(s_rx_buffer));
+
+        if (result > 0) {
+            s_rx_head = 0;
+            s_rx_tail = result;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0 && errno != EAGAIN) {
+            return ESP_LOADER_ERROR_FAIL;
+        } else {
+            RETURN_ON_ERROR( wait_for(EPOLLIN, timeout) );
+        }
+    }
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    transfer_debug_print(data, size, false);
+#endif
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
+// Same sequence as the classic reset of esptool: EN low, then IO0 low while EN is released.
+void loader_port_enter_bootloader(void)
+{
+    set_modem_lines(false, true);
+    loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
+    set_modem_lines(true, false);
+    loader_port_delay_ms(SERIAL_FLASHER_BOOT_HOLD_TIME_MS);
+    set_modem_lines(false, false);
+    rx_flush();
+}
+
+
+void loader_port_reset_target(void)
+{
+    set_modem_lines(false, true);
+    loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
+    set_modem_lines(false, false);
+    rx_flush();
+}
+
+
+void loader_port_delay_ms(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+
+void loader_port_start_timer(uint32_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s_time_end);
+    s_time_end.tv_sec += ms / 1000;
+    s_time_end.tv_nsec += (ms % 1000) * 1000000L;
+    if (s_time_end.tv_nsec >= 1000000000L) {
+        s_time_end.tv_sec++;
+        s_time_end.tv_nsec -= 1000000000L;
+    }
+}
+
+
+uint32_t loader_port_remaining_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int64_t remaining = (int64_t)(s_time_end.tv_sec - now.tv_sec) * 1000 +
+                        (s_time_end.tv_nsec - now.tv_nsec) / 1000000;
+    return (remaining > 0) ? (uint32_t)remaining : 0;
+}
+
+
+void loader_port_debug_print(const char *str)
+{
+    printf("DEBUG: %s\n", str);
+}
+
+esp_loader_error_t loader_port_change_transmission_rate(uint32_t baudrate)
+{
+    // Let the data written at the old rate leave the UART first
+    ioctl(s_serial, TCSBRK, 1);
+
+    return set_baudrate(baudrate);
+}
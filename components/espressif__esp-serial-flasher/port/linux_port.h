@@ -0,0 +1,55 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_loader_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOADER_LINUX_MAX_BAUDRATE 12000000
+
+typedef struct {
+    const char *device;     /*!< Path of the serial device, e.g. /dev/ttyUSB0 */
+    uint32_t baudrate;      /*!< Initial baud rate, any rate up to LOADER_LINUX_MAX_BAUDRATE */
+} loader_linux_config_t;
+
+/**
+  * @brief Opens and configures the serial device.
+  *
+  * The target is reset through the DTR (IO0) and RTS (EN) modem lines, wired the same
+  * way as the auto reset circuit of Espressif development boards. Devices without modem
+  * lines are still usable, the target then has to be put into download mode manually.
+  *
+  * @param config[in]       Port configuration.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_INVALID_PARAM Unsupported baud rate
+  *     - ESP_LOADER_ERROR_FAIL Initialization failure
+  */
+esp_loader_error_t loader_port_linux_init(const loader_linux_config_t *config);
+
+/**
+  * @brief Closes the serial device.
+  */
+void loader_port_linux_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
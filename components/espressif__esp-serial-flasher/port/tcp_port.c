@@ -0,0 +1,525 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_loader_io.h"
+#include "tcp_port.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/param.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+static void transfer_debug_print(const uint8_t *data, uint16_t size, bool write)
+{
+    static bool write_prev = false;
+
+    if (write_prev != write) {
+        write_prev = write;
+        printf("\n--- %s ---\n", write ? "WRITE" : "READ");
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        printf("%02x ", data[i]);
+    }
+}
+#endif
+
+#define DEFAULT_CONNECT_TIMEOUT_MS 5000
+#define TX_BUFFER_SIZE 16384
+#define RX_BUFFER_SIZE 4096
+
+// Telnet (RFC 854) and Com Port Control (RFC 2217) codes
+#define TELNET_SE   240
+#define TELNET_SB   250
+#define TELNET_WILL 251
+#define TELNET_WONT 252
+#define TELNET_DO   253
+#define TELNET_DONT 254
+#define TELNET_IAC  255
+
+#define TELNET_OPTION_BINARY   0
+#define TELNET_OPTION_SGA      3
+#define TELNET_OPTION_COM_PORT 44
+
+#define COM_PORT_SET_BAUDRATE 1
+#define COM_PORT_SET_DATASIZE 2
+#define COM_PORT_SET_PARITY   3
+#define COM_PORT_SET_STOPSIZE 4
+#define COM_PORT_SET_CONTROL  5
+
+#define COM_PORT_PARITY_NONE    1
+#define COM_PORT_STOPSIZE_1     1
+#define COM_PORT_CONTROL_DTR_ON  8
+#define COM_PORT_CONTROL_DTR_OFF 9
+#define COM_PORT_CONTROL_RTS_ON  11
+#define COM_PORT_CONTROL_RTS_OFF 12
+
+#define SLIP_DELIMITER 0xC0
+
+typedef enum {
+    TELNET_STATE_DATA,
+    TELNET_STATE_IAC,
+    TELNET_STATE_OPTION,
+    TELNET_STATE_SB,
+    TELNET_STATE_SB_IAC,
+} telnet_state_t;
+
+static const uint8_t s_iac = TELNET_IAC;
+
+static int s_sock = -1;
+static bool s_rfc2217;
+static struct timespec s_time_end;
+
+/* The SLIP frame being written, with IAC bytes already doubled, sent at once when closed */
+static uint8_t s_tx_buffer[TX_BUFFER_SIZE];
+static size_t s_tx_length;
+static bool s_tx_in_frame;
+
+/* Received data with the telnet commands already removed */
+static uint8_t s_rx_buffer[RX_BUFFER_SIZE];
+static size_t s_rx_head;
+static size_t s_rx_tail;
+static telnet_state_t s_telnet_state;
+static uint8_t s_telnet_verb;
+
+
+static esp_loader_error_t wait_for(short events, uint32_t timeout)
+{
+    struct pollfd fd = { .fd = s_sock, .events = events };
+    int ready;
+
+    do {
+        ready = poll(&fd, 1, timeout);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready < 0 || (ready > 0 && (fd.revents & (POLLERR | POLLNVAL)))) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    return ready == 0 ? ESP_LOADER_ERROR_TIMEOUT : ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t send_bytes(const uint8_t *data, size_t size, uint32_t timeout)
+{
+    while (size > 0) {
+        ssize_t sent = write(s_sock, data, size);
+
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                RETURN_ON_ERROR( wait_for(POLLOUT, timeout) );
+                continue;
+            }
+            return ESP_LOADER_ERROR_FAIL;
+        }
+
+        data += sent;
+        size -= sent;
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t tx_flush(uint32_t timeout)
+{
+    esp_loader_error_t err = send_bytes(s_tx_buffer, s_tx_length, timeout);
+    s_tx_length = 0;
+    if (err != ESP_LOADER_SUCCESS) {
+        s_tx_in_frame = false;
+    }
+
+    return err;
+}
+
+// Frames larger than the buffer are sent in several parts
+static esp_loader_error_t tx_queue(const uint8_t *data, size_t size, uint32_t timeout)
+{
+    while (size > 0) {
+        if (s_tx_length == TX_BUFFER_SIZE) {
+            RETURN_ON_ERROR( tx_flush(timeout) );
+        }
+
+        const size_t part = MIN(size, TX_BUFFER_SIZE - s_tx_length);
+        memcpy(&s_tx_buffer[s_tx_length], data, part);
+        s_tx_length += part;
+        data += part;
+        size -= part;
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+/* Sends one Com Port Control subnegotiation, IAC bytes in the value have to be doubled */
+static esp_loader_error_t send_com_port_command(const uint8_t *commands, size_t size)
+{
+    uint8_t buffer[64];
+    size_t length = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        buffer[length++] = commands[i];
+        // Skips the IAC SB header and the IAC SE trailer
+        if (commands[i] == TELNET_IAC && i >= 4 && i < size - 2) {
+            buffer[length++] = TELNET_IAC;
+        }
+    }
+
+    return send_bytes(buffer, length, DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+static esp_loader_error_t set_modem_lines(bool dtr, bool rts)
+{
+    if (!s_rfc2217) {
+        return ESP_LOADER_SUCCESS;
+    }
+
+    // DTR first, so releasing EN already sees the final state of IO0
+    const uint8_t commands[] = {
+        TELNET_IAC, TELNET_SB, TELNET_OPTION_COM_PORT, COM_PORT_SET_CONTROL,
+        dtr ? COM_PORT_CONTROL_DTR_ON : COM_PORT_CONTROL_DTR_OFF, TELNET_IAC, TELNET_SE,
+        TELNET_IAC, TELNET_SB, TELNET_OPTION_COM_PORT, COM_PORT_SET_CONTROL,
+        rts ? COM_PORT_CONTROL_RTS_ON : COM_PORT_CONTROL_RTS_OFF, TELNET_IAC, TELNET_SE,
+    };
+
+    return send_bytes(commands, sizeof(commands), DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+static esp_loader_error_t set_baudrate(uint32_t baudrate)
+{
+    const uint8_t command[] = {
+        TELNET_IAC, TELNET_SB, TELNET_OPTION_COM_PORT, COM_PORT_SET_BAUDRATE,
+        baudrate >> 24, baudrate >> 16, baudrate >> 8, baudrate, TELNET_IAC, TELNET_SE,
+    };
+
+    return send_com_port_command(command, sizeof(command));
+}
+
+static esp_loader_error_t negotiate_rfc2217(uint32_t baudrate)
+{
+    const uint8_t negotiation[] = {
+        TELNET_IAC, TELNET_WILL, TELNET_OPTION_BINARY,
+        TELNET_IAC, TELNET_DO, TELNET_OPTION_BINARY,
+        TELNET_IAC, TELNET_WILL, TELNET_OPTION_SGA,
+        TELNET_IAC, TELNET_DO, TELNET_OPTION_SGA,
+        TELNET_IAC, TELNET_WILL, TELNET_OPTION_COM_PORT,
+        TELNET_IAC, TELNET_SB, TELNET_OPTION_COM_PORT, COM_PORT_SET_DATASIZE, 8, TELNET_IAC, TELNET_SE,
+        TELNET_IAC, TELNET_SB, TELNET_OPTION_COM_PORT, COM_PORT_SET_PARITY, COM_PORT_PARITY_NONE, TELNET_IAC, TELNET_SE,
+        TELNET_IAC, TELNET_SB, TELNET_OPTION_COM_PORT, COM_PORT_SET_STOPSIZE, COM_PORT_STOPSIZE_1, TELNET_IAC, TELNET_SE,
+    };
+
+    RETURN_ON_ERROR( send_bytes(negotiation, sizeof(negotiation), DEFAULT_CONNECT_TIMEOUT_MS) );
+    RETURN_ON_ERROR( set_baudrate(baudrate) );
+
+    return set_modem_lines(false, false);
+}
+
+/* Refuses options the server offers or requests, except the ones asked for in negotiate_rfc2217 */
+static void answer_negotiation(uint8_t verb, uint8_t option)
+{
+    const bool supported = option == TELNET_OPTION_BINARY || option == TELNET_OPTION_SGA ||
+                           (option == TELNET_OPTION_COM_PORT && verb == TELNET_DO);
+
+    if (supported || verb == TELNET_WONT || verb == TELNET_DONT) {
+        return;
+    }
+
+    const uint8_t answer[] = { TELNET_IAC, verb == TELNET_DO ? TELNET_WONT : TELNET_DONT, option };
+    send_bytes(answer, sizeof(answer), DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+/* Strips telnet commands from the received data in place, returns the length of the data left */
+static size_t telnet_decode(uint8_t *data, size_t size)
+{
+    size_t length = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        const uint8_t byte = data[i];
+
+        switch (s_telnet_state) {
+        case TELNET_STATE_DATA:
+            if (byte == TELNET_IAC) {
+                s_telnet_state = TELNET_STATE_IAC;
+            } else {
+                data[length++] = byte;
+            }
+            break;
+        case TELNET_STATE_IAC:
+            if (byte == TELNET_IAC) {
+                data[length++] = byte;
+                s_telnet_state = TELNET_STATE_DATA;
+            } else if (byte >= TELNET_WILL) {
+                s_telnet_verb = byte;
+                s_telnet_state = TELNET_STATE_OPTION;
+            } else if (byte == TELNET_SB) {
+                s_telnet_state = TELNET_STATE_SB;
+            } else {
+                s_telnet_state = TELNET_STATE_DATA;
+            }
+            break;
+        case TELNET_STATE_OPTION:
+            answer_negotiation(s_telnet_verb, byte);
+            s_telnet_state = TELNET_STATE_DATA;
+            break;
+        case TELNET_STATE_SB:
+            // Notifications of the server, e.g. line or modem state, are not needed
+            if (byte == TELNET_IAC) {
+                s_telnet_state = TELNET_STATE_SB_IAC;
+            }
+            break;
+        case TELNET_STATE_SB_IAC:
+            s_telnet_state = byte == TELNET_SE ? TELNET_STATE_DATA : TELNET_STATE_SB;
+            break;
+        }
+    }
+
+    return length;
+}
+
+static esp_loader_error_t tcp_connect(const loader_tcp_config_t *config)
+{
+    const uint32_t timeout = config->connect_timeout_ms != 0 ?
+                             config->connect_timeout_ms : DEFAULT_CONNECT_TIMEOUT_MS;
+    const struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addresses;
+    char port[8];
+
+    snprintf(port, sizeof(port), "%u", config->port);
+    if (getaddrinfo(config->host, port, &hints, &addresses) != 0) {
+        printf("Could not resolve %s\n", config->host);
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    esp_loader_error_t err = ESP_LOADER_ERROR_FAIL;
+    for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+        s_sock = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        address->ai_protocol);
+        if (s_sock < 0) {
+            continue;
+        }
+
+        if (connect(s_sock, address->ai_addr, address->ai_addrlen) == 0) {
+            err = ESP_LOADER_SUCCESS;
+        } else if (errno == EINPROGRESS) {
+            err = wait_for(POLLOUT, timeout);
+            int so_error = 0;
+            socklen_t length = sizeof(so_error);
+            if (err == ESP_LOADER_SUCCESS &&
+                    (getsockopt(s_sock, SOL_SOCKET, SO_ERROR, &so_error, &length) != 0 || so_error != 0)) {
+                err = ESP_LOADER_ERROR_FAIL;
+            }
+        }
+
+        if (err == ESP_LOADER_SUCCESS) {
+            break;
+        }
+        close(s_sock);
+        s_sock = -1;
+    }
+    freeaddrinfo(addresses);
+
+    return err;
+}
+
+esp_loader_error_t loader_port_tcp_init(const loader_tcp_config_t *config)
+{
+    s_rfc2217 = config->rfc2217;
+    s_tx_length = 0;
+    s_tx_in_frame = false;
+    s_rx_head = 0;
+    s_rx_tail = 0;
+    s_telnet_state = TELNET_STATE_DATA;
+
+    esp_loader_error_t err = tcp_connect(config);
+    if (err != ESP_LOADER_SUCCESS) {
+        printf("Could not connect to %s:%u\n", config->host, config->port);
+        return err;
+    }
+
+    // Commands are small and every one of them waits for a response, Nagle would only delay them
+    const int nodelay = 1;
+    setsockopt(s_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (s_rfc2217) {
+        err = negotiate_rfc2217(config->baudrate);
+        if (err != ESP_LOADER_SUCCESS) {
+            printf("RFC 2217 negotiation failed\n");
+            loader_port_tcp_deinit();
+            return err;
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_tcp_deinit(void)
+{
+    if (s_sock >= 0) {
+        close(s_sock);
+        s_sock = -1;
+    }
+    s_tx_length = 0;
+    s_tx_in_frame = false;
+}
+
+
+esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    // The SLIP layer writes frame delimiters on their own, which is used to find frame ends
+    const bool delimiter = size == 1 && data[0] == SLIP_DELIMITER;
+    size_t queued = 0;
+
+    while (queued < size) {
+        // Data bytes equal to IAC are sent twice
+        const uint8_t *iac = s_rfc2217 ? memchr(&data[queued], TELNET_IAC, size - queued) : NULL;
+        const size_t run = iac != NULL ? (size_t)(iac - &data[queued]) + 1 : size - queued;
+        RETURN_ON_ERROR( tx_queue(&data[queued], run, timeout) );
+        if (iac != NULL) {
+            RETURN_ON_ERROR( tx_queue(&s_iac, 1, timeout) );
+        }
+        queued += run;
+    }
+
+    if (delimiter) {
+        s_tx_in_frame = !s_tx_in_frame;
+    }
+
+    if (!s_tx_in_frame) {
+        RETURN_ON_ERROR( tx_flush(timeout) );
+    }
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    transfer_debug_print(data, size, true);
+#endif
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
+esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    size_t received = 0;
+
+    // Anything still queued has to reach the target before a response can come
+    if (s_tx_length > 0) {
+        s_tx_in_frame = false;
+        RETURN_ON_ERROR( tx_flush(timeout) );
+    }
+
+    while (received < size) {
+        if (s_rx_head != s_rx_tail) {
+            const size_t to_copy = MIN(size - received, s_rx_tail - s_rx_head);
+            memcpy(&data[received], &s_rx_buffer[s_rx_head], to_copy);
+            s_rx_head += to_copy;
+            received += to_copy;
+            continue;
+        }
+
+        ssize_t result = recv(s_sock, s_rx_buffer, sizeof(s_rx_buffer), 0);
+
+        if (result > 0) {
+            s_rx_head = 0;
+            s_rx_tail = s_rfc2217 ? telnet_decode(s_rx_buffer, result) : (size_t)result;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            // Connection closed by the server or lost
+            return ESP_LOADER_ERROR_FAIL;
+        } else {
+            RETURN_ON_ERROR( wait_for(POLLIN, timeout) );
+        }
+    }
+
+#if SERIAL_FLASHER_DEBUG_TRACE
+    transfer_debug_print(data, size, false);
+#endif
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
+// Same sequence as the classic reset of esptool: EN low, then IO0 low while EN is released.
+void loader_port_enter_bootloader(void)
+{
+    set_modem_lines(false, true);
+    loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
+    set_modem_lines(true, false);
+    loader_port_delay_ms(SERIAL_FLASHER_BOOT_HOLD_TIME_MS);
+    set_modem_lines(false, false);
+    s_rx_head = 0;
+    s_rx_tail = 0;
+}
+
+
+void loader_port_reset_target(void)
+{
+    set_modem_lines(false, true);
+    loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
+    set_modem_lines(false, false);
+    s_rx_head = 0;
+    s_rx_tail = 0;
+}
+
+
+void loader_port_delay_ms(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+
+void loader_port_start_timer(uint32_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s_time_end);
+    s_time_end.tv_sec += ms / 1000;
+    s_time_end.tv_nsec += (ms % 1000) * 1000000L;
+    if (s_time_end.tv_nsec >= 1000000000L) {
+        s_time_end.tv_sec++;
+        s_time_end.tv_nsec -= 1000000000L;
+    }
+}
+
+
+uint32_t loader_port_remaining_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int64_t remaining = (int64_t)(s_time_end.tv_sec - now.tv_sec) * 1000 +
+                        (s_time_end.tv_nsec - now.tv_nsec) / 1000000;
+    return (remaining > 0) ? (uint32_t)remaining : 0;
+}
+
+
+void loader_port_debug_print(const char *str)
+{
+    printf("DEBUG: %s\n", str);
+}
+
+esp_loader_error_t loader_port_change_transmission_rate(uint32_t baudrate)
+{
+    if (!s_rfc2217) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+
+    return set_baudrate(baudrate);
+}
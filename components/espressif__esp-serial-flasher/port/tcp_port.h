@@ -0,0 +1,60 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_loader_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *host;           /*!< Host name or address of the serial server */
+    uint16_t port;              /*!< TCP port of the serial server */
+    bool rfc2217;               /*!< Speak RFC 2217, otherwise the connection carries raw data */
+    uint32_t baudrate;          /*!< Initial baud rate, only used with RFC 2217 */
+    uint32_t connect_timeout_ms; /*!< Set to zero for the default of 5 seconds */
+} loader_tcp_config_t;
+
+/**
+  * @brief Connects to a serial server, such as ser2net or esp_rfc2217_server.py.
+  *
+  * With RFC 2217, the baud rate is changed remotely and the target is reset through the
+  * DTR (IO0) and RTS (EN) lines of the server's serial port. Raw TCP connections can
+  * neither change the baud rate nor reset the target.
+  *
+  * Every SLIP frame written by the loader is collected in a buffer of 16 KiB, with IAC
+  * bytes already doubled, and sent with a single write() call once the frame is complete.
+  *
+  * @param config[in]       Port configuration.
+  *
+  * @return
+  *     - ESP_LOADER_SUCCESS Success
+  *     - ESP_LOADER_ERROR_TIMEOUT Server did not accept the connection in time
+  *     - ESP_LOADER_ERROR_FAIL Initialization failure
+  */
+esp_loader_error_t loader_port_tcp_init(const loader_tcp_config_t *config);
+
+/**
+  * @brief Closes the connection.
+  */
+void loader_port_tcp_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
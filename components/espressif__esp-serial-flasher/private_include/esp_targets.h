@@ -33,3 +33,16 @@ esp_loader_error_t loader_read_spi_config(target_chip_t target_chip, uint32_t *s
 bool encryption_in_begin_flash_cmd(target_chip_t target);
 esp_loader_error_t loader_read_mac(target_chip_t target_code, uint8_t *mac);
 target_chip_t target_from_chip_id(uint32_t chip_id);
+// Whether the target is one of SERIAL_FLASHER_TARGETS, the others have no entry in the tables
+bool target_in_build(target_chip_t chip);
+
+// Lets the ESP8266 special cases compile out together with its table entry
+static inline bool target_is_esp8266(const target_chip_t chip)
+{
+#if SERIAL_FLASHER_TARGET_ESP8266
+    return chip == ESP8266_CHIP;
+#else
+    (void)chip;
+    return false;
+#endif
+}
@@ -9,6 +9,18 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#if SERIAL_FLASHER_MD5_ROM
+
+/* The ROM of the host chip provides the same context layout and interface */
+#include "esp_rom_md5.h"
+
+#define MD5Init(context) esp_rom_md5_init(context)
+#define MD5Update(context, buf, len) esp_rom_md5_update(context, buf, len)
+#define MD5Final(digest, context) esp_rom_md5_final(digest, context)
+
+#else
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,3 +38,5 @@ void MD5Final(unsigned char digest[16], struct MD5Context *context);
 #ifdef __cplusplus
 }
 #endif
+
+#endif /* SERIAL_FLASHER_MD5_ROM */
@@ -34,6 +34,7 @@ extern "C" {
 
 // Maximum block sized for RAM and Flash writes, respectively.
 #define ESP_RAM_BLOCK 0x1800
+#define MEM_DATA_BATCH_BLOCKS 4
 
 #ifndef MAX
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
@@ -70,6 +71,7 @@ typedef enum __attribute__((packed))
     FLASH_DEFL_END = 0x12,
     SPI_FLASH_MD5 = 0x13,
     GET_SECURITY_INFO = 0x14,
+    ERASE_REGION = 0xd1,
     READ_FLASH_STUB = 0xd2,
 } command_t;
 
@@ -125,6 +127,13 @@ typedef struct __attribute__((packed))
     uint32_t size;
 } flash_read_rom_cmd;
 
+typedef struct __attribute__((packed))
+{
+    command_common_t common;
+    uint32_t offset;
+    uint32_t size;
+} erase_region_command_t;
+
 typedef struct __attribute__((packed))
 {
     command_common_t common;
@@ -247,13 +256,24 @@ typedef struct __attribute__((packed))
 
 esp_loader_error_t loader_initialize_conn(esp_loader_connect_args_t *connect_args);
 
-#if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
 esp_loader_error_t loader_flash_begin_cmd(uint32_t offset, uint32_t erase_size, uint32_t block_size, uint32_t blocks_to_write, bool encryption);
 
 esp_loader_error_t loader_flash_data_cmd(const uint8_t *data, uint32_t size);
 
 esp_loader_error_t loader_flash_end_cmd(bool stay_in_loader);
 
+esp_loader_error_t loader_erase_region_cmd(uint32_t offset, uint32_t size);
+
+esp_loader_error_t loader_md5_cmd(uint32_t address, uint32_t size, uint8_t *md5_out);
+
+esp_loader_error_t loader_spi_parameters(uint32_t total_size);
+
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+esp_loader_error_t loader_run_flash_helper(const esp_loader_flash_helper_t *helper,
+        esp_loader_connect_args_t *connect_args);
+#endif /* SERIAL_FLASHER_INTERFACE_SPI */
+
+#if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
 esp_loader_error_t loader_flash_read_rom_cmd(uint32_t address, uint8_t *data);
 
 esp_loader_error_t loader_flash_read_stub_cmd(uint32_t address, uint32_t size, uint32_t size_per_packet);
@@ -262,10 +282,6 @@ esp_loader_error_t loader_sync_cmd(void);
 
 esp_loader_error_t loader_spi_attach_cmd(uint32_t config);
 
-esp_loader_error_t loader_md5_cmd(uint32_t address, uint32_t size, uint8_t *md5_out);
-
-esp_loader_error_t loader_spi_parameters(uint32_t total_size);
-
 esp_loader_error_t loader_run_stub(target_chip_t target);
 
 esp_loader_error_t loader_get_security_info_cmd(get_security_info_response_data_t *response,
@@ -276,12 +292,18 @@ esp_loader_error_t loader_mem_begin_cmd(uint32_t offset, uint32_t size, uint32_t
 
 esp_loader_error_t loader_mem_data_cmd(const uint8_t *data, uint32_t size);
 
+/* Sends up to MEM_DATA_BATCH_BLOCKS blocks of block_size bytes, the last one may be shorter,
+   as one batch of send_cmd_batch */
+esp_loader_error_t loader_mem_data_batch_cmd(const uint8_t *data, uint32_t size, uint32_t block_size);
+
 esp_loader_error_t loader_mem_end_cmd(uint32_t entrypoint);
 
 esp_loader_error_t loader_write_reg_cmd(uint32_t address, uint32_t value, uint32_t mask, uint32_t delay_us);
 
 esp_loader_error_t loader_read_reg_cmd(uint32_t address, uint32_t *reg);
 
+esp_loader_error_t loader_reg_batch_cmd(esp_loader_reg_op_t *ops, uint32_t count);
+
 esp_loader_error_t loader_change_baudrate_cmd(uint32_t new_baudrate, uint32_t old_baudrate);
 
 #ifdef __cplusplus
@@ -37,4 +37,10 @@ typedef struct {
 
 void log_loader_internal_error(error_code_t error);
 
+uint8_t compute_checksum(const uint8_t *data, uint32_t size);
+
 esp_loader_error_t send_cmd(const send_cmd_config *config);
+
+/* Sends the commands ahead of their responses as far as the interface allows it and collects
+   all the responses in order. Fails with the first error, after all responses have been read. */
+esp_loader_error_t send_cmd_batch(const send_cmd_config *configs, size_t count);
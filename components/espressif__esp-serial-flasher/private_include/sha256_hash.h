@@ -0,0 +1,49 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+
+/* mbedTLS uses the SHA accelerator of the host chip when it has one */
+#include "mbedtls/sha256.h"
+
+typedef mbedtls_sha256_context sha256_context_t;
+
+#else
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t bits;
+    uint8_t block[64];
+    uint32_t block_len;
+} sha256_context_t;
+
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sha256_init(sha256_context_t *context);
+void sha256_update(sha256_context_t *context, const uint8_t *data, size_t size);
+void sha256_final(sha256_context_t *context, uint8_t digest[32]);
+
+#ifdef __cplusplus
+}
+#endif
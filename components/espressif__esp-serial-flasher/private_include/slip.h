@@ -24,3 +24,11 @@ esp_loader_error_t SLIP_receive_packet(uint8_t *buff, size_t max_size, size_t *r
 esp_loader_error_t SLIP_send(const uint8_t *data, size_t size);
 
 esp_loader_error_t SLIP_send_delimiter(void);
+
+/* Number of bytes the data takes on the wire, without the delimiters */
+size_t SLIP_encoded_size(const uint8_t *data, size_t size);
+
+/* Sends data from its start for as long as it fits max_encoded bytes on the wire. Returns the
+   number of data bytes consumed and of bytes written in consumed and encoded. */
+esp_loader_error_t SLIP_send_limited(const uint8_t *data, size_t size, size_t max_encoded,
+                                     size_t *consumed, size_t *encoded);
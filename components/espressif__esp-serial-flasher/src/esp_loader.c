@@ -19,6 +19,7 @@
 #include "esp_stubs.h"
 #include "esp_targets.h"
 #include "md5_hash.h"
+#include "sha256_hash.h"
 #include "slip.h"
 #include <string.h>
 #include <assert.h>
@@ -28,6 +29,8 @@
 #define DEFAULT_FLASH_TIMEOUT 3000
 #define LOAD_RAM_TIMEOUT_PER_MB 2000000
 #define MD5_TIMEOUT_PER_MB 8000
+#define ERASE_REGION_TIMEOUT_PER_MB 10000
+#define FLASH_SECTOR_SIZE 4096
 
 typedef enum {
     SPI_FLASH_READ_ID = 0x9F
@@ -36,29 +39,50 @@ typedef enum {
 static const target_registers_t *s_reg = NULL;
 static target_chip_t s_target = ESP_UNKNOWN_CHIP;
 
-#if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
 static uint32_t s_flash_write_size = 0;
 static uint32_t s_target_flash_size = 0;
+
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+static const esp_loader_flash_helper_t *s_flash_helper = NULL;
 #endif
 
-#if MD5_ENABLED
+#if MD5_ENABLED || SERIAL_FLASHER_SHA256_VERIFY
 
+#if MD5_ENABLED
 static struct MD5Context s_md5_context;
+#endif
+#if SERIAL_FLASHER_SHA256_VERIFY
+static sha256_context_t s_sha256_context;
+#endif
 static uint32_t s_start_address;
 static uint32_t s_image_size;
 
-static inline void init_md5(uint32_t address, uint32_t size)
+static inline void init_digests(uint32_t address, uint32_t size)
 {
     s_start_address = address;
     s_image_size = size;
+#if MD5_ENABLED
     MD5Init(&s_md5_context);
+#endif
+#if SERIAL_FLASHER_SHA256_VERIFY
+    sha256_init(&s_sha256_context);
+#endif
 }
 
-static inline void md5_update(const uint8_t *data, uint32_t size)
+static inline void update_digests(const uint8_t *data, uint32_t size)
 {
+#if MD5_ENABLED
     MD5Update(&s_md5_context, data, size);
+#endif
+#if SERIAL_FLASHER_SHA256_VERIFY
+    sha256_update(&s_sha256_context, data, size);
+#endif
 }
 
+#endif
+
+#if MD5_ENABLED
+
 static inline void md5_final(uint8_t digets[16])
 {
     MD5Final(digets, &s_md5_context);
@@ -84,7 +108,7 @@ esp_loader_error_t esp_loader_connect(esp_loader_connect_args_t *connect_args)
 #if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
     s_target_flash_size = 0;
 
-    if (s_target == ESP8266_CHIP) {
+    if (target_is_esp8266(s_target)) {
         loader_port_start_timer(DEFAULT_TIMEOUT);
         return loader_flash_begin_cmd(0, 0, 0, 0, s_target);
     } else {
@@ -95,6 +119,12 @@ esp_loader_error_t esp_loader_connect(esp_loader_connect_args_t *connect_args)
     }
 #endif /* SERIAL_FLASHER_INTERFACE_UART || SERIAL_FLASHER_INTERFACE_USB */
 
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+    // The target has been reset, so a previously started flash helper is gone
+    s_target_flash_size = 0;
+    esp_stub_set_running(false);
+#endif
+
     return ESP_LOADER_SUCCESS;
 }
 
@@ -107,6 +137,7 @@ target_chip_t esp_loader_get_target(void)
 esp_loader_error_t esp_loader_connect_with_stub(esp_loader_connect_args_t *connect_args)
 {
     s_target_flash_size = 0;
+    esp_stub_set_running(false);
 
     loader_port_enter_bootloader();
 
@@ -119,10 +150,29 @@ esp_loader_error_t esp_loader_connect_with_stub(esp_loader_connect_args_t *conne
     return ESP_LOADER_SUCCESS;
 }
 
+esp_loader_error_t esp_loader_connect_reuse_stub(esp_loader_connect_args_t *connect_args)
+{
+    s_target_flash_size = 0;
+
+    /* ERASE_REGION of nothing is a no-op for the stub, the ROM rejects the unknown command and
+       nothing answers while the target runs its application */
+    loader_port_start_timer(connect_args->sync_timeout);
+    if (loader_erase_region_cmd(0, 0) == ESP_LOADER_SUCCESS) {
+        esp_stub_set_running(true);
+        return loader_detect_chip(&s_target, &s_reg);
+    }
+
+    return esp_loader_connect_with_stub(connect_args);
+}
+
 #ifdef SERIAL_FLASHER_INTERFACE_UART
 esp_loader_error_t esp_loader_connect_secure_download_mode(esp_loader_connect_args_t *connect_args,
         const uint32_t flash_size, const target_chip_t target_chip)
 {
+    if (target_chip != ESP_UNKNOWN_CHIP && !target_in_build(target_chip)) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_CHIP;
+    }
+
     s_target_flash_size = flash_size;
     s_target = target_chip;
 
@@ -134,7 +184,7 @@ esp_loader_error_t esp_loader_connect_secure_download_mode(esp_loader_connect_ar
         RETURN_ON_ERROR(loader_detect_chip(&s_target, &s_reg));
     }
 
-    if (s_target == ESP8266_CHIP) {
+    if (target_is_esp8266(s_target)) {
         loader_port_start_timer(DEFAULT_TIMEOUT);
         return loader_flash_begin_cmd(0, 0, 0, 0, s_target);
     } else {
@@ -147,30 +197,40 @@ esp_loader_error_t esp_loader_connect_secure_download_mode(esp_loader_connect_ar
     return ESP_LOADER_SUCCESS;
 }
 #endif /* SERIAL_FLASHER_INTERFACE_UART */
+#endif /* SERIAL_FLASHER_INTERFACE_UART || SERIAL_FLASHER_INTERFACE_USB */
 
-static esp_loader_error_t spi_set_data_lengths(size_t mosi_bits, size_t miso_bits)
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+esp_loader_error_t esp_loader_connect_with_flash_helper(esp_loader_connect_args_t *connect_args,
+        const esp_loader_flash_helper_t *helper)
 {
-    if (mosi_bits > 0) {
-        RETURN_ON_ERROR( esp_loader_write_register(s_reg->mosi_dlen, mosi_bits - 1) );
-    }
-    if (miso_bits > 0) {
-        RETURN_ON_ERROR( esp_loader_write_register(s_reg->miso_dlen, miso_bits - 1) );
+    if (helper->segment_count == 0) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
     }
 
+    s_target_flash_size = 0;
+    s_flash_helper = NULL;
+
+    RETURN_ON_ERROR(esp_loader_connect(connect_args));
+
+    RETURN_ON_ERROR(loader_run_flash_helper(helper, connect_args));
+
+    s_flash_helper = helper;
+
     return ESP_LOADER_SUCCESS;
 }
+#endif /* SERIAL_FLASHER_INTERFACE_SPI */
 
-static esp_loader_error_t spi_set_data_lengths_8266(size_t mosi_bits, size_t miso_bits)
+static void reg_op_add(esp_loader_reg_op_t *ops, size_t *count, bool write, uint32_t address, uint32_t value)
 {
-    uint32_t mosi_mask = (mosi_bits == 0) ? 0 : mosi_bits - 1;
-    uint32_t miso_mask = (miso_bits == 0) ? 0 : miso_bits - 1;
-    return esp_loader_write_register(s_reg->usr1, (miso_mask << 8) | (mosi_mask << 17));
+    ops[(*count)++] = (esp_loader_reg_op_t) {
+        .write = write, .address = address, .value = value
+    };
 }
 
 static esp_loader_error_t spi_flash_command(spi_flash_cmd_t cmd, void *data_tx, size_t tx_size, void *data_rx, size_t rx_size)
 {
     assert(rx_size <= 32); // Reading more than 32 bits back from a SPI flash operation is unsupported
-    assert(tx_size <= 64); // Writing more than 64 bytes of data with one SPI command is unsupported
+    assert(tx_size <= 64); // Writing more than 64 bits of data with one SPI command is unsupported
 
     uint32_t SPI_USR_CMD  = (1 << 31);
     uint32_t SPI_USR_MISO = (1 << 28);
@@ -178,18 +238,6 @@ static esp_loader_error_t spi_flash_command(spi_flash_cmd_t cmd, void *data_tx,
     uint32_t SPI_CMD_USR  = (1 << 18);
     uint32_t CMD_LEN_SHIFT = 28;
 
-    // Save SPI configuration
-    uint32_t old_spi_usr;
-    uint32_t old_spi_usr2;
-    RETURN_ON_ERROR( esp_loader_read_register(s_reg->usr, &old_spi_usr) );
-    RETURN_ON_ERROR( esp_loader_read_register(s_reg->usr2, &old_spi_usr2) );
-
-    if (s_target == ESP8266_CHIP) {
-        RETURN_ON_ERROR( spi_set_data_lengths_8266(tx_size, rx_size) );
-    } else {
-        RETURN_ON_ERROR( spi_set_data_lengths(tx_size, rx_size) );
-    }
-
     uint32_t usr_reg_2 = (7 << CMD_LEN_SHIFT) | cmd;
     uint32_t usr_reg = SPI_USR_CMD;
     if (rx_size > 0) {
@@ -199,52 +247,75 @@ static esp_loader_error_t spi_flash_command(spi_flash_cmd_t cmd, void *data_tx,
         usr_reg |= SPI_USR_MOSI;
     }
 
-    RETURN_ON_ERROR( esp_loader_write_register(s_reg->usr, usr_reg) );
-    RETURN_ON_ERROR( esp_loader_write_register(s_reg->usr2, usr_reg_2 ) );
+    /* The whole command up to the first poll of its completion goes out as one batch, the
+       SPI configuration it overwrites is read at the start of it */
+    esp_loader_reg_op_t ops[16];
+    size_t count = 0;
+    reg_op_add(ops, &count, false, s_reg->usr, 0);
+    reg_op_add(ops, &count, false, s_reg->usr2, 0);
+
+    if (target_is_esp8266(s_target)) {
+        uint32_t mosi_mask = (tx_size == 0) ? 0 : tx_size - 1;
+        uint32_t miso_mask = (rx_size == 0) ? 0 : rx_size - 1;
+        reg_op_add(ops, &count, true, s_reg->usr1, (miso_mask << 8) | (mosi_mask << 17));
+    } else {
+        if (tx_size > 0) {
+            reg_op_add(ops, &count, true, s_reg->mosi_dlen, tx_size - 1);
+        }
+        if (rx_size > 0) {
+            reg_op_add(ops, &count, true, s_reg->miso_dlen, rx_size - 1);
+        }
+    }
+
+    reg_op_add(ops, &count, true, s_reg->usr, usr_reg);
+    reg_op_add(ops, &count, true, s_reg->usr2, usr_reg_2);
 
     if (tx_size == 0) {
         // clear data register before we read it
-        RETURN_ON_ERROR( esp_loader_write_register(s_reg->w0, 0) );
+        reg_op_add(ops, &count, true, s_reg->w0, 0);
     } else {
         uint32_t *data = (uint32_t *)data_tx;
         uint32_t words_to_write = (tx_size + 31) / (8 * 4);
         uint32_t data_reg_addr = s_reg->w0;
 
         while (words_to_write--) {
-            uint32_t word = *data++;
-            RETURN_ON_ERROR( esp_loader_write_register(data_reg_addr, word) );
+            reg_op_add(ops, &count, true, data_reg_addr, *data++);
             data_reg_addr += 4;
         }
     }
 
-    RETURN_ON_ERROR( esp_loader_write_register(s_reg->cmd, SPI_CMD_USR) );
+    reg_op_add(ops, &count, true, s_reg->cmd, SPI_CMD_USR);
+
+    // The command is done by the time the target gets to the read of the command register
+    const size_t poll = count;
+    reg_op_add(ops, &count, false, s_reg->cmd, 0);
+    reg_op_add(ops, &count, false, s_reg->w0, 0);
+
+    RETURN_ON_ERROR( esp_loader_run_register_batch(ops, count) );
 
     uint32_t trials = 10;
-    while (trials--) {
-        uint32_t cmd_reg;
-        RETURN_ON_ERROR( esp_loader_read_register(s_reg->cmd, &cmd_reg) );
-        if ((cmd_reg & SPI_CMD_USR) == 0) {
-            break;
+    while (ops[poll].value & SPI_CMD_USR) {
+        if (--trials == 0) {
+            return ESP_LOADER_ERROR_TIMEOUT;
         }
+        RETURN_ON_ERROR( esp_loader_run_register_batch(&ops[poll], 2) );
     }
 
-    if (trials == 0) {
-        return ESP_LOADER_ERROR_TIMEOUT;
-    }
-
-    RETURN_ON_ERROR( esp_loader_read_register(s_reg->w0, data_rx) );
+    *(uint32_t *)data_rx = ops[poll + 1].value;
 
     // Restore SPI configuration
-    RETURN_ON_ERROR( esp_loader_write_register(s_reg->usr, old_spi_usr) );
-    RETURN_ON_ERROR( esp_loader_write_register(s_reg->usr2, old_spi_usr2) );
+    esp_loader_reg_op_t restore[] = {
+        { .write = true, .address = s_reg->usr, .value = ops[0].value },
+        { .write = true, .address = s_reg->usr2, .value = ops[1].value },
+    };
 
-    return ESP_LOADER_SUCCESS;
+    return esp_loader_run_register_batch(restore, sizeof(restore) / sizeof(restore[0]));
 }
 
 static uint32_t calc_erase_size(const target_chip_t target, const uint32_t offset,
                                 const uint32_t image_size)
 {
-    if (target != ESP8266_CHIP || esp_stub_get_running()) {
+    if (!target_is_esp8266(target) || esp_stub_get_running()) {
         return image_size;
     } else {
         /* Needed to fix a bug in the ESP8266 ROM */
@@ -318,6 +389,13 @@ esp_loader_error_t esp_loader_flash_detect_size(uint32_t *flash_size)
 
 esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size, uint32_t block_size)
 {
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+    // The ROM does not implement the flash commands over SPI
+    if (!esp_stub_get_running()) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+#endif
+
     s_flash_write_size = block_size;
 
     // Both the address and image size must be aligned to 4 bytes
@@ -339,20 +417,49 @@ esp_loader_error_t esp_loader_flash_start(uint32_t offset, uint32_t image_size,
         }
     }
 
-#if MD5_ENABLED
-    init_md5(offset, image_size);
+#if MD5_ENABLED || SERIAL_FLASHER_SHA256_VERIFY
+    init_digests(offset, image_size);
 #endif
 
     bool encryption_in_cmd = encryption_in_begin_flash_cmd(s_target) && !esp_stub_get_running();
     const uint32_t erase_size = calc_erase_size(esp_loader_get_target(), offset, image_size);
     const uint32_t blocks_to_write = (image_size + block_size - 1) / block_size;
 
-    const uint32_t erase_region_timeout_per_mb = 10000;
-    loader_port_start_timer(timeout_per_mb(erase_size, erase_region_timeout_per_mb));
+    loader_port_start_timer(timeout_per_mb(erase_size, ERASE_REGION_TIMEOUT_PER_MB));
     return loader_flash_begin_cmd(offset, erase_size, block_size, blocks_to_write, encryption_in_cmd);
 }
 
 
+esp_loader_error_t esp_loader_flash_erase_region(uint32_t offset, uint32_t size)
+{
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+    if (!esp_stub_get_running()) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+#endif
+
+    if (offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
+    }
+
+    if (size == 0) {
+        return ESP_LOADER_SUCCESS;
+    }
+
+    if (esp_stub_get_running()) {
+        loader_port_start_timer(timeout_per_mb(size, ERASE_REGION_TIMEOUT_PER_MB));
+        return loader_erase_region_cmd(offset, size);
+    }
+
+    // The ROM has no erase command, but erases the whole region when a write begins
+    bool encryption_in_cmd = encryption_in_begin_flash_cmd(s_target);
+    const uint32_t erase_size = calc_erase_size(esp_loader_get_target(), offset, size);
+
+    loader_port_start_timer(timeout_per_mb(erase_size, ERASE_REGION_TIMEOUT_PER_MB));
+    return loader_flash_begin_cmd(offset, erase_size, FLASH_SECTOR_SIZE, 0, encryption_in_cmd);
+}
+
+
 esp_loader_error_t esp_loader_flash_write(void *payload, uint32_t size)
 {
     uint32_t padding_bytes = s_flash_write_size - size;
@@ -368,8 +475,8 @@ esp_loader_error_t esp_loader_flash_write(void *payload, uint32_t size)
         data[padding_index++] = padding_pattern;
     }
 
-#if MD5_ENABLED
-    md5_update(payload, (size + 3) & ~3);
+#if MD5_ENABLED || SERIAL_FLASHER_SHA256_VERIFY
+    update_digests(payload, (size + 3) & ~3);
 #endif
 
     unsigned int attempt = 0;
@@ -391,11 +498,12 @@ esp_loader_error_t esp_loader_flash_finish(bool reboot)
     return loader_flash_end_cmd(!reboot);
 }
 
+#if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
 
 esp_loader_error_t esp_loader_change_transmission_rate_stub(const uint32_t old_transmission_rate,
         const uint32_t new_transmission_rate)
 {
-    if (s_target == ESP8266_CHIP || !esp_stub_get_running()) {
+    if (target_is_esp8266(s_target) || !esp_stub_get_running()) {
         return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
     }
 
@@ -434,7 +542,12 @@ esp_loader_error_t esp_loader_get_security_info(esp_loader_target_security_info_
         security_info->target_chip = target_from_chip_id(resp.chip_id);
         security_info->eco_version = resp.eco_version;
     } else if (response_received_size == sizeof(get_security_info_response_data_t) - 8) {
+        // Only the ESP32-S2 ROM leaves out the chip ID
+#if SERIAL_FLASHER_TARGET_ESP32S2
         security_info->target_chip = ESP32S2_CHIP;
+#else
+        security_info->target_chip = ESP_UNKNOWN_CHIP;
+#endif
         security_info->eco_version = 0;
     } else {
         return ESP_LOADER_ERROR_INVALID_RESPONSE;
@@ -598,23 +711,34 @@ esp_loader_error_t esp_loader_flash_read(uint8_t *dest, uint32_t address, uint32
 }
 #endif /* SERIAL_FLASHER_INTERFACE_UART || SERIAL_FLASHER_INTERFACE_USB */
 
+// check we're not going to overwrite a running software loader with this data
+static esp_loader_error_t check_loader_overlap(const uint32_t load_start, const uint32_t load_end,
+        const esp_loader_bin_segment_t *segments, const uint32_t segment_count)
+{
+    for (uint32_t seg = 0; seg < segment_count; seg++) {
+        const uint32_t loader_start = segments[seg].addr;
+        const uint32_t loader_end = segments[seg].addr + segments[seg].size;
+        if (load_start < loader_end && load_end > loader_start) {
+            loader_port_debug_print("Software loader is resident at the requested address, can't load binary at overlapping address range");
+            return ESP_LOADER_ERROR_INVALID_PARAM;
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
 esp_loader_error_t esp_loader_mem_start(uint32_t offset, uint32_t size, uint32_t block_size)
 {
 #if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
     if (esp_stub_get_running()) {
         const esp_stub_t *stub = &esp_stub[s_target];
-
-        // check we're not going to overwrite a running stub with this data
-        const uint32_t load_start = offset;
-        const uint32_t load_end = offset + size;
-        for (uint32_t seg = 0; seg < sizeof(stub->segments) / sizeof(stub->segments[0]); seg++) {
-            const uint32_t stub_start = stub->segments[seg].addr;
-            const uint32_t stub_end = stub->segments[seg].addr + stub->segments[seg].size;
-            if (load_start < stub_end && load_end > stub_start) {
-                loader_port_debug_print("Software loader is resident at the requested address, can't load binary at overlapping address range");
-                return ESP_LOADER_ERROR_INVALID_PARAM;
-            }
-        }
+        RETURN_ON_ERROR( check_loader_overlap(offset, offset + size, stub->segments,
+                                              sizeof(stub->segments) / sizeof(stub->segments[0])) );
+    }
+#elif defined SERIAL_FLASHER_INTERFACE_SPI
+    if (esp_stub_get_running() && s_flash_helper != NULL) {
+        RETURN_ON_ERROR( check_loader_overlap(offset, offset + size, s_flash_helper->segments,
+                                              s_flash_helper->segment_count) );
     }
 #endif
 
@@ -649,7 +773,7 @@ esp_loader_error_t esp_loader_mem_finish(uint32_t entrypoint)
 
 esp_loader_error_t esp_loader_read_mac(uint8_t *mac)
 {
-    if (s_target == ESP8266_CHIP) {
+    if (target_is_esp8266(s_target)) {
         return ESP_LOADER_ERROR_UNSUPPORTED_CHIP;
     }
 
@@ -671,9 +795,16 @@ esp_loader_error_t esp_loader_write_register(uint32_t address, uint32_t reg_valu
     return loader_write_reg_cmd(address, reg_value, 0xFFFFFFFF, 0);
 }
 
+esp_loader_error_t esp_loader_run_register_batch(esp_loader_reg_op_t *ops, uint32_t count)
+{
+    loader_port_start_timer(DEFAULT_TIMEOUT);
+
+    return loader_reg_batch_cmd(ops, count);
+}
+
 esp_loader_error_t esp_loader_change_transmission_rate(uint32_t transmission_rate)
 {
-    if (s_target == ESP8266_CHIP || esp_stub_get_running()) {
+    if (target_is_esp8266(s_target) || esp_stub_get_running()) {
         return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
     }
 
@@ -698,9 +829,14 @@ static void hexify(const uint8_t raw_md5[16], uint8_t hex_md5_out[32])
 
 esp_loader_error_t esp_loader_flash_verify(void)
 {
-    if (s_target == ESP8266_CHIP && !esp_stub_get_running()) {
+    if (target_is_esp8266(s_target) && !esp_stub_get_running()) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+    if (!esp_stub_get_running()) {
         return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
     }
+#endif
 
     /* Zero termination require 1 byte */
     uint8_t received_md5[MAX(MD5_SIZE_ROM, MD5_SIZE_STUB) + 1] = {0};
@@ -737,6 +873,63 @@ esp_loader_error_t esp_loader_flash_verify(void)
     return ESP_LOADER_SUCCESS;
 }
 
+static uint8_t unhexify_nibble(uint8_t hex)
+{
+    return hex <= '9' ? hex - '0' : (hex | 0x20) - 'a' + 10;
+}
+
+esp_loader_error_t esp_loader_flash_md5(uint32_t address, uint32_t size, uint8_t *md5)
+{
+    if (target_is_esp8266(s_target) && !esp_stub_get_running()) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+#ifdef SERIAL_FLASHER_INTERFACE_SPI
+    if (!esp_stub_get_running()) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+#endif
+
+    uint8_t received_md5[MAX(MD5_SIZE_ROM, MD5_SIZE_STUB)];
+
+    loader_port_start_timer(timeout_per_mb(size, MD5_TIMEOUT_PER_MB));
+
+    RETURN_ON_ERROR( loader_md5_cmd(address, size, received_md5) );
+
+    // The stub sends the raw digest, the ROM sends it as hex characters
+    if (esp_stub_get_running()) {
+        memcpy(md5, received_md5, MD5_SIZE_STUB);
+    } else {
+        for (int i = 0; i < MD5_SIZE_STUB; i++) {
+            md5[i] = (unhexify_nibble(received_md5[2 * i]) << 4) |
+                     unhexify_nibble(received_md5[2 * i + 1]);
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+#endif
+
+#if SERIAL_FLASHER_SHA256_VERIFY
+
+#if !MD5_ENABLED
+#error "SERIAL_FLASHER_SHA256_VERIFY requires MD5_ENABLED"
+#endif
+
+esp_loader_error_t esp_loader_flash_verify_sha256(const uint8_t *expected_sha256)
+{
+    uint8_t calculated_sha256[32];
+    sha256_final(&s_sha256_context, calculated_sha256);
+
+    if (memcmp(calculated_sha256, expected_sha256, sizeof(calculated_sha256)) != 0) {
+        loader_port_debug_print("Error: SHA-256 digest of the written data does not match\n");
+        return ESP_LOADER_ERROR_INVALID_DIGEST;
+    }
+
+    // Neither the ROM nor the stub hash with SHA-256, the target checks the flash with MD5
+    return esp_loader_flash_verify();
+}
+
 #endif
 
 void esp_loader_reset_target(void)
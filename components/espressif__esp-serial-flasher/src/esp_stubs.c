@@ -31,25 +31,12 @@ void esp_stub_set_running(bool stub_status)
 
 #if (defined SERIAL_FLASHER_INTERFACE_UART) || (defined SERIAL_FLASHER_INTERFACE_USB)
 
-#if __STDC_VERSION__ >= 201112L
-_Static_assert(ESP8266_CHIP == 0, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32_CHIP == 1, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32S2_CHIP == 2, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32C3_CHIP == 3, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32S3_CHIP == 4, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32C2_CHIP == 5, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32_RESERVED0_CHIP == 6, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32H2_CHIP == 7, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP32C6_CHIP == 8, "Stub order matches target_chip_t enumeration");
-_Static_assert(ESP_MAX_CHIP == 9, "Stub order matches target_chip_t enumeration");
-#endif
-
+/* Indexed by target_chip_t, the entries of chips without a stub or left out of the build
+   stay all zero */
 const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
-    // placeholder
-    {},
-
+#if SERIAL_FLASHER_TARGET_ESP32
     // esp32.json
-    {
+    [ESP32_CHIP] = {
         .header = {
             .entrypoint = 1074274996,
         },
@@ -66,9 +53,11 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32S2
     // esp32s2.json
-    {
+    [ESP32S2_CHIP] = {
         .header = {
             .entrypoint = 1073913140,
         },
@@ -85,9 +74,11 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32C3
     // esp32c3.json
-    {
+    [ESP32C3_CHIP] = {
         .header = {
             .entrypoint = 1077411840,
         },
@@ -104,9 +95,11 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32S3
     // esp32s3.json
-    {
+    [ESP32S3_CHIP] = {
         .header = {
             .entrypoint = 1077391268,
         },
@@ -123,9 +116,11 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32C2
     // esp32c2.json
-    {
+    [ESP32C2_CHIP] = {
         .header = {
             .entrypoint = 1077411840,
         },
@@ -142,12 +137,11 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
-    // placeholder
-    {},
-
+#if SERIAL_FLASHER_TARGET_ESP32H2
     // esp32h2.json
-    {
+    [ESP32H2_CHIP] = {
         .header = {
             .entrypoint = 1082130432,
         },
@@ -164,9 +158,11 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32C6
     // esp32c6.json
-    {
+    [ESP32C6_CHIP] = {
         .header = {
             .entrypoint = 1082130432,
         },
@@ -183,6 +179,7 @@ const esp_stub_t esp_stub[ESP_MAX_CHIP] = {
             },
         },
     },
+#endif
 
 };
 
@@ -42,14 +42,29 @@ typedef struct {
 
 #define CHIP_ID_NONE 0xFF
 
+#define SPI_CONFIG_ESP32 SERIAL_FLASHER_TARGET_ESP32
+#define SPI_CONFIG_ESP32XX (SERIAL_FLASHER_TARGET_ESP32S2 || SERIAL_FLASHER_TARGET_ESP32C3 || \
+                            SERIAL_FLASHER_TARGET_ESP32S3 || SERIAL_FLASHER_TARGET_ESP32C2)
+#define SPI_CONFIG_UNSUPPORTED (SERIAL_FLASHER_TARGET_ESP32H2 || SERIAL_FLASHER_TARGET_ESP32C6)
+
+#if SPI_CONFIG_ESP32
 static esp_loader_error_t spi_config_esp32(uint32_t efuse_base, uint32_t *spi_config);
+#endif
+#if SPI_CONFIG_ESP32XX
 static esp_loader_error_t spi_config_esp32xx(uint32_t efuse_base, uint32_t *spi_config);
+#endif
+#if SPI_CONFIG_UNSUPPORTED
 static esp_loader_error_t spi_config_unsupported(uint32_t efuse_base, uint32_t *spi_config);
+#endif
+
+/* Indexed by target_chip_t. The entries of targets left out of the build, and of the reserved
+   value, stay all zero. */
 
 static const esp_target_t esp_target[ESP_MAX_CHIP] = {
 
+#if SERIAL_FLASHER_TARGET_ESP8266
     // ESP8266
-    {
+    [ESP8266_CHIP] = {
         .regs = {
             .cmd  = ESP8266_SPI_REG_BASE + 0x00,
             .usr  = ESP8266_SPI_REG_BASE + 0x1c,
@@ -66,9 +81,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = false,
         .chip_id = CHIP_ID_NONE,
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32
     // ESP32
-    {
+    [ESP32_CHIP] = {
         .regs = {
             .cmd  = ESP32_SPI_REG_BASE + 0x00,
             .usr  = ESP32_SPI_REG_BASE + 0x1c,
@@ -85,9 +102,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = false,
         .chip_id = 0,
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32S2
     // ESP32S2
-    {
+    [ESP32S2_CHIP] = {
         .regs = {
             .cmd  = ESP32S2_SPI_REG_BASE + 0x00,
             .usr  = ESP32S2_SPI_REG_BASE + 0x18,
@@ -104,9 +123,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = true,
         .chip_id = 2,
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32C3
     // ESP32C3
-    {
+    [ESP32C3_CHIP] = {
         .regs = {
             .cmd  = ESP32xx_SPI_REG_BASE + 0x00,
             .usr  = ESP32xx_SPI_REG_BASE + 0x18,
@@ -123,9 +144,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = true,
         .chip_id = 5,
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32S3
     // ESP32S3
-    {
+    [ESP32S3_CHIP] = {
         .regs = {
             .cmd  = ESP32xx_SPI_REG_BASE + 0x00,
             .usr  = ESP32xx_SPI_REG_BASE + 0x18,
@@ -142,9 +165,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = true,
         .chip_id = 9,
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32C2
     // ESP32C2
-    {
+    [ESP32C2_CHIP] = {
         .regs = {
             .cmd  = ESP32xx_SPI_REG_BASE + 0x00,
             .usr  = ESP32xx_SPI_REG_BASE + 0x18,
@@ -161,14 +186,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = true,
         .chip_id = 12,
     },
+#endif
 
-    // Reserved for future use
-    {
-        .chip_id = CHIP_ID_NONE,
-    },
-
+#if SERIAL_FLASHER_TARGET_ESP32H2
     // ESP32H2
-    {
+    [ESP32H2_CHIP] = {
         .regs = {
             .cmd  = ESP32H2_SPI_REG_BASE + 0x00,
             .usr  = ESP32H2_SPI_REG_BASE + 0x18,
@@ -185,9 +207,11 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = true,
         .chip_id = 16,
     },
+#endif
 
+#if SERIAL_FLASHER_TARGET_ESP32C6
     // ESP32C6
-    {
+    [ESP32C6_CHIP] = {
         .regs = {
             .cmd  = ESP32C6_SPI_REG_BASE + 0x00,
             .usr  = ESP32C6_SPI_REG_BASE + 0x18,
@@ -204,8 +228,14 @@ static const esp_target_t esp_target[ESP_MAX_CHIP] = {
         .encryption_in_begin_flash_cmd = true,
         .chip_id = 13,
     },
+#endif
 };
 
+bool target_in_build(const target_chip_t chip)
+{
+    return chip < ESP_MAX_CHIP && esp_target[chip].regs.cmd != 0;
+}
+
 const target_registers_t *get_esp_target_data(target_chip_t chip)
 {
     return (const target_registers_t *)&esp_target[chip];
@@ -219,6 +249,9 @@ esp_loader_error_t loader_detect_chip(target_chip_t *target_chip, const target_r
     esp_loader_target_security_info_t security_info;
 
     if (esp_loader_get_security_info(&security_info) == ESP_LOADER_SUCCESS) {
+        if (!target_in_build(security_info.target_chip)) {
+            return ESP_LOADER_ERROR_UNSUPPORTED_CHIP;
+        }
         *target_chip = security_info.target_chip;
         *target_data = (target_registers_t *)&esp_target[security_info.target_chip];
         return ESP_LOADER_SUCCESS;
@@ -229,6 +262,9 @@ esp_loader_error_t loader_detect_chip(target_chip_t *target_chip, const target_r
     RETURN_ON_ERROR( esp_loader_read_register(CHIP_DETECT_MAGIC_REG_ADDR,  &magic_value) );
 
     for (int chip = 0; chip < ESP_MAX_CHIP; chip++) {
+        if (!target_in_build((target_chip_t)chip)) {
+            continue;
+        }
         for (int index = 0; index < MAX_MAGIC_VALUES; index++) {
             if (magic_value == esp_target[chip].chip_magic_value[index]) {
                 *target_chip = (target_chip_t)chip;
@@ -251,11 +287,14 @@ esp_loader_error_t loader_read_mac(const target_chip_t target_code, uint8_t *mac
 {
     const esp_target_t *target = &esp_target[target_code];
 
-    uint32_t part1;
-    uint32_t part2;
+    esp_loader_reg_op_t words[] = {
+        { .address = target->efuse_base + target->mac_efuse_offset },
+        { .address = target->efuse_base + target->mac_efuse_offset + sizeof(uint32_t) },
+    };
+    RETURN_ON_ERROR(esp_loader_run_register_batch(words, 2));
 
-    RETURN_ON_ERROR(esp_loader_read_register(target->efuse_base + target->mac_efuse_offset, &part1));
-    RETURN_ON_ERROR(esp_loader_read_register(target->efuse_base + target->mac_efuse_offset + sizeof(uint32_t), &part2));
+    const uint32_t part1 = words[0].value;
+    const uint32_t part2 = words[1].value;
 
     mac[0] = (part2 >> 8) & 0xff;
     mac[1] = (part2 >> 0) & 0xff;
@@ -278,14 +317,19 @@ static inline uint8_t adjust_pin_number(uint8_t num)
     return (num >= 30) ? num + 2 : num;
 }
 
-
+#if SPI_CONFIG_ESP32
 static esp_loader_error_t spi_config_esp32(uint32_t efuse_base, uint32_t *spi_config)
 {
     *spi_config = 0;
 
-    uint32_t reg5, reg3;
-    RETURN_ON_ERROR( esp_loader_read_register(efuse_word_addr(efuse_base, 5), &reg5) );
-    RETURN_ON_ERROR( esp_loader_read_register(efuse_word_addr(efuse_base, 3), &reg3) );
+    esp_loader_reg_op_t words[] = {
+        { .address = efuse_word_addr(efuse_base, 5) },
+        { .address = efuse_word_addr(efuse_base, 3) },
+    };
+    RETURN_ON_ERROR( esp_loader_run_register_batch(words, 2) );
+
+    const uint32_t reg5 = words[0].value;
+    const uint32_t reg3 = words[1].value;
 
     uint32_t pins = reg5 & 0xfffff;
 
@@ -307,15 +351,22 @@ static esp_loader_error_t spi_config_esp32(uint32_t efuse_base, uint32_t *spi_co
 
     return ESP_LOADER_SUCCESS;
 }
+#endif /* SPI_CONFIG_ESP32 */
 
+#if SPI_CONFIG_ESP32XX
 // Applies for esp32s2, esp32c3 and esp32c3
 static esp_loader_error_t spi_config_esp32xx(uint32_t efuse_base, uint32_t *spi_config)
 {
     *spi_config = 0;
 
-    uint32_t reg1, reg2;
-    RETURN_ON_ERROR( esp_loader_read_register(efuse_word_addr(efuse_base, 18), &reg1) );
-    RETURN_ON_ERROR( esp_loader_read_register(efuse_word_addr(efuse_base, 19), &reg2) );
+    esp_loader_reg_op_t words[] = {
+        { .address = efuse_word_addr(efuse_base, 18) },
+        { .address = efuse_word_addr(efuse_base, 19) },
+    };
+    RETURN_ON_ERROR( esp_loader_run_register_batch(words, 2) );
+
+    const uint32_t reg1 = words[0].value;
+    const uint32_t reg2 = words[1].value;
 
     uint32_t pins = ((reg1 >> 16) | ((reg2 & 0xfffff) << 16)) & 0x3fffffff;
 
@@ -326,7 +377,9 @@ static esp_loader_error_t spi_config_esp32xx(uint32_t efuse_base, uint32_t *spi_
     *spi_config = pins;
     return ESP_LOADER_SUCCESS;
 }
+#endif /* SPI_CONFIG_ESP32XX */
 
+#if SPI_CONFIG_UNSUPPORTED
 // Some newer chips like the esp32c6 do not support configurable SPI
 static esp_loader_error_t spi_config_unsupported(uint32_t efuse_base, uint32_t *spi_config)
 {
@@ -335,6 +388,7 @@ static esp_loader_error_t spi_config_unsupported(uint32_t efuse_base, uint32_t *
     *spi_config = 0;
     return ESP_LOADER_SUCCESS;
 }
+#endif /* SPI_CONFIG_UNSUPPORTED */
 
 bool encryption_in_begin_flash_cmd(const target_chip_t target)
 {
@@ -344,7 +398,7 @@ bool encryption_in_begin_flash_cmd(const target_chip_t target)
 target_chip_t target_from_chip_id(const uint32_t chip_id)
 {
     for (size_t chip = 0; chip < ESP_MAX_CHIP; chip++) {
-        if (chip_id == esp_target[chip].chip_id) {
+        if (target_in_build((target_chip_t)chip) && chip_id == esp_target[chip].chip_id) {
             return (target_chip_t)chip;
         }
     }
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !SERIAL_FLASHER_MD5_ROM
 
 static void MD5Transform(uint32_t buf[4], uint32_t const in[16]);
 
@@ -103,6 +104,15 @@ void MD5Update(struct MD5Context *ctx, unsigned char const *buf, unsigned len)
     /* Process data in 64-byte chunks */
 
     while (len >= 64) {
+#ifndef WORDS_BIGENDIAN
+        /* Aligned input needs no conversion on little-endian hosts, transform it in place */
+        if (((uintptr_t)buf & 3) == 0) {
+            MD5Transform((uint32_t *)ctx->buf, (uint32_t const *) buf);
+            buf += 64;
+            len -= 64;
+            continue;
+        }
+#endif
         memcpy(ctx->in, buf, 64);
         byteReverse(ctx->in, 16);
         MD5Transform((uint32_t *)ctx->buf, (uint32_t *) ctx->in);
@@ -260,3 +270,5 @@ static void MD5Transform(uint32_t buf[4], uint32_t const in[16])
     buf[3] += d;
 }
 /* ===== end - public domain MD5 implementation ===== */
+
+#endif /* !SERIAL_FLASHER_MD5_ROM */
@@ -22,9 +22,12 @@
 
 #define CMD_SIZE(cmd) ( sizeof(cmd) - sizeof(command_common_t) )
 
+// Commands per register batch, send_cmd_batch decides how many of them are in flight
+#define REG_BATCH_MAX_OPS 12
+
 static uint32_t s_sequence_number = 0;
 
-static uint8_t compute_checksum(const uint8_t *data, uint32_t size)
+uint8_t compute_checksum(const uint8_t *data, uint32_t size)
 {
     uint8_t checksum = 0xEF;
 
@@ -129,6 +132,28 @@ esp_loader_error_t loader_flash_end_cmd(bool stay_in_loader)
 }
 
 
+esp_loader_error_t loader_erase_region_cmd(uint32_t offset, uint32_t size)
+{
+    const erase_region_command_t erase_cmd = {
+        .common = {
+            .direction = WRITE_DIRECTION,
+            .command = ERASE_REGION,
+            .size = CMD_SIZE(erase_cmd),
+            .checksum = 0
+        },
+        .offset = offset,
+        .size = size,
+    };
+
+    const send_cmd_config cmd_config = {
+        .cmd = &erase_cmd,
+        .cmd_size = sizeof(erase_cmd)
+    };
+
+    return send_cmd(&cmd_config);
+}
+
+
 esp_loader_error_t loader_flash_read_rom_cmd(const uint32_t address, uint8_t *data)
 {
     const flash_read_rom_cmd flash_read_cmd = {
@@ -330,6 +355,44 @@ esp_loader_error_t loader_mem_data_cmd(const uint8_t *data, uint32_t size)
 }
 
 
+esp_loader_error_t loader_mem_data_batch_cmd(const uint8_t *data, uint32_t size, uint32_t block_size)
+{
+    data_command_t data_cmds[MEM_DATA_BATCH_BLOCKS];
+    send_cmd_config configs[MEM_DATA_BATCH_BLOCKS];
+    uint32_t block_count = 0;
+
+    while (size > 0) {
+        if (block_count == MEM_DATA_BATCH_BLOCKS) {
+            return ESP_LOADER_ERROR_INVALID_PARAM;
+        }
+
+        const uint32_t data_size = MIN(block_size, size);
+        data_cmds[block_count] = (data_command_t) {
+            .common = {
+                .direction = WRITE_DIRECTION,
+                .command = MEM_DATA,
+                .size = CMD_SIZE(data_command_t) + data_size,
+                .checksum = compute_checksum(data, data_size)
+            },
+            .data_size = data_size,
+            .sequence_number = s_sequence_number++,
+        };
+        configs[block_count] = (send_cmd_config) {
+            .cmd = &data_cmds[block_count],
+            .cmd_size = sizeof(data_command_t),
+            .data = data,
+            .data_size = data_size,
+        };
+
+        block_count++;
+        data += data_size;
+        size -= data_size;
+    }
+
+    return send_cmd_batch(configs, block_count);
+}
+
+
 esp_loader_error_t loader_mem_end_cmd(uint32_t entrypoint)
 {
     mem_end_command_t end_cmd = {
@@ -398,6 +461,65 @@ esp_loader_error_t loader_read_reg_cmd(uint32_t address, uint32_t *reg)
 }
 
 
+esp_loader_error_t loader_reg_batch_cmd(esp_loader_reg_op_t *ops, uint32_t count)
+{
+    while (count > 0) {
+        union {
+            read_reg_command_t read;
+            write_reg_command_t write;
+        } cmds[REG_BATCH_MAX_OPS];
+        send_cmd_config configs[REG_BATCH_MAX_OPS];
+        size_t batch_count = 0;
+
+        while (batch_count < count && batch_count < REG_BATCH_MAX_OPS) {
+            esp_loader_reg_op_t *op = &ops[batch_count];
+
+            if (op->write) {
+                cmds[batch_count].write = (write_reg_command_t) {
+                    .common = {
+                        .direction = WRITE_DIRECTION,
+                        .command = WRITE_REG,
+                        .size = CMD_SIZE(write_reg_command_t),
+                        .checksum = 0
+                    },
+                    .address = op->address,
+                    .value = op->value,
+                    .mask = 0xFFFFFFFF,
+                    .delay_us = 0
+                };
+                configs[batch_count] = (send_cmd_config) {
+                    .cmd = &cmds[batch_count].write,
+                    .cmd_size = sizeof(write_reg_command_t),
+                };
+            } else {
+                cmds[batch_count].read = (read_reg_command_t) {
+                    .common = {
+                        .direction = WRITE_DIRECTION,
+                        .command = READ_REG,
+                        .size = CMD_SIZE(read_reg_command_t),
+                        .checksum = 0
+                    },
+                    .address = op->address,
+                };
+                configs[batch_count] = (send_cmd_config) {
+                    .cmd = &cmds[batch_count].read,
+                    .cmd_size = sizeof(read_reg_command_t),
+                    .reg_value = &op->value,
+                };
+            }
+            batch_count++;
+        }
+
+        RETURN_ON_ERROR(send_cmd_batch(configs, batch_count));
+
+        ops += batch_count;
+        count -= batch_count;
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
 esp_loader_error_t loader_change_baudrate_cmd(uint32_t new_baudrate, uint32_t old_baudrate)
 {
     change_baudrate_command_t baudrate_cmd = {
@@ -15,8 +15,10 @@
 
 #include "protocol.h"
 #include "protocol_prv.h"
+#include "esp_stubs.h"
 #include "esp_loader_io.h"
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 typedef struct __attribute__((packed))
@@ -67,19 +69,48 @@ typedef enum {
     SLAVE_CMD_DONE = 0x55,
 } slave_cmd_t;
 
-static uint8_t s_slave_seq_tx;
-static uint8_t s_slave_seq_rx;
+/* State of one of the slave buffers, as seen in its status register */
+typedef struct {
+    uint8_t seq;        /* Last seen value of the toggle bit */
+    bool ready;         /* The buffer was made available and has not been used yet */
+    uint32_t buf_size;
+} slave_buffer_t;
+
+static slave_buffer_t s_slave_rx;
+static slave_buffer_t s_slave_tx;
+static bool s_qpi;
 
 static esp_loader_error_t write_slave_reg(const uint8_t *data, const uint32_t addr,
         const uint8_t size);
 static esp_loader_error_t read_slave_reg(uint8_t *out_data, const uint32_t addr,
         const uint8_t size);
-static esp_loader_error_t handle_slave_state(const uint32_t status_reg_addr, uint8_t *seq_state,
-        bool *slave_ready, uint32_t *buf_size);
-static esp_loader_error_t check_response(command_t cmd, uint32_t *reg_value);
+static esp_loader_error_t wait_for_slave(slave_buffer_t *buffer);
+static esp_loader_error_t check_response(const send_cmd_config *config);
+
+static esp_loader_error_t transaction(const transaction_cmd_t cmd, const uint8_t addr,
+                                      const loader_spi_segment_t *tx, const uint32_t tx_count,
+                                      uint8_t *rx, const uint32_t rx_size)
+{
+    const loader_spi_transaction_t trans = {
+        .cmd = cmd,
+        .addr = addr,
+        .qpi = s_qpi,
+        .tx = tx,
+        .tx_count = tx_count,
+        .rx = rx,
+        .rx_size = rx_size,
+    };
+
+    return loader_port_spi_transaction(&trans, loader_port_remaining_time());
+}
 
 esp_loader_error_t loader_initialize_conn(esp_loader_connect_args_t *connect_args)
 {
+    /* The target has just been reset, so it talks on a single line and all buffers are fresh */
+    s_qpi = false;
+    memset(&s_slave_rx, 0, sizeof(s_slave_rx));
+    memset(&s_slave_tx, 0, sizeof(s_slave_tx));
+
     for (uint8_t trial = 0; trial < connect_args->trials; trial++) {
         /* The alignment requirement comes from the esp port DMA requirements */
         uint8_t slave_ready_flag __attribute__((aligned(4)));
@@ -110,97 +141,117 @@ esp_loader_error_t loader_initialize_conn(esp_loader_connect_args_t *connect_arg
         }
     }
 
+#if SERIAL_FLASHER_SPI_QPI
+    if (loader_port_spi_qpi_supported()) {
+        RETURN_ON_ERROR(transaction(TRANS_CMD_ENQPI, 0, NULL, 0, NULL, 0));
+        s_qpi = true;
+    }
+#endif
+
     return ESP_LOADER_SUCCESS;
 }
 
 
-esp_loader_error_t send_cmd(const send_cmd_config *config)
+static esp_loader_error_t wait_for_slave_cmd(const slave_cmd_t cmd, const int32_t trials)
 {
-    // Commands with response data are not supported by the ROM for the SPI interface
-    if (config->resp_data != NULL) {
-        return ESP_LOADER_ERROR_INVALID_PARAM;
-    }
+    for (int32_t trial = 0; trial < trials; trial++) {
+        uint8_t slave_cmd __attribute__((aligned(4)));
+        RETURN_ON_ERROR(read_slave_reg(&slave_cmd, SLAVE_REGISTER_CMD, sizeof(slave_cmd)));
 
-    uint32_t target_buf_size;
-    bool slave_ready = false;
-    while (!slave_ready) {
-        RETURN_ON_ERROR(handle_slave_state(SLAVE_REGISTER_RXSTA, &s_slave_seq_rx, &slave_ready,
-                                           &target_buf_size));
-    }
+        if (slave_cmd == cmd) {
+            return ESP_LOADER_SUCCESS;
+        }
 
-    if (config->cmd_size + config->data_size > target_buf_size) {
-        return ESP_LOADER_ERROR_INVALID_PARAM;
+        loader_port_delay_ms(100);
     }
 
-    /* Start and write the command */
-    transaction_preamble_t preamble = {.cmd = TRANS_CMD_WRDMA};
+    return ESP_LOADER_ERROR_TIMEOUT;
+}
 
-    loader_port_spi_set_cs(0);
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)&preamble, sizeof(preamble),
-                                      loader_port_remaining_time()));
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)config->cmd, config->cmd_size,
-                                      loader_port_remaining_time()));
-    if (config->data != NULL && config->data_size != 0) {
-        RETURN_ON_ERROR(loader_port_write((const uint8_t *)config->data, config->data_size,
-                                          loader_port_remaining_time()));
+
+esp_loader_error_t loader_run_flash_helper(const esp_loader_flash_helper_t *helper,
+        esp_loader_connect_args_t *connect_args)
+{
+    for (uint32_t seg = 0; seg < helper->segment_count; seg++) {
+        const esp_loader_bin_segment_t *segment = &helper->segments[seg];
+        RETURN_ON_ERROR(esp_loader_mem_start(segment->addr, segment->size, ESP_RAM_BLOCK));
+
+        uint32_t remain_size = segment->size;
+        const uint8_t *data_pos = segment->data;
+        while (remain_size > 0) {
+            const uint32_t data_size = MIN(ESP_RAM_BLOCK, remain_size);
+            RETURN_ON_ERROR(esp_loader_mem_write(data_pos, data_size));
+            data_pos += data_size;
+            remain_size -= data_size;
+        }
     }
 
-    loader_port_spi_set_cs(1);
+    RETURN_ON_ERROR(esp_loader_mem_finish(helper->entrypoint));
 
-    /* Terminate the write */
-    loader_port_spi_set_cs(0);
-    preamble.cmd = TRANS_CMD_WR_DONE;
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)&preamble, sizeof(preamble),
-                                      loader_port_remaining_time()));
-    loader_port_spi_set_cs(1);
+    /* The helper reinitializes the slave peripheral and reports it is idle, the command
+       register still holds the READY value written for the ROM until then */
+    RETURN_ON_ERROR(wait_for_slave_cmd(SLAVE_CMD_IDLE, connect_args->trials));
+    RETURN_ON_ERROR(loader_initialize_conn(connect_args));
 
-    command_t command = ((const command_common_t *)config->cmd)->command;
-    return check_response(command, config->reg_value);
+    esp_stub_set_running(true);
+
+    return ESP_LOADER_SUCCESS;
 }
 
 
-static esp_loader_error_t read_slave_reg(uint8_t *out_data, const uint32_t addr,
-        const uint8_t size)
+esp_loader_error_t send_cmd(const send_cmd_config *config)
 {
-    transaction_preamble_t preamble = {
-        .cmd = TRANS_CMD_RDBUF,
-        .addr = addr,
+    RETURN_ON_ERROR(wait_for_slave(&s_slave_rx));
+
+    if (config->cmd_size + config->data_size > s_slave_rx.buf_size) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
+    }
+
+    /* Write the command and its data in a single transaction */
+    const loader_spi_segment_t segments[] = {
+        { .data = (const uint8_t *)config->cmd, .size = config->cmd_size },
+        { .data = (const uint8_t *)config->data, .size = config->data_size },
     };
+    const uint32_t segment_count = (config->data != NULL && config->data_size != 0) ? 2 : 1;
+    RETURN_ON_ERROR(transaction(TRANS_CMD_WRDMA, 0, segments, segment_count, NULL, 0));
 
-    loader_port_spi_set_cs(0);
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)&preamble, sizeof(preamble),
-                                      loader_port_remaining_time()));
-    RETURN_ON_ERROR(loader_port_read(out_data, size, loader_port_remaining_time()));
-    loader_port_spi_set_cs(1);
+    /* Terminate the write */
+    RETURN_ON_ERROR(transaction(TRANS_CMD_WR_DONE, 0, NULL, 0, NULL, 0));
+
+    return check_response(config);
+}
+
+
+esp_loader_error_t send_cmd_batch(const send_cmd_config *configs, size_t count)
+{
+    // The slave buffer holds a single command, so there is nothing to overlap
+    for (size_t i = 0; i < count; i++) {
+        RETURN_ON_ERROR(send_cmd(&configs[i]));
+    }
 
     return ESP_LOADER_SUCCESS;
 }
 
 
-static esp_loader_error_t write_slave_reg(const uint8_t *data, const uint32_t addr,
+static esp_loader_error_t read_slave_reg(uint8_t *out_data, const uint32_t addr,
         const uint8_t size)
 {
-    transaction_preamble_t preamble = {
-        .cmd = TRANS_CMD_WRBUF,
-        .addr = addr,
-    };
+    return transaction(TRANS_CMD_RDBUF, addr, NULL, 0, out_data, size);
+}
 
-    loader_port_spi_set_cs(0);
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)&preamble, sizeof(preamble),
-                                      loader_port_remaining_time()));
-    RETURN_ON_ERROR(loader_port_write(data, size, loader_port_remaining_time()));
-    loader_port_spi_set_cs(1);
 
-    return ESP_LOADER_SUCCESS;
+static esp_loader_error_t write_slave_reg(const uint8_t *data, const uint32_t addr,
+        const uint8_t size)
+{
+    const loader_spi_segment_t segment = { .data = data, .size = size };
+
+    return transaction(TRANS_CMD_WRBUF, addr, &segment, 1, NULL, 0);
 }
 
 
-static esp_loader_error_t handle_slave_state(const uint32_t status_reg_addr, uint8_t *seq_state,
-        bool *slave_ready, uint32_t *buf_size)
+static esp_loader_error_t handle_slave_state(const uint32_t status_reg,
+        const uint32_t status_reg_addr, slave_buffer_t *buffer)
 {
-    uint32_t status_reg;
-    RETURN_ON_ERROR(read_slave_reg((uint8_t *)&status_reg, status_reg_addr,
-                                   sizeof(status_reg)));
     const slave_state_t state = status_reg & (SLAVE_STA_TOGGLE_BIT | SLAVE_STA_INIT_BIT);
 
     switch (state) {
@@ -211,18 +262,18 @@ static esp_loader_error_t handle_slave_state(const uint32_t status_reg_addr, uin
     }
 
     case SLAVE_STATE_FIRST_PACKET: {
-        *seq_state = state & SLAVE_STA_TOGGLE_BIT;
-        *buf_size = status_reg >> SLAVE_STA_BUF_LENGTH_POS;
-        *slave_ready = true;
+        buffer->seq = state & SLAVE_STA_TOGGLE_BIT;
+        buffer->buf_size = status_reg >> SLAVE_STA_BUF_LENGTH_POS;
+        buffer->ready = true;
         break;
     }
 
     default: {
         const uint8_t new_seq = state & SLAVE_STA_TOGGLE_BIT;
-        if (new_seq != *seq_state) {
-            *seq_state = new_seq;
-            *buf_size = status_reg >> SLAVE_STA_BUF_LENGTH_POS;
-            *slave_ready = true;
+        if (new_seq != buffer->seq) {
+            buffer->seq = new_seq;
+            buffer->buf_size = status_reg >> SLAVE_STA_BUF_LENGTH_POS;
+            buffer->ready = true;
         }
         break;
     }
@@ -232,54 +283,127 @@ static esp_loader_error_t handle_slave_state(const uint32_t status_reg_addr, uin
 }
 
 
-static esp_loader_error_t check_response(const command_t cmd, uint32_t *reg_value)
+/* Both status registers are adjacent, so they are always polled together. The receive buffer
+   is usually rearmed by the time the response is available, so the next command does not need
+   to poll at all. */
+static esp_loader_error_t wait_for_slave(slave_buffer_t *buffer)
+{
+    while (!buffer->ready) {
+        uint32_t status_regs[2] __attribute__((aligned(4)));
+        RETURN_ON_ERROR(read_slave_reg((uint8_t *)status_regs, SLAVE_REGISTER_RXSTA,
+                                       sizeof(status_regs)));
+        RETURN_ON_ERROR(handle_slave_state(status_regs[0], SLAVE_REGISTER_RXSTA, &s_slave_rx));
+        RETURN_ON_ERROR(handle_slave_state(status_regs[1], SLAVE_REGISTER_TXSTA, &s_slave_tx));
+
+        if (!buffer->ready && loader_port_remaining_time() == 0) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+    }
+
+    buffer->ready = false;
+
+    return ESP_LOADER_SUCCESS;
+}
+
+
+/* The ROM only sends responses without data. Responses of the flash helper may carry data,
+   whose length is taken from the size field, as the status follows right after it. */
+static esp_loader_error_t check_response(const send_cmd_config *config)
 {
-    uint8_t buf[sizeof(common_response_t) + sizeof(response_status_t)] __attribute__((aligned(4)));
+    uint8_t buf[sizeof(common_response_t) + MAX_RESP_DATA_SIZE + sizeof(response_status_t)]
+    __attribute__((aligned(4)));
+
+    RETURN_ON_ERROR(wait_for_slave(&s_slave_tx));
 
-    uint32_t target_buf_size;
-    bool slave_ready = false;
-    while (!slave_ready) {
-        RETURN_ON_ERROR(handle_slave_state(SLAVE_REGISTER_TXSTA, &s_slave_seq_tx, &slave_ready,
-                                           &target_buf_size));
+    uint32_t read_size = sizeof(common_response_t) + config->resp_data_size + sizeof(response_status_t);
+    if (config->resp_data_recv_size != NULL) {
+        read_size = MIN(read_size, s_slave_tx.buf_size);
     }
 
-    if (sizeof(buf) > target_buf_size) {
+    if (read_size > sizeof(buf) || read_size > s_slave_tx.buf_size ||
+            read_size < sizeof(common_response_t) + sizeof(response_status_t)) {
         return ESP_LOADER_ERROR_INVALID_RESPONSE;
     }
 
-    transaction_preamble_t preamble = {
-        .cmd = TRANS_CMD_RDDMA,
-    };
-
-    loader_port_spi_set_cs(0);
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)&preamble, sizeof(preamble),
-                                      loader_port_remaining_time()));
-    RETURN_ON_ERROR(loader_port_read(buf, sizeof(buf),
-                                     loader_port_remaining_time()));
-
-    loader_port_spi_set_cs(1);
+    RETURN_ON_ERROR(transaction(TRANS_CMD_RDDMA, 0, NULL, 0, buf, read_size));
 
     /* Terminate the read */
-    loader_port_spi_set_cs(0);
-    preamble.cmd = TRANS_CMD_CMD8;
-    RETURN_ON_ERROR(loader_port_write((const uint8_t *)&preamble, sizeof(preamble),
-                                      loader_port_remaining_time()));
-    loader_port_spi_set_cs(1);
+    RETURN_ON_ERROR(transaction(TRANS_CMD_CMD8, 0, NULL, 0, NULL, 0));
 
-    common_response_t *common = (common_response_t *)&buf[0];
-    if ((common->direction != READ_DIRECTION) || (common->command != cmd)) {
+    const common_response_t *common = (const common_response_t *)&buf[0];
+    const command_t command = ((const command_common_t *)config->cmd)->command;
+    if ((common->direction != READ_DIRECTION) || (common->command != command)) {
         return ESP_LOADER_ERROR_INVALID_RESPONSE;
     }
 
-    response_status_t *status = (response_status_t *)&buf[sizeof(buf) - sizeof(response_status_t)];
+    uint32_t resp_data_size = 0;
+    if (config->resp_data != NULL) {
+        if (common->size < sizeof(response_status_t) ||
+                sizeof(common_response_t) + common->size > read_size) {
+            return ESP_LOADER_ERROR_INVALID_RESPONSE;
+        }
+        resp_data_size = common->size - sizeof(response_status_t);
+
+        // If the command has fixed response data size, require all of it to be received
+        if (config->resp_data_recv_size == NULL && resp_data_size != config->resp_data_size) {
+            return ESP_LOADER_ERROR_INVALID_RESPONSE;
+        }
+    }
+
+    const response_status_t *status =
+        (const response_status_t *)&buf[sizeof(common_response_t) + resp_data_size];
     if (status->failed) {
         log_loader_internal_error(status->error);
         return ESP_LOADER_ERROR_INVALID_RESPONSE;
     }
 
-    if (reg_value != NULL) {
-        *reg_value = common->value;
+    if (config->reg_value != NULL) {
+        *config->reg_value = common->value;
+    }
+
+    if (config->resp_data != NULL) {
+        memcpy(config->resp_data, &buf[sizeof(common_response_t)], resp_data_size);
+
+        if (config->resp_data_recv_size != NULL) {
+            *config->resp_data_recv_size = resp_data_size;
+        }
     }
 
     return ESP_LOADER_SUCCESS;
 }
+
+
+/* Fallback for ports without a transaction implementation, every part is a separate transfer */
+__attribute__ ((weak)) esp_loader_error_t loader_port_spi_transaction(
+    const loader_spi_transaction_t *transaction, const uint32_t timeout)
+{
+    if (transaction->qpi) {
+        return ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+    }
+
+    const transaction_preamble_t preamble = {
+        .cmd = transaction->cmd,
+        .addr = transaction->addr,
+    };
+
+    esp_loader_error_t err;
+    loader_port_spi_set_cs(0);
+    err = loader_port_write((const uint8_t *)&preamble, sizeof(preamble), timeout);
+
+    for (uint32_t i = 0; i < transaction->tx_count && err == ESP_LOADER_SUCCESS; i++) {
+        err = loader_port_write(transaction->tx[i].data, transaction->tx[i].size, timeout);
+    }
+
+    if (transaction->rx_size != 0 && err == ESP_LOADER_SUCCESS) {
+        err = loader_port_read(transaction->rx, transaction->rx_size, timeout);
+    }
+    loader_port_spi_set_cs(1);
+
+    return err;
+}
+
+
+__attribute__ ((weak)) bool loader_port_spi_qpi_supported(void)
+{
+    return false;
+}
@@ -19,6 +19,7 @@
 #include "esp_stubs.h"
 #include "slip.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 static esp_loader_error_t check_response(const send_cmd_config *config);
@@ -44,6 +45,27 @@ esp_loader_error_t loader_initialize_conn(esp_loader_connect_args_t *connect_arg
     return err;
 }
 
+/* Enough for MEM_DATA_BATCH_BLOCKS blocks of ESP_RAM_BLOCK bytes at 115200 baud */
+#define MEM_DATA_BATCH_TIMEOUT 5000
+
+static esp_loader_error_t upload_segment(const esp_loader_bin_segment_t *segment)
+{
+    RETURN_ON_ERROR(esp_loader_mem_start(segment->addr, segment->size, ESP_RAM_BLOCK));
+
+    // The start of each block is sent while the ROM is still answering the previous one
+    size_t remain_size = segment->size;
+    const uint8_t *data_pos = segment->data;
+    while (remain_size > 0) {
+        const size_t batch_size = MIN(ESP_RAM_BLOCK * MEM_DATA_BATCH_BLOCKS, remain_size);
+        loader_port_start_timer(MEM_DATA_BATCH_TIMEOUT);
+        RETURN_ON_ERROR(loader_mem_data_batch_cmd(data_pos, batch_size, ESP_RAM_BLOCK));
+        data_pos += batch_size;
+        remain_size -= batch_size;
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
 esp_loader_error_t loader_run_stub(target_chip_t target)
 {
     esp_loader_error_t err;
@@ -51,22 +73,17 @@ esp_loader_error_t loader_run_stub(target_chip_t target)
 
     // Download segments
     for (uint32_t seg = 0; seg < sizeof(stub->segments) / sizeof(stub->segments[0]); seg++) {
-        err = esp_loader_mem_start(stub->segments[seg].addr, stub->segments[seg].size, ESP_RAM_BLOCK);
+        /* The ROM appends every accepted block, so after a rejected one the segment is
+           restarted from MEM_BEGIN rather than the block resent */
+        unsigned int attempt = 0;
+        do {
+            err = upload_segment(&stub->segments[seg]);
+            attempt++;
+        } while (err == ESP_LOADER_ERROR_INVALID_RESPONSE && attempt < SERIAL_FLASHER_WRITE_BLOCK_RETRIES);
+
         if (err != ESP_LOADER_SUCCESS) {
             return err;
         }
-
-        size_t remain_size = stub->segments[seg].size;
-        uint8_t *data_pos = stub->segments[seg].data;
-        while (remain_size > 0) {
-            size_t data_size = MIN(ESP_RAM_BLOCK, remain_size);
-            err = esp_loader_mem_write(data_pos, data_size);
-            if (err != ESP_LOADER_SUCCESS) {
-                return err;
-            }
-            data_pos += data_size;
-            remain_size -= data_size;
-        }
     }
 
     err = esp_loader_mem_finish(stub->header.entrypoint);
@@ -89,7 +106,7 @@ esp_loader_error_t loader_run_stub(target_chip_t target)
     return ESP_LOADER_SUCCESS;
 }
 
-esp_loader_error_t send_cmd(const send_cmd_config *config)
+static esp_loader_error_t send_frame(const send_cmd_config *config)
 {
     RETURN_ON_ERROR(SLIP_send_delimiter());
 
@@ -99,7 +116,12 @@ esp_loader_error_t send_cmd(const send_cmd_config *config)
         RETURN_ON_ERROR(SLIP_send((const uint8_t *)config->data, config->data_size));
     }
 
-    RETURN_ON_ERROR(SLIP_send_delimiter());
+    return SLIP_send_delimiter();
+}
+
+esp_loader_error_t send_cmd(const send_cmd_config *config)
+{
+    RETURN_ON_ERROR(send_frame(config));
 
     command_t command = ((const command_common_t *)config->cmd)->command;
     const uint8_t response_cnt = command == SYNC ? 8 : 1;
@@ -111,6 +133,97 @@ esp_loader_error_t send_cmd(const send_cmd_config *config)
     return ESP_LOADER_SUCCESS;
 }
 
+/* The ROM reads a command only after answering the previous one, meanwhile the bytes that
+   follow wait in its 128 byte UART receive FIFO and whatever does not fit is lost. A batch
+   therefore never sends more than that beyond the end of the oldest command not yet answered. */
+#define ROM_RX_FIFO_SIZE 128
+
+static size_t frame_data_size(const send_cmd_config *config)
+{
+    return config->data != NULL ? config->data_size : 0;
+}
+
+static size_t frame_encoded_size(const send_cmd_config *config)
+{
+    return SLIP_encoded_size((const uint8_t *)config->cmd, config->cmd_size) +
+           SLIP_encoded_size((const uint8_t *)config->data, frame_data_size(config)) + 2;
+}
+
+/* Continues sending a frame from *pos, which counts the delimiters as one byte each, until it
+   is complete or *budget bytes have been written */
+static esp_loader_error_t send_frame_part(const send_cmd_config *config, size_t *pos, size_t *budget)
+{
+    const uint8_t *parts[] = { (const uint8_t *)config->cmd, (const uint8_t *)config->data };
+    const size_t part_sizes[] = { config->cmd_size, frame_data_size(config) };
+
+    if (*pos == 0 && *budget > 0) {
+        RETURN_ON_ERROR(SLIP_send_delimiter());
+        (*pos)++;
+        (*budget)--;
+    }
+
+    size_t start = 1;
+    for (size_t i = 0; i < 2; i++) {
+        const size_t end = start + part_sizes[i];
+        if (*pos >= start && *pos < end) {
+            size_t consumed, encoded;
+            RETURN_ON_ERROR(SLIP_send_limited(&parts[i][*pos - start], end - *pos, *budget,
+                                              &consumed, &encoded));
+            *pos += consumed;
+            *budget -= encoded;
+        }
+        start = end;
+    }
+
+    if (*pos == start && *budget > 0) {
+        RETURN_ON_ERROR(SLIP_send_delimiter());
+        (*pos)++;
+        (*budget)--;
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t send_cmd_batch(const send_cmd_config *configs, size_t count)
+{
+    size_t next = 0;        // Frame being sent
+    size_t next_pos = 0;    // Position within it
+    size_t sent = 0;        // Bytes written for the whole batch
+    size_t oldest_end = count > 0 ? frame_encoded_size(&configs[0]) : 0;
+
+    /* A failed command still gets its response, the rest are drained so that they are not
+       mistaken for responses of the following commands */
+    esp_loader_error_t result = ESP_LOADER_SUCCESS;
+    for (size_t answered = 0; answered < count; answered++) {
+        while (next < count) {
+            const size_t limit = oldest_end + ROM_RX_FIFO_SIZE;
+            size_t budget = (next == answered) ? SIZE_MAX : (sent < limit ? limit - sent : 0);
+            const size_t budget_before = budget;
+
+            RETURN_ON_ERROR(send_frame_part(&configs[next], &next_pos, &budget));
+            sent += budget_before - budget;
+            if (next_pos < configs[next].cmd_size + frame_data_size(&configs[next]) + 2) {
+                break;
+            }
+            next++;
+            next_pos = 0;
+        }
+
+        const esp_loader_error_t err = check_response(&configs[answered]);
+        if (err == ESP_LOADER_ERROR_INVALID_RESPONSE) {
+            result = (result == ESP_LOADER_SUCCESS) ? err : result;
+        } else if (err != ESP_LOADER_SUCCESS) {
+            return err;
+        }
+
+        if (answered + 1 < count) {
+            oldest_end += frame_encoded_size(&configs[answered + 1]);
+        }
+    }
+
+    return result;
+}
+
 static esp_loader_error_t check_response(const send_cmd_config *config)
 {
     uint8_t buf[sizeof(common_response_t) + sizeof(response_status_t) + MAX_RESP_DATA_SIZE];
@@ -0,0 +1,160 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sha256_hash.h"
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+
+void sha256_init(sha256_context_t *context)
+{
+    mbedtls_sha256_init(context);
+    mbedtls_sha256_starts(context, 0);
+}
+
+void sha256_update(sha256_context_t *context, const uint8_t *data, size_t size)
+{
+    mbedtls_sha256_update(context, data, size);
+}
+
+void sha256_final(sha256_context_t *context, uint8_t digest[32])
+{
+    mbedtls_sha256_finish(context, digest);
+    mbedtls_sha256_free(context);
+}
+
+#else
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_transform(uint32_t state[8], const uint8_t block[64])
+{
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+
+    for (int i = 16; i < 64; i++) {
+        const uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        const uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        const uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void sha256_init(sha256_context_t *context)
+{
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(context->state, initial_state, sizeof(initial_state));
+    context->bits = 0;
+    context->block_len = 0;
+}
+
+void sha256_update(sha256_context_t *context, const uint8_t *data, size_t size)
+{
+    context->bits += (uint64_t)size * 8;
+
+    if (context->block_len > 0) {
+        const size_t to_copy = size < 64 - context->block_len ? size : 64 - context->block_len;
+        memcpy(&context->block[context->block_len], data, to_copy);
+        context->block_len += to_copy;
+        data += to_copy;
+        size -= to_copy;
+
+        if (context->block_len < 64) {
+            return;
+        }
+        sha256_transform(context->state, context->block);
+        context->block_len = 0;
+    }
+
+    while (size >= 64) {
+        sha256_transform(context->state, data);
+        data += 64;
+        size -= 64;
+    }
+
+    memcpy(context->block, data, size);
+    context->block_len = size;
+}
+
+void sha256_final(sha256_context_t *context, uint8_t digest[32])
+{
+    const uint64_t bits = context->bits;
+
+    context->block[context->block_len++] = 0x80;
+    if (context->block_len > 56) {
+        memset(&context->block[context->block_len], 0, 64 - context->block_len);
+        sha256_transform(context->state, context->block);
+        context->block_len = 0;
+    }
+    memset(&context->block[context->block_len], 0, 56 - context->block_len);
+
+    for (int i = 0; i < 8; i++) {
+        context->block[56 + i] = bits >> (56 - i * 8);
+    }
+    sha256_transform(context->state, context->block);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = context->state[i] >> 24;
+        digest[i * 4 + 1] = context->state[i] >> 16;
+        digest[i * 4 + 2] = context->state[i] >> 8;
+        digest[i * 4 + 3] = context->state[i];
+    }
+
+    memset(context, 0, sizeof(*context));
+}
+
+#endif /* ESP_PLATFORM */
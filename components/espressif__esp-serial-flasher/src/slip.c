@@ -20,39 +20,82 @@ static const uint8_t DELIMITER = 0xC0;
 static const uint8_t C0_REPLACEMENT[2] = {0xDB, 0xDC};
 static const uint8_t DB_REPLACEMENT[2] = {0xDB, 0xDD};
 
-static inline esp_loader_error_t peripheral_read(uint8_t *buff, const size_t size)
+static inline esp_loader_error_t peripheral_write(const uint8_t *buff, const size_t size)
 {
-    return loader_port_read(buff, size, loader_port_remaining_time());
+    return loader_port_write(buff, size, loader_port_remaining_time());
 }
 
-static inline esp_loader_error_t peripheral_write(const uint8_t *buff, const size_t size)
+
+static uint8_t s_peeked;
+static bool s_peeked_valid;
+
+__attribute__ ((weak)) esp_loader_error_t loader_port_peek(const uint8_t **data, size_t *size,
+        const uint32_t timeout)
 {
-    return loader_port_write(buff, size, loader_port_remaining_time());
+    if (!s_peeked_valid) {
+        RETURN_ON_ERROR( loader_port_read(&s_peeked, 1, timeout) );
+        s_peeked_valid = true;
+    }
+
+    *data = &s_peeked;
+    *size = 1;
+    return ESP_LOADER_SUCCESS;
 }
 
+__attribute__ ((weak)) void loader_port_consume(const size_t size)
+{
+    if (size > 0) {
+        s_peeked_valid = false;
+    }
+}
 
-esp_loader_error_t SLIP_receive_packet(uint8_t *buff, const size_t max_size, size_t *recv_size)
+
+// Received data is decoded in place, as far as the port hands it out
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} slip_reader_t;
+
+static esp_loader_error_t reader_next(slip_reader_t *reader, uint8_t *ch)
+{
+    if (reader->pos == reader->size) {
+        if (reader->size > 0) {
+            loader_port_consume(reader->size);
+            reader->size = 0;
+            reader->pos = 0;
+        }
+        RETURN_ON_ERROR( loader_port_peek(&reader->data, &reader->size, loader_port_remaining_time()) );
+    }
+
+    *ch = reader->data[reader->pos++];
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t receive_packet(slip_reader_t *reader, uint8_t *buff, const size_t max_size,
+        size_t *recv_size)
 {
     uint8_t ch;
 
     // Wait for delimiter
     do {
-        RETURN_ON_ERROR( peripheral_read(&ch, 1) );
+        RETURN_ON_ERROR( reader_next(reader, &ch) );
     } while (ch != DELIMITER);
 
     // Workaround: bootloader sends two dummy(0xC0) bytes after response when baud rate is changed.
     do {
-        RETURN_ON_ERROR( peripheral_read(&ch, 1) );
+        RETURN_ON_ERROR( reader_next(reader, &ch) );
     } while (ch == DELIMITER);
 
-    buff[0] = ch;
-
     // Receive either until either delimiter or maximum receive size
-    for (size_t i = 1; i < max_size; i++) {
-        RETURN_ON_ERROR( peripheral_read(&ch, 1) );
+    for (size_t i = 0; i < max_size; i++) {
+        // The first byte has already been read while skipping the delimiters
+        if (i > 0) {
+            RETURN_ON_ERROR( reader_next(reader, &ch) );
+        }
 
         if (ch == 0xDB) {
-            RETURN_ON_ERROR( peripheral_read(&ch, 1) );
+            RETURN_ON_ERROR( reader_next(reader, &ch) );
             if (ch == 0xDC) {
                 buff[i] = 0xC0;
             } else if (ch == 0xDD) {
@@ -71,7 +114,7 @@ esp_loader_error_t SLIP_receive_packet(uint8_t *buff, const size_t max_size, siz
     // Wait for delimiter if we already reached max receive size
     // This enables us to ignore unsupported or unecessary packet data instead of failing
     do {
-        RETURN_ON_ERROR( peripheral_read(&ch, 1) );
+        RETURN_ON_ERROR( reader_next(reader, &ch) );
     } while (ch != DELIMITER);
 
     *recv_size = max_size;
@@ -80,6 +123,20 @@ esp_loader_error_t SLIP_receive_packet(uint8_t *buff, const size_t max_size, siz
 }
 
 
+esp_loader_error_t SLIP_receive_packet(uint8_t *buff, const size_t max_size, size_t *recv_size)
+{
+    slip_reader_t reader = { 0 };
+    const esp_loader_error_t err = receive_packet(&reader, buff, max_size, recv_size);
+
+    // Data following the packet is left for the next one
+    if (reader.size > 0) {
+        loader_port_consume(reader.pos);
+    }
+
+    return err;
+}
+
+
 esp_loader_error_t SLIP_send(const uint8_t *data, const size_t size)
 {
     uint32_t to_write = 0;  // Bytes ready to write as they are
@@ -121,3 +178,41 @@ esp_loader_error_t SLIP_send_delimiter(void)
 {
     return peripheral_write(&DELIMITER, 1);
 }
+
+
+size_t SLIP_encoded_size(const uint8_t *data, const size_t size)
+{
+    size_t encoded = size;
+
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == 0xC0 || data[i] == 0xDB) {
+            encoded++;
+        }
+    }
+
+    return encoded;
+}
+
+
+esp_loader_error_t SLIP_send_limited(const uint8_t *data, const size_t size, const size_t max_encoded,
+                                     size_t *consumed, size_t *encoded)
+{
+    size_t i = 0;
+    size_t encoded_size = 0;
+
+    for (; i < size; i++) {
+        const size_t byte_size = (data[i] == 0xC0 || data[i] == 0xDB) ? 2 : 1;
+        if (encoded_size + byte_size > max_encoded) {
+            break;
+        }
+        encoded_size += byte_size;
+    }
+
+    if (i > 0) {
+        RETURN_ON_ERROR( SLIP_send(data, i) );
+    }
+
+    *consumed = i;
+    *encoded = encoded_size;
+    return ESP_LOADER_SUCCESS;
+}
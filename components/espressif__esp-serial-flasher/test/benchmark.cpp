@@ -0,0 +1,338 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the loader hot paths. The port below is a null port: writes are
+ * discarded and every command is answered immediately with a canned success response,
+ * so only the time spent inside the library is measured.
+ *
+ * Usage: serial_flasher_bench [--min-time-ms N] [--filter TEXT] [--json FILE]
+ */
+
+#include "esp_loader.h"
+#include "esp_loader_io.h"
+extern "C" {
+#include "protocol_prv.h"
+#include "slip.h"
+#include "md5_hash.h"
+#include "sha256_hash.h"
+}
+
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef struct {
+    string name;
+    uint32_t block_size;
+    uint64_t iterations;
+    double ns_per_block;
+    double mb_per_s;
+} bench_result_t;
+
+static uint64_t s_bytes_written;
+static bool s_in_frame;
+static size_t s_frame_pos;
+static uint8_t s_command;
+// One canned reply per received frame, batched commands send several frames before reading
+static deque<vector<uint8_t>> s_replies;
+static size_t s_reply_pos;
+static vector<uint8_t> s_rx_endless;   // Served over and over while not empty
+static size_t s_rx_endless_pos;
+
+
+esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    s_bytes_written += size;
+
+    if (size == 1 && data[0] == 0xC0) {
+        if (s_in_frame) {
+            // Command is complete, queue the response, SYNC is answered eight times
+            const vector<uint8_t> reply = { 0xC0, READ_DIRECTION, s_command, 0x02, 0x00, 0, 0, 0, 0, 0, 0, 0xC0 };
+            s_replies.insert(s_replies.end(), s_command == SYNC ? 8 : 1, reply);
+        }
+        s_in_frame = !s_in_frame;
+        s_frame_pos = 0;
+        return ESP_LOADER_SUCCESS;
+    }
+
+    if (s_in_frame && s_frame_pos <= 1 && s_frame_pos + size > 1) {
+        s_command = data[1 - s_frame_pos];
+    }
+    s_frame_pos += size;
+
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    for (uint16_t i = 0; i < size; i++) {
+        if (!s_rx_endless.empty()) {
+            data[i] = s_rx_endless[s_rx_endless_pos++];
+            s_rx_endless_pos %= s_rx_endless.size();
+            continue;
+        }
+
+        if (s_replies.empty()) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+
+        data[i] = s_replies.front()[s_reply_pos++];
+        if (s_reply_pos == s_replies.front().size()) {
+            s_replies.pop_front();
+            s_reply_pos = 0;
+        }
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_change_transmission_rate(uint32_t transmission_rate)
+{
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_enter_bootloader(void) { }
+
+void loader_port_reset_target(void) { }
+
+void loader_port_delay_ms(uint32_t ms) { }
+
+void loader_port_start_timer(uint32_t ms) { }
+
+uint32_t loader_port_remaining_time(void)
+{
+    return 1000;
+}
+
+
+static uint32_t s_min_time_ms = 500;
+static string s_filter;
+static vector<bench_result_t> s_results;
+
+/* Runs body repeatedly for at least s_min_time_ms, body processes one block per call */
+static void run(const string &name, uint32_t block_size, const function<void()> &body)
+{
+    if (!s_filter.empty() && name.find(s_filter) == string::npos) {
+        return;
+    }
+
+    // Warm up caches and branch predictors
+    for (int i = 0; i < 16; i++) {
+        body();
+    }
+
+    const auto start = chrono::steady_clock::now();
+    const auto min_time = chrono::milliseconds(s_min_time_ms);
+    auto elapsed = chrono::steady_clock::duration::zero();
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+
+    do {
+        for (uint64_t i = 0; i < batch; i++) {
+            body();
+        }
+        iterations += batch;
+        batch *= 2;
+        elapsed = chrono::steady_clock::now() - start;
+    } while (elapsed < min_time);
+
+    const double ns = chrono::duration<double, nano>(elapsed).count();
+    const bench_result_t result = {
+        name,
+        block_size,
+        iterations,
+        ns / iterations,
+        (double)block_size * iterations / (ns / 1e9) / 1e6,
+    };
+    s_results.push_back(result);
+
+    printf("%-28s %8u B %14.1f ns/block %10.2f MB/s\n",
+           name.c_str(), block_size, result.ns_per_block, result.mb_per_s);
+}
+
+static vector<uint8_t> load_image()
+{
+    ifstream file(TEST_DATA_DIR "/hello-world.bin", ios::binary);
+    vector<uint8_t> image(istreambuf_iterator<char>(file), (istreambuf_iterator<char>()));
+
+    if (image.empty()) {
+        // Fall back to pseudo random data with the occasional SLIP special character
+        image.resize(256 * 1024);
+        uint32_t state = 1;
+        for (uint8_t &byte : image) {
+            state = state * 1103515245 + 12345;
+            byte = state >> 24;
+        }
+    }
+
+    return image;
+}
+
+static vector<uint8_t> slip_encode(const uint8_t *data, size_t size)
+{
+    vector<uint8_t> encoded = { 0xC0 };
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == 0xC0) {
+            encoded.insert(encoded.end(), { 0xDB, 0xDC });
+        } else if (data[i] == 0xDB) {
+            encoded.insert(encoded.end(), { 0xDB, 0xDD });
+        } else {
+            encoded.push_back(data[i]);
+        }
+    }
+    encoded.push_back(0xC0);
+
+    return encoded;
+}
+
+static bool write_json(const string &path)
+{
+    ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < s_results.size(); i++) {
+        const bench_result_t &r = s_results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"block_size\": " << r.block_size
+            << ", \"iterations\": " << r.iterations << ", \"ns_per_block\": " << r.ns_per_block
+            << ", \"mb_per_s\": " << r.mb_per_s << "}" << (i + 1 < s_results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    string json_path;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (arg == "--min-time-ms" && i + 1 < argc) {
+            s_min_time_ms = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            s_filter = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--min-time-ms N] [--filter TEXT] [--json FILE]\n";
+            return 1;
+        }
+    }
+
+    const uint32_t BLOCK_SIZE = 4096;
+    const vector<uint8_t> image = load_image();
+    const vector<uint8_t> worst_case(BLOCK_SIZE, 0xC0);
+    size_t offset = 0;
+
+    // Walks through the image block by block, so the typical data is not always the same
+    auto next_block = [&]() {
+        const uint8_t *block = &image[offset];
+        offset = (offset + 2 * BLOCK_SIZE <= image.size()) ? offset + BLOCK_SIZE : 0;
+        return block;
+    };
+
+    run("slip_send_typical", BLOCK_SIZE, [&]() {
+        SLIP_send(next_block(), BLOCK_SIZE);
+    });
+
+    run("slip_send_worst_case", BLOCK_SIZE, [&]() {
+        SLIP_send(worst_case.data(), BLOCK_SIZE);
+    });
+
+    uint8_t recv_buf[BLOCK_SIZE];
+    size_t recv_size;
+    const vector<uint8_t> typical_frame = slip_encode(image.data(), BLOCK_SIZE);
+    const vector<uint8_t> worst_case_frame = slip_encode(worst_case.data(), BLOCK_SIZE);
+
+    s_rx_endless = typical_frame;
+    s_rx_endless_pos = 0;
+    run("slip_receive_typical", BLOCK_SIZE, [&]() {
+        SLIP_receive_packet(recv_buf, sizeof(recv_buf), &recv_size);
+    });
+
+    s_rx_endless = worst_case_frame;
+    s_rx_endless_pos = 0;
+    run("slip_receive_worst_case", BLOCK_SIZE, [&]() {
+        SLIP_receive_packet(recv_buf, sizeof(recv_buf), &recv_size);
+    });
+    s_rx_endless.clear();
+
+    volatile uint8_t checksum_sink;
+    run("compute_checksum", BLOCK_SIZE, [&]() {
+        checksum_sink = compute_checksum(next_block(), BLOCK_SIZE);
+    });
+    (void)checksum_sink;
+
+    struct MD5Context md5_context;
+    MD5Init(&md5_context);
+    run("md5_update", BLOCK_SIZE, [&]() {
+        MD5Update(&md5_context, next_block(), BLOCK_SIZE);
+    });
+
+    sha256_context_t sha256_context;
+    sha256_init(&sha256_context);
+    run("sha256_update", BLOCK_SIZE, [&]() {
+        sha256_update(&sha256_context, next_block(), BLOCK_SIZE);
+    });
+
+    uint32_t reg_value;
+    run("send_cmd_read_reg", 0, [&]() {
+        loader_read_reg_cmd(0x3ff42000, &reg_value);
+    });
+
+    run("send_cmd_flash_data", BLOCK_SIZE, [&]() {
+        loader_flash_data_cmd(next_block(), BLOCK_SIZE);
+    });
+
+    // Flash size and chip are given, so the null port does not need to answer SPI flash commands
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    if (esp_loader_connect_secure_download_mode(&connect_config, 4 * 1024 * 1024, ESP32_CHIP) != ESP_LOADER_SUCCESS ||
+            esp_loader_flash_start(0, 4 * 1024 * 1024, BLOCK_SIZE) != ESP_LOADER_SUCCESS) {
+        cerr << "Null port connection failed\n";
+        return 1;
+    }
+
+    vector<uint8_t> payload(BLOCK_SIZE);
+    run("flash_write_full_block", BLOCK_SIZE, [&]() {
+        memcpy(payload.data(), next_block(), BLOCK_SIZE);
+        esp_loader_flash_write(payload.data(), BLOCK_SIZE);
+    });
+
+    run("flash_write_padded_block", BLOCK_SIZE, [&]() {
+        memcpy(payload.data(), next_block(), 16);
+        esp_loader_flash_write(payload.data(), 16);
+    });
+
+    printf("Bytes written to the null port: %llu\n", (unsigned long long)s_bytes_written);
+
+    if (!json_path.empty() && !write_json(json_path)) {
+        cerr << "Cannot write " << json_path << "\n";
+        return 1;
+    }
+
+    return 0;
+}
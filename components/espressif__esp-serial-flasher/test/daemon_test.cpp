@@ -0,0 +1,257 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Tests of the flashing daemon of examples/linux_daemon_example. The devices are pseudo
+ * terminals served by simulated targets in real time, jobs are submitted over the socket.
+ */
+
+#include "catch.hpp"
+#include "pty_target.h"
+#include "daemon.h"
+#include "hotplug.h"
+#include "protocol_prv.h"
+#include "test_port.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+
+const uint32_t APP_START_ADDRESS = 0x10000;
+const char IMAGE_PATH[] = TEST_DATA_DIR "/hello-world.bin";
+
+esp_loader_error_t loader_port_test_init(const loader_serial_config_t *config)
+{
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_test_deinit()
+{
+}
+
+static vector<uint8_t> load_image()
+{
+    ifstream file(IMAGE_PATH, ios::binary);
+    REQUIRE( file.is_open() );
+
+    return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+// Slow enough flash for the erase and write times to outweigh everything else
+static sim_target_config_t board_config()
+{
+    sim_target_config_t config;
+    config.chip = ESP32S3_CHIP;
+    config.link.baud_limits_bandwidth = false;
+    config.flash.sector_erase_us = 10000;
+    config.flash.sector_write_us = 20000;
+    return config;
+}
+
+class Daemon {
+public:
+    Daemon()
+    {
+        char dir[] = "/tmp/flasher_daemon_XXXXXX";
+        REQUIRE( mkdtemp(dir) != nullptr );
+        m_dir = dir;
+        m_socket_path = m_dir + "/socket";
+
+        const daemon_config_t config = {
+            .socket_path = m_socket_path.c_str(),
+            .baudrate = 115200,
+            .higher_baudrate = 921600,
+            .block_size = 0x4000,
+        };
+        REQUIRE( daemon_start(&config) == 0 );
+    }
+
+    ~Daemon()
+    {
+        daemon_stop();
+        rmdir(m_dir.c_str());
+    }
+
+    // Sends one request and returns the response, up to and including its OK or ERR line
+    string request(const string &line)
+    {
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE( fd >= 0 );
+
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, m_socket_path.c_str());
+        REQUIRE( connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0 );
+
+        const string message = line + "\n";
+        REQUIRE( send(fd, message.data(), message.size(), MSG_NOSIGNAL) == (ssize_t)message.size() );
+
+        string response;
+        char buffer[1024];
+        for (ssize_t received; (received = recv(fd, buffer, sizeof(buffer), 0)) > 0;) {
+            response.append(buffer, received);
+            const size_t last = response.rfind('\n', response.size() - 2);
+            const string last_line = response.substr(last == string::npos ? 0 : last + 1);
+            if (response.back() == '\n' && (last_line.compare(0, 2, "OK") == 0 ||
+                                            last_line.compare(0, 3, "ERR") == 0)) {
+                break;
+            }
+        }
+        close(fd);
+        return response;
+    }
+
+    // Submits a job and waits for it, returns the WAIT response
+    string flash(const string &target)
+    {
+        const string submitted = request("FLASH " + target + " 0x10000 " + IMAGE_PATH);
+        REQUIRE( submitted.compare(0, 3, "OK ") == 0 );
+        const string id = submitted.substr(3, submitted.size() - 4);
+        return request("WAIT " + id);
+    }
+
+private:
+    string m_dir;
+    string m_socket_path;
+};
+
+
+TEST_CASE( "Daemon flashes all targets in the time of one", "[daemon]" )
+{
+    const int BOARDS = 16;
+    vector<unique_ptr<PtyTarget>> targets;
+    for (int i = 0; i < BOARDS; i++) {
+        targets.emplace_back(new PtyTarget(board_config(), true));
+    }
+
+    const vector<uint8_t> image = load_image();
+    Daemon daemon;
+
+    REQUIRE( daemon_add_device(targets[0]->slave_path()) == 0 );
+    REQUIRE( daemon_add_device(targets[0]->slave_path()) == -1 );
+
+    auto start = chrono::steady_clock::now();
+    REQUIRE( daemon.flash(targets[0]->slave_path()) == "OK 1 1 0\n" );
+    const auto single = chrono::steady_clock::now() - start;
+    REQUIRE( targets[0]->flash(APP_START_ADDRESS, image.size()) == image );
+
+    for (int i = 1; i < BOARDS; i++) {
+        REQUIRE( daemon_add_device(targets[i]->slave_path()) == 0 );
+    }
+
+    // The first board already holds the image and only has its digest checked
+    start = chrono::steady_clock::now();
+    REQUIRE( daemon.flash("all") == "OK 2 16 0\n" );
+    const auto parallel = chrono::steady_clock::now() - start;
+    INFO( "one board " << chrono::duration_cast<chrono::milliseconds>(single).count() <<
+          " ms, " << BOARDS << " boards " <<
+          chrono::duration_cast<chrono::milliseconds>(parallel).count() << " ms" );
+    CHECK( parallel < single * 2 );
+
+    vector<uint64_t> blocks;
+    for (auto &target : targets) {
+        REQUIRE( target->flash(APP_START_ADDRESS, image.size()) == image );
+        blocks.push_back(target->stats().command_count[FLASH_DATA]);
+    }
+
+    // The digest read back from the first board spares every board the second write
+    REQUIRE( daemon.flash("any") == "OK 3 1 0\n" );
+    REQUIRE( daemon.flash("all") == "OK 4 16 0\n" );
+    for (int i = 0; i < BOARDS; i++) {
+        REQUIRE( targets[i]->stats().command_count[FLASH_DATA] == blocks[i] );
+    }
+
+    istringstream status(daemon.request("STATUS"));
+    string line;
+    int devices = 0;
+    while (getline(status, line) && line.compare(0, 7, "DEVICE ") == 0) {
+        INFO( line );
+        REQUIRE( line.find(" idle ") != string::npos );
+        REQUIRE( line.find(" failed=0 ") != string::npos );
+        REQUIRE( line.find(" rate=0") == string::npos );
+        devices++;
+    }
+    REQUIRE( line == "OK" );
+    REQUIRE( devices == BOARDS );
+}
+
+TEST_CASE( "Daemon rejects malformed requests", "[daemon]" )
+{
+    PtyTarget target(board_config());
+    Daemon daemon;
+    REQUIRE( daemon_add_device(target.slave_path()) == 0 );
+
+    REQUIRE( daemon.request("ERASE all") == "ERR unknown command\n" );
+    REQUIRE( daemon.request("FLASH") == "ERR missing target\n" );
+    REQUIRE( daemon.request("FLASH any") == "ERR no image\n" );
+    REQUIRE( daemon.request(string("FLASH any 0x10001 ") + IMAGE_PATH).compare(0, 4, "ERR ") == 0 );
+    REQUIRE( daemon.request("FLASH any 0x10000").compare(0, 4, "ERR ") == 0 );
+    REQUIRE( daemon.request("FLASH any 0x10000 /nonexistent.bin") ==
+             "ERR No such file or directory\n" );
+    REQUIRE( daemon.request(string("FLASH /dev/null 0x10000 ") + IMAGE_PATH) ==
+             "ERR unknown device\n" );
+    REQUIRE( daemon.request("WAIT 42") == "ERR unknown job\n" );
+
+    // A removed device takes no further jobs
+    daemon_remove_device(target.slave_path());
+    REQUIRE( daemon.request(string("FLASH all 0x10000 ") + IMAGE_PATH) == "ERR no device\n" );
+}
+
+TEST_CASE( "Hotplug picks up USB serial devices from uevents", "[daemon]" )
+{
+    char name[32];
+
+    const char add[] = "add@/devices/pci0000:00/0000:00:14.0/usb1/1-2/1-2:1.0/tty/ttyACM0\0"
+                       "ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2/1-2:1.0/tty/ttyACM0\0"
+                       "SUBSYSTEM=tty\0MAJOR=166\0MINOR=0\0DEVNAME=ttyACM0\0SEQNUM=4242";
+    REQUIRE( hotplug_parse(add, sizeof(add), name, sizeof(name)) == HOTPLUG_ADD );
+    REQUIRE( string(name) == "ttyACM0" );
+
+    const char remove[] = "remove@/devices/platform/serial8250/tty/ttyUSB3\0ACTION=remove\0"
+                          "SUBSYSTEM=tty\0DEVNAME=ttyUSB3";
+    REQUIRE( hotplug_parse(remove, sizeof(remove), name, sizeof(name)) == HOTPLUG_REMOVE );
+    REQUIRE( string(name) == "ttyUSB3" );
+
+    // Other subsystems and other tty devices are left alone
+    const char interface[] = "add@/devices/usb1/1-2/1-2:1.0\0ACTION=add\0SUBSYSTEM=usb\0"
+                             "DEVNAME=bus/usb/001/005";
+    REQUIRE( hotplug_parse(interface, sizeof(interface), name, sizeof(name)) == HOTPLUG_NONE );
+    const char console[] = "add@/devices/virtual/tty/tty1\0ACTION=add\0SUBSYSTEM=tty\0DEVNAME=tty1";
+    REQUIRE( hotplug_parse(console, sizeof(console), name, sizeof(name)) == HOTPLUG_NONE );
+    const char change[] = "change@/devices/usb1/tty/ttyACM0\0ACTION=change\0SUBSYSTEM=tty\0"
+                          "DEVNAME=ttyACM0";
+    REQUIRE( hotplug_parse(change, sizeof(change), name, sizeof(name)) == HOTPLUG_NONE );
+
+    // Truncated messages and names longer than the buffer
+    REQUIRE( hotplug_parse(add, sizeof(add) - 2, name, sizeof(name)) == HOTPLUG_NONE );
+    REQUIRE( hotplug_parse(add, sizeof(add), name, 4) == HOTPLUG_NONE );
+
+    const hotplug_filter_t any = {};
+    REQUIRE( hotplug_match(&any, "ttyUSB0") );
+    REQUIRE_FALSE( hotplug_match(&any, "tty1") );
+
+    // A filtered device is matched through sysfs, which has no such device here
+    hotplug_filter_t filter = {};
+    filter.ids[filter.id_count++] = { 0x303a, 0x1001 };
+    REQUIRE_FALSE( hotplug_match(&filter, "ttyACM99") );
+}
@@ -0,0 +1,167 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * End to end tests of port/linux_port.c. The port opens the slave side of a pseudo terminal,
+ * a thread serves the simulated target on the master side in real time.
+ */
+
+#include "catch.hpp"
+#include "pty_target.h"
+#include "esp_loader.h"
+#include "linux_port.h"
+#include "test_port.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+using namespace std;
+
+
+#define ESP_ERR_CHECK(exp) REQUIRE( (exp) == ESP_LOADER_SUCCESS )
+
+const uint32_t APP_START_ADDRESS = 0x10000;
+
+// Every test case opens its own pseudo terminal, nothing is shared between them
+esp_loader_error_t loader_port_test_init(const loader_serial_config_t *config)
+{
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_test_deinit()
+{
+}
+
+static vector<uint8_t> load_image()
+{
+    ifstream file(TEST_DATA_DIR "/hello-world.bin", ios::binary);
+    REQUIRE( file.is_open() );
+
+    return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static void flash_image(const vector<uint8_t> &image, uint32_t block_size)
+{
+    ESP_ERR_CHECK( esp_loader_flash_start(APP_START_ADDRESS, image.size(), block_size) );
+
+    for (size_t written = 0; written < image.size(); written += block_size) {
+        const size_t to_write = min<size_t>(block_size, image.size() - written);
+        ESP_ERR_CHECK( esp_loader_flash_write((void *)&image[written], to_write) );
+    }
+}
+
+static uint32_t configured_baudrate(const char *device)
+{
+    const int fd = open(device, O_RDWR | O_NOCTTY);
+    REQUIRE( fd >= 0 );
+
+    struct termios2 options;
+    REQUIRE( ioctl(fd, TCGETS2, &options) == 0 );
+    close(fd);
+
+    return options.c_ospeed;
+}
+
+
+TEST_CASE( "Linux port flashes through a pseudo terminal", "[linux_port]" )
+{
+    PtyTarget target((sim_target_config_t()));
+
+    const loader_linux_config_t config = {
+        .device = target.slave_path(),
+        .baudrate = 115200,
+    };
+    ESP_ERR_CHECK( loader_port_linux_init(&config) );
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+    REQUIRE( esp_loader_get_target() == ESP32_CHIP );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 4096);
+
+    REQUIRE( target.flash(APP_START_ADDRESS, image.size()) == image );
+    ESP_ERR_CHECK( esp_loader_flash_verify() );
+
+    loader_port_linux_deinit();
+}
+
+TEST_CASE( "Linux port accepts arbitrary baud rates", "[linux_port]" )
+{
+    sim_target_config_t sim_config;
+    sim_config.chip = ESP32S3_CHIP;
+    PtyTarget target(sim_config);
+
+    loader_linux_config_t config = {
+        .device = target.slave_path(),
+        .baudrate = 115200,
+    };
+    ESP_ERR_CHECK( loader_port_linux_init(&config) );
+    REQUIRE( configured_baudrate(target.slave_path()) == 115200 );
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+
+    // Neither a standard rate, nor one of the Bxxx constants
+    const uint32_t baudrate = 3456789;
+    ESP_ERR_CHECK( esp_loader_change_transmission_rate_stub(115200, baudrate) );
+    ESP_ERR_CHECK( loader_port_change_transmission_rate(baudrate) );
+    REQUIRE( configured_baudrate(target.slave_path()) == baudrate );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 16384);
+    ESP_ERR_CHECK( esp_loader_flash_verify() );
+
+    vector<uint8_t> read_back(image.size());
+    ESP_ERR_CHECK( esp_loader_flash_read(read_back.data(), APP_START_ADDRESS, read_back.size()) );
+    REQUIRE( read_back == image );
+
+    REQUIRE( loader_port_change_transmission_rate(LOADER_LINUX_MAX_BAUDRATE + 1) ==
+             ESP_LOADER_ERROR_INVALID_PARAM );
+
+    esp_loader_reset_target();
+    loader_port_linux_deinit();
+
+    config.baudrate = 0;
+    REQUIRE( loader_port_linux_init(&config) == ESP_LOADER_ERROR_INVALID_PARAM );
+}
+
+TEST_CASE( "Linux port times out without a target", "[linux_port]" )
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    REQUIRE( master >= 0 );
+    REQUIRE( grantpt(master) == 0 );
+    REQUIRE( unlockpt(master) == 0 );
+
+    const loader_linux_config_t config = {
+        .device = ptsname(master),
+        .baudrate = 921600,
+    };
+    ESP_ERR_CHECK( loader_port_linux_init(&config) );
+
+    uint8_t data[4];
+    const auto start = chrono::steady_clock::now();
+    REQUIRE( loader_port_read(data, sizeof(data), 50) == ESP_LOADER_ERROR_TIMEOUT );
+    REQUIRE( chrono::steady_clock::now() - start >= chrono::milliseconds(45) );
+
+    loader_port_linux_deinit();
+    close(master);
+}
@@ -0,0 +1,142 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Simulated target served on the master side of a pseudo terminal by its own thread, the
+ * slave side is opened as a serial device. By default responses are sent as soon as they are
+ * computed. A real time target holds each one back until the time the model gives it, so
+ * flash erase and write times are spent on the wall clock as they would be on hardware.
+ */
+
+#include "catch.hpp"
+#include "sim_target.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+class PtyTarget {
+public:
+    explicit PtyTarget(const sim_target_config_t &config, bool realtime = false)
+        : m_realtime(realtime), m_stop(false),
+          m_target(config, [this](const std::vector<uint8_t> &payload, uint64_t time_ns) {
+        send(payload, time_ns);
+    })
+    {
+        m_master = posix_openpt(O_RDWR | O_NOCTTY);
+        REQUIRE( m_master >= 0 );
+        REQUIRE( grantpt(m_master) == 0 );
+        REQUIRE( unlockpt(m_master) == 0 );
+        m_slave_path = ptsname(m_master);
+
+        m_thread = std::thread(&PtyTarget::serve, this);
+    }
+
+    ~PtyTarget()
+    {
+        m_stop = true;
+        m_thread.join();
+        close(m_master);
+    }
+
+    const char *slave_path() const
+    {
+        return m_slave_path.c_str();
+    }
+
+    std::vector<uint8_t> flash(uint32_t address, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const std::vector<uint8_t> &flash = m_target.flash();
+
+        return std::vector<uint8_t>(flash.begin() + address, flash.begin() + address + size);
+    }
+
+    sim_stats_t stats()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_target.stats();
+    }
+
+private:
+    static uint64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void serve()
+    {
+        uint8_t buffer[4096];
+
+        while (!m_stop) {
+            struct pollfd fd = { m_master, POLLIN, 0 };
+            if (poll(&fd, 1, 10) <= 0) {
+                continue;
+            }
+
+            // Fails with EIO while the slave side is closed
+            const ssize_t received = read(m_master, buffer, sizeof(buffer));
+            if (received <= 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const uint64_t time_ns = now_ns();
+            for (ssize_t i = 0; i < received; i++) {
+                m_target.receive(buffer[i], time_ns);
+            }
+        }
+    }
+
+    void send(const std::vector<uint8_t> &payload, uint64_t time_ns)
+    {
+        if (m_realtime) {
+            const uint64_t now = now_ns();
+            if (time_ns > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(time_ns - now));
+            }
+        }
+
+        const std::vector<uint8_t> encoded = sim_slip_encode(payload);
+
+        for (size_t written = 0; written < encoded.size();) {
+            const ssize_t result = write(m_master, &encoded[written], encoded.size() - written);
+            if (result > 0) {
+                written += result;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    int m_master;
+    std::string m_slave_path;
+    const bool m_realtime;
+    std::atomic<bool> m_stop;
+    std::mutex m_mutex;
+    SimTarget m_target;
+    std::thread m_thread;
+};
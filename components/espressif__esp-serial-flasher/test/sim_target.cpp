@@ -0,0 +1,779 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sim_target.h"
+#include "protocol.h"
+#include "esp_stubs.h"
+#include "md5_hash.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if SIM_TARGET_DEFLATE
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+#define SECTOR_SIZE 4096U
+#define CHIP_DETECT_MAGIC_REG_ADDR 0x40001000
+#define SPI_CMD_USR (1U << 18)
+#define SPI_FLASH_READ_ID 0x9F
+#define FLASH_MANUFACTURER_ID 0xEF
+#define FLASH_DEVICE_ID 0x40
+
+typedef struct {
+    target_chip_t chip;
+    uint32_t magic_value;
+    uint32_t spi_cmd;
+    uint32_t spi_usr2;
+    uint32_t spi_w0;
+    uint32_t efuse_base;
+    uint32_t mac_efuse_offset;
+    bool security_info;
+    uint32_t chip_id;
+} sim_chip_t;
+
+static const sim_chip_t s_chips[] = {
+    { ESP32_CHIP,   0x00f01d83, 0x3ff42000, 0x3ff42024, 0x3ff42080, 0x3ff5A000, 0x04, false, 0 },
+    { ESP32S3_CHIP, 0x00000009, 0x60002000, 0x60002020, 0x60002058, 0x60007000, 0x44, true,  9 },
+    { ESP32C3_CHIP, 0x6921506f, 0x60002000, 0x60002020, 0x60002058, 0x60008800, 0x44, true,  5 },
+};
+
+/* 24:0a:c4:12:34:56, split the way the MAC eFuse words store it */
+static const uint32_t MAC_WORD0 = 0xc4123456;
+static const uint32_t MAC_WORD1 = 0x0000240a;
+
+static const sim_chip_t &chip_info(target_chip_t chip)
+{
+    for (const sim_chip_t &info : s_chips) {
+        if (info.chip == chip) {
+            return info;
+        }
+    }
+
+    return s_chips[0];
+}
+
+static uint32_t get_u32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void put_u32(vector<uint8_t> &out, uint32_t value)
+{
+    const uint8_t *bytes = (const uint8_t *)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+static uint8_t checksum(const uint8_t *data, size_t size)
+{
+    uint8_t result = 0xEF;
+    while (size--) {
+        result ^= *data++;
+    }
+    return result;
+}
+
+static uint64_t sectors_time_ns(uint64_t bytes, uint32_t us_per_sector)
+{
+    return bytes * us_per_sector * 1000ULL / SECTOR_SIZE;
+}
+
+
+SimTarget::SimTarget(const sim_target_config_t &config, emit_fn_t emit)
+    : m_config(config), m_emit(emit), m_mode(MODE_APP), m_baud_rate(config.link.baud_rate),
+      m_flash(config.flash.size, 0xFF), m_mem_cursor(0), m_inflate(nullptr), m_busy_until_ns(0),
+      m_flash_busy_until_ns(0), m_frame_escape(false), m_frame_invalid(false)
+{
+    reset(true);
+}
+
+SimTarget::~SimTarget()
+{
+#if SIM_TARGET_DEFLATE
+    if (m_inflate != nullptr) {
+        inflateEnd((z_stream *)m_inflate);
+        delete (z_stream *)m_inflate;
+    }
+#endif
+}
+
+void SimTarget::reset(bool download_mode)
+{
+    const sim_chip_t &chip = chip_info(m_config.chip);
+
+    m_mode = download_mode ? MODE_ROM : MODE_APP;
+    m_baud_rate = m_config.link.baud_rate;
+    m_regs.clear();
+    m_regs[chip.efuse_base + chip.mac_efuse_offset] = MAC_WORD0;
+    m_regs[chip.efuse_base + chip.mac_efuse_offset + 4] = MAC_WORD1;
+    m_ram.clear();
+    m_write = write_state_t();
+    m_read = read_state_t();
+    m_rx_fifo.clear();
+    m_frame.clear();
+    m_frame_escape = false;
+    m_frame_invalid = false;
+}
+
+void SimTarget::receive(uint8_t byte, uint64_t time_ns)
+{
+    m_stats.bytes_to_target++;
+
+    // The ROM leaves the bytes arriving while it is busy in its receive FIFO
+    if (m_mode == MODE_ROM && m_config.rom_rx_fifo_size > 0) {
+        while (!m_rx_fifo.empty() && m_rx_fifo.front() <= time_ns) {
+            m_rx_fifo.pop_front();
+        }
+        if (m_busy_until_ns > time_ns) {
+            if (m_rx_fifo.size() >= m_config.rom_rx_fifo_size) {
+                m_stats.fifo_overruns++;
+                return;
+            }
+            m_rx_fifo.push_back(m_busy_until_ns);
+        }
+    }
+
+    if (byte == 0xC0) {
+        if (!m_frame.empty() && !m_frame_invalid) {
+            handle_frame(time_ns);
+        } else if (m_frame_invalid) {
+            m_stats.frames_dropped++;
+        }
+        m_frame.clear();
+        m_frame_escape = false;
+        m_frame_invalid = false;
+    } else if (m_frame_escape) {
+        m_frame_escape = false;
+        if (byte == 0xDC) {
+            m_frame.push_back(0xC0);
+        } else if (byte == 0xDD) {
+            m_frame.push_back(0xDB);
+        } else {
+            m_frame_invalid = true;
+        }
+    } else if (byte == 0xDB) {
+        m_frame_escape = true;
+    } else {
+        m_frame.push_back(byte);
+    }
+}
+
+void SimTarget::handle_frame(uint64_t time_ns)
+{
+    if (m_mode == MODE_APP) {
+        return;
+    }
+
+    // The flasher stub acknowledges READ_FLASH packets with bare 4 byte frames
+    if (m_read.active && m_frame.size() == sizeof(uint32_t)) {
+        handle_read_ack(get_u32(m_frame.data()), time_ns);
+        return;
+    }
+
+    if (m_frame.size() < sizeof(command_common_t)) {
+        m_stats.frames_dropped++;
+        return;
+    }
+
+    command_common_t header;
+    memcpy(&header, m_frame.data(), sizeof(header));
+
+    if (header.direction != WRITE_DIRECTION ||
+            header.size != m_frame.size() - sizeof(command_common_t)) {
+        m_stats.frames_dropped++;
+        return;
+    }
+
+    m_stats.commands++;
+    m_stats.command_count[header.command]++;
+
+    const uint64_t command_ns = m_mode == MODE_ROM ? m_config.rom_command_us * 1000ULL : 0;
+    handle_command(header.command, &m_frame[sizeof(command_common_t)], header.size,
+                   header.checksum, max(time_ns, m_busy_until_ns) + command_ns);
+}
+
+void SimTarget::handle_command(uint8_t command, const uint8_t *params, size_t size,
+                               uint32_t data_checksum, uint64_t time_ns)
+{
+    const sim_chip_t &chip = chip_info(m_config.chip);
+    const bool stub = m_mode == MODE_STUB;
+
+    switch (command) {
+    case SYNC:
+        for (int i = 0; i < 8; i++) {
+            respond(command, time_ns);
+        }
+        break;
+
+    case READ_REG:
+        if (size < 4) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        respond(command, time_ns, read_reg(get_u32(params)));
+        break;
+
+    case WRITE_REG: {
+        if (size < 16) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        write_reg(get_u32(params), get_u32(params + 4), get_u32(params + 8));
+        respond(command, time_ns + get_u32(params + 12) * 1000ULL);
+        break;
+    }
+
+    case SPI_SET_PARAMS:
+    case SPI_ATTACH:
+        respond(command, time_ns);
+        break;
+
+    case GET_SECURITY_INFO: {
+        if (!chip.security_info) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        get_security_info_response_data_t info = {};
+        info.chip_id = chip.chip_id;
+        const uint8_t *raw = (const uint8_t *)&info;
+        respond(command, time_ns, 0, vector<uint8_t>(raw, raw + sizeof(info)));
+        break;
+    }
+
+    case CHANGE_BAUDRATE:
+        if (size < 8) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        // The response still goes out at the old rate
+        respond(command, time_ns);
+        m_baud_rate = get_u32(params);
+        break;
+
+    case FLASH_BEGIN:
+    case FLASH_DEFL_BEGIN: {
+        if (size < 16) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        const uint32_t erase_size = get_u32(params);
+        const uint32_t offset = get_u32(params + 12);
+        if ((uint64_t)offset + erase_size > m_flash.size()) {
+            respond_error(command, COMMAND_FAILED, time_ns);
+            break;
+        }
+#if !SIM_TARGET_DEFLATE
+        if (command == FLASH_DEFL_BEGIN) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+#endif
+        m_write = write_state_t();
+        m_write.active = true;
+        m_write.deflate = command == FLASH_DEFL_BEGIN;
+        m_write.offset = offset;
+        m_write.cursor = offset;
+        m_write.erase_end = offset + erase_size;
+        m_write.erased_up_to = offset - offset % SECTOR_SIZE;
+
+#if SIM_TARGET_DEFLATE
+        if (m_write.deflate) {
+            if (m_inflate == nullptr) {
+                m_inflate = new z_stream();
+            } else {
+                inflateEnd((z_stream *)m_inflate);
+                *(z_stream *)m_inflate = z_stream();
+            }
+            inflateInit((z_stream *)m_inflate);
+        }
+#endif
+
+        if (stub) {
+            // The stub erases lazily, in front of the data being written
+            respond(command, time_ns);
+        } else {
+            const uint64_t erase_ns = erase(m_write.erased_up_to, m_write.erase_end - m_write.erased_up_to);
+            m_write.erased_up_to = m_write.erase_end;
+            respond(command, time_ns + erase_ns);
+        }
+        break;
+    }
+
+    case FLASH_DATA:
+    case FLASH_DEFL_DATA:
+    case MEM_DATA: {
+        if (size < 16 || get_u32(params) != size - 16) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        const uint8_t *data = params + 16;
+        const uint32_t data_size = size - 16;
+        if (checksum(data, data_size) != (uint8_t)data_checksum) {
+            m_stats.checksum_errors++;
+            respond_error(command, INVALID_CRC, time_ns);
+            break;
+        }
+
+        if (command == MEM_DATA) {
+            for (uint32_t i = 0; i < data_size; i++) {
+                m_ram[m_mem_cursor++] = data[i];
+            }
+            respond(command, time_ns);
+            break;
+        }
+
+        if (!m_write.active || m_write.deflate != (command == FLASH_DEFL_DATA)) {
+            respond_error(command, COMMAND_FAILED, time_ns);
+            break;
+        }
+
+        vector<uint8_t> inflated;
+        if (m_write.deflate) {
+#if SIM_TARGET_DEFLATE
+            z_stream *stream = (z_stream *)m_inflate;
+            uint8_t out[4096];
+            stream->next_in = (Bytef *)data;
+            stream->avail_in = data_size;
+            do {
+                stream->next_out = out;
+                stream->avail_out = sizeof(out);
+                const int ret = inflate(stream, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                    respond_error(command, DEFLATE_ERROR, time_ns);
+                    return;
+                }
+                inflated.insert(inflated.end(), out, out + (sizeof(out) - stream->avail_out));
+            } while (stream->avail_out == 0);
+            data = inflated.data();
+#endif
+        }
+        const size_t write_size = m_write.deflate ? inflated.size() : data_size;
+
+        if (stub) {
+            // One block is buffered while the previous one is being written
+            const uint64_t ack_ns = max(time_ns, m_flash_busy_until_ns);
+            m_flash_busy_until_ns = ack_ns + program(data, write_size);
+            respond(command, ack_ns);
+        } else {
+            respond(command, time_ns + program(data, write_size));
+        }
+        break;
+    }
+
+    case FLASH_END:
+    case FLASH_DEFL_END: {
+        const bool stay_in_loader = size < 4 || get_u32(params) != 0;
+        m_write.active = false;
+        respond(command, max(time_ns, m_flash_busy_until_ns));
+        if (!stay_in_loader) {
+            m_mode = MODE_APP;
+        }
+        break;
+    }
+
+    case ERASE_REGION: {
+        if (!stub || size < 8) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        const uint32_t offset = get_u32(params);
+        const uint32_t erase_size = get_u32(params + 4);
+        if (offset % SECTOR_SIZE != 0 || erase_size % SECTOR_SIZE != 0 ||
+                (uint64_t)offset + erase_size > m_flash.size()) {
+            respond_error(command, COMMAND_FAILED, time_ns);
+            break;
+        }
+        respond(command, max(time_ns, m_flash_busy_until_ns) + erase(offset, erase_size));
+        break;
+    }
+
+    case MEM_BEGIN:
+        if (size < 16) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        m_mem_cursor = get_u32(params + 12);
+        respond(command, time_ns);
+        break;
+
+    case MEM_END: {
+        if (size < 8) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        const bool stay_in_loader = get_u32(params) != 0;
+        const uint32_t entrypoint = get_u32(params + 4);
+        respond(command, time_ns);
+        if (!stay_in_loader) {
+            if (entrypoint == esp_stub[m_config.chip].header.entrypoint && loaded_stub_matches()) {
+                m_mode = MODE_STUB;
+                const vector<uint8_t> greeting = { 'O', 'H', 'A', 'I' };
+                m_emit(greeting, time_ns);
+            } else {
+                m_mode = MODE_APP;
+            }
+        }
+        break;
+    }
+
+    case SPI_FLASH_MD5: {
+        if (size < 8) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        const uint32_t address = get_u32(params);
+        const uint32_t length = get_u32(params + 4);
+        if ((uint64_t)address + length > m_flash.size()) {
+            respond_error(command, FLASH_READ_ERR, time_ns);
+            break;
+        }
+
+        struct MD5Context context;
+        uint8_t digest[16];
+        MD5Init(&context);
+        MD5Update(&context, &m_flash[address], length);
+        MD5Final(digest, &context);
+
+        vector<uint8_t> data;
+        if (stub) {
+            data.assign(digest, digest + sizeof(digest));
+        } else {
+            static const char hex[] = "0123456789abcdef";
+            for (uint8_t byte : digest) {
+                data.push_back(hex[byte >> 4]);
+                data.push_back(hex[byte & 0xF]);
+            }
+        }
+        respond(command, max(time_ns, m_flash_busy_until_ns), 0, data);
+        break;
+    }
+
+    case READ_FLASH_ROM: {
+        if (stub || size < 8) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        const uint32_t address = get_u32(params);
+        const uint32_t length = get_u32(params + 4);
+        if (length > READ_FLASH_ROM_DATA_SIZE || (uint64_t)address + length > m_flash.size()) {
+            respond_error(command, READ_LENGTH_ERR, time_ns);
+            break;
+        }
+        respond(command, time_ns, 0, vector<uint8_t>(&m_flash[address], &m_flash[address] + length));
+        break;
+    }
+
+    case READ_FLASH_STUB: {
+        if (!stub || size < 16) {
+            respond_error(command, INVALID_COMMAND, time_ns);
+            break;
+        }
+        m_read = read_state_t();
+        m_read.address = get_u32(params);
+        m_read.total = get_u32(params + 4);
+        m_read.packet_size = get_u32(params + 8);
+        m_read.max_inflight = max(get_u32(params + 12), 1U);
+        if ((uint64_t)m_read.address + m_read.total > m_flash.size() || m_read.packet_size == 0) {
+            respond_error(command, READ_LENGTH_ERR, time_ns);
+            break;
+        }
+        m_read.active = true;
+        respond(command, time_ns);
+        send_read_packets(time_ns);
+        break;
+    }
+
+    default:
+        respond_error(command, INVALID_COMMAND, time_ns);
+        break;
+    }
+}
+
+void SimTarget::handle_read_ack(uint32_t acked, uint64_t time_ns)
+{
+    m_read.acked = acked;
+
+    if (m_read.acked >= m_read.total) {
+        struct MD5Context context;
+        uint8_t digest[16];
+        MD5Init(&context);
+        MD5Update(&context, &m_flash[m_read.address], m_read.total);
+        MD5Final(digest, &context);
+
+        m_read.active = false;
+        m_emit(vector<uint8_t>(digest, digest + sizeof(digest)), time_ns);
+    } else {
+        send_read_packets(time_ns);
+    }
+}
+
+void SimTarget::send_read_packets(uint64_t time_ns)
+{
+    while (m_read.sent < m_read.total &&
+            m_read.sent - m_read.acked < m_read.packet_size * m_read.max_inflight) {
+        const uint32_t length = min(m_read.packet_size, m_read.total - m_read.sent);
+        const uint8_t *start = &m_flash[m_read.address + m_read.sent];
+        m_emit(vector<uint8_t>(start, start + length), time_ns);
+        m_read.sent += length;
+    }
+}
+
+void SimTarget::respond(uint8_t command, uint64_t time_ns, uint32_t value,
+                        const vector<uint8_t> &data, uint8_t error)
+{
+    // The ROM appends four status bytes, the stub only two
+    const size_t status_size = m_mode == MODE_STUB ? 2 : 4;
+
+    vector<uint8_t> payload = { READ_DIRECTION, command };
+    const uint16_t size = data.size() + status_size;
+    payload.push_back(size & 0xFF);
+    payload.push_back(size >> 8);
+    put_u32(payload, value);
+    payload.insert(payload.end(), data.begin(), data.end());
+    payload.push_back(error != 0 ? STATUS_FAILURE : STATUS_SUCCESS);
+    payload.push_back(error);
+    payload.resize(payload.size() + status_size - 2, 0);
+
+    m_busy_until_ns = time_ns;
+    m_emit(payload, time_ns);
+}
+
+void SimTarget::respond_error(uint8_t command, uint8_t error, uint64_t time_ns)
+{
+    respond(command, time_ns, 0, vector<uint8_t>(), error);
+}
+
+uint32_t SimTarget::read_reg(uint32_t address)
+{
+    if (address == CHIP_DETECT_MAGIC_REG_ADDR) {
+        return chip_info(m_config.chip).magic_value;
+    }
+
+    auto reg = m_regs.find(address);
+    return reg != m_regs.end() ? reg->second : 0;
+}
+
+void SimTarget::write_reg(uint32_t address, uint32_t value, uint32_t mask)
+{
+    m_regs[address] = (read_reg(address) & ~mask) | (value & mask);
+
+    if (address == chip_info(m_config.chip).spi_cmd && (m_regs[address] & SPI_CMD_USR)) {
+        run_spi_command();
+    }
+}
+
+void SimTarget::run_spi_command()
+{
+    const sim_chip_t &chip = chip_info(m_config.chip);
+
+    if ((read_reg(chip.spi_usr2) & 0xFF) == SPI_FLASH_READ_ID) {
+        uint32_t size_id = 0;
+        while ((1U << size_id) < m_flash.size()) {
+            size_id++;
+        }
+        m_regs[chip.spi_w0] = (size_id << 16) | (FLASH_DEVICE_ID << 8) | FLASH_MANUFACTURER_ID;
+    }
+
+    // The command completes immediately
+    m_regs[chip.spi_cmd] &= ~SPI_CMD_USR;
+}
+
+uint64_t SimTarget::erase(uint32_t address, uint32_t size)
+{
+    const uint32_t start = address - address % SECTOR_SIZE;
+    const uint32_t end = min<uint64_t>(ROUNDUP((uint64_t)address + size, SECTOR_SIZE), m_flash.size());
+
+    if (end <= start) {
+        return 0;
+    }
+
+    fill(m_flash.begin() + start, m_flash.begin() + end, 0xFF);
+    m_stats.sectors_erased += (end - start) / SECTOR_SIZE;
+
+    return sectors_time_ns(end - start, m_config.flash.sector_erase_us);
+}
+
+uint64_t SimTarget::program(const uint8_t *data, size_t size)
+{
+    uint64_t duration_ns = 0;
+
+    const uint32_t end = min<uint64_t>((uint64_t)m_write.cursor + size, m_flash.size());
+    if (m_write.erased_up_to < min(end, m_write.erase_end)) {
+        const uint32_t erase_end = ROUNDUP(min(end, m_write.erase_end), SECTOR_SIZE);
+        duration_ns += erase(m_write.erased_up_to, erase_end - m_write.erased_up_to);
+        m_write.erased_up_to = erase_end;
+    }
+
+    // NOR flash can only clear bits
+    for (uint32_t address = m_write.cursor; address < end; address++) {
+        m_flash[address] &= *data++;
+    }
+
+    duration_ns += sectors_time_ns(end - m_write.cursor, m_config.flash.sector_write_us);
+    m_write.cursor = end;
+
+    return duration_ns;
+}
+
+bool SimTarget::loaded_stub_matches() const
+{
+    const esp_stub_t &stub = esp_stub[m_config.chip];
+
+    for (const esp_loader_bin_segment_t &segment : stub.segments) {
+        for (uint32_t i = 0; i < segment.size; i++) {
+            auto byte = m_ram.find(segment.addr + i);
+            if (byte == m_ram.end() || byte->second != segment.data[i]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+SimLink::SimLink(const sim_target_config_t &config)
+    : m_config(config.link), m_host_baud_rate(config.link.baud_rate), m_now_ns(0),
+      m_tx_free_ns(0), m_rx_free_ns(0), m_rng(config.link.seed),
+      m_target(config, [this](const vector<uint8_t> &payload, uint64_t time_ns) {
+    deliver_to_host(payload, time_ns);
+})
+{
+}
+
+double SimLink::byte_time_ns() const
+{
+    if (m_config.baud_limits_bandwidth) {
+        return 10.0 * 1e9 / m_host_baud_rate;
+    }
+
+    return m_config.bytes_per_second != 0 ? 1e9 / m_config.bytes_per_second : 0.0;
+}
+
+uint8_t SimLink::inject_errors(uint8_t byte, double bit_error_rate)
+{
+    // Both ends have to agree on the baud rate, otherwise only garbage gets through
+    if (m_config.baud_limits_bandwidth && m_host_baud_rate != m_target.baud_rate()) {
+        return (uint8_t)m_rng();
+    }
+
+    if (bit_error_rate > 0.0) {
+        uniform_real_distribution<double> chance(0.0, 1.0);
+        for (int bit = 0; bit < 8; bit++) {
+            if (chance(m_rng) < bit_error_rate) {
+                byte ^= 1 << bit;
+                m_target.stats().bit_errors++;
+            }
+        }
+    }
+
+    return byte;
+}
+
+esp_loader_error_t SimLink::write(const uint8_t *data, size_t size)
+{
+    const double byte_ns = byte_time_ns();
+    const uint64_t latency_ns = m_config.latency_us * 1000ULL;
+    const uint64_t start_ns = max(m_now_ns, m_tx_free_ns);
+
+    for (size_t i = 0; i < size; i++) {
+        const uint64_t arrival_ns = start_ns + (uint64_t)((i + 1) * byte_ns) + latency_ns;
+        m_target.receive(inject_errors(data[i], m_config.tx_bit_error_rate), arrival_ns);
+    }
+
+    m_tx_free_ns = start_ns + (uint64_t)(size * byte_ns);
+    m_now_ns = m_tx_free_ns;
+
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t SimLink::read(uint8_t *data, size_t size, uint32_t timeout_ms)
+{
+    const uint64_t deadline_ns = m_now_ns + timeout_ms * 1000000ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        if (m_rx.empty() || m_rx.front().ready_ns > deadline_ns) {
+            m_now_ns = deadline_ns;
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+
+        m_now_ns = max(m_now_ns, m_rx.front().ready_ns);
+        data[i] = m_rx.front().value;
+        m_rx.pop_front();
+    }
+
+    return ESP_LOADER_SUCCESS;
+}
+
+vector<uint8_t> sim_slip_encode(const vector<uint8_t> &payload)
+{
+    vector<uint8_t> encoded = { 0xC0 };
+    for (uint8_t byte : payload) {
+        if (byte == 0xC0) {
+            encoded.insert(encoded.end(), { 0xDB, 0xDC });
+        } else if (byte == 0xDB) {
+            encoded.insert(encoded.end(), { 0xDB, 0xDD });
+        } else {
+            encoded.push_back(byte);
+        }
+    }
+    encoded.push_back(0xC0);
+
+    return encoded;
+}
+
+void SimLink::deliver_to_host(const vector<uint8_t> &payload, uint64_t time_ns)
+{
+    const vector<uint8_t> encoded = sim_slip_encode(payload);
+
+    const double byte_ns = byte_time_ns();
+    const uint64_t latency_ns = m_config.latency_us * 1000ULL;
+    const uint64_t start_ns = max(time_ns, m_rx_free_ns);
+
+    for (size_t i = 0; i < encoded.size(); i++) {
+        const uint64_t ready_ns = start_ns + (uint64_t)((i + 1) * byte_ns) + latency_ns;
+        m_rx.push_back({ inject_errors(encoded[i], m_config.rx_bit_error_rate), ready_ns });
+    }
+
+    m_rx_free_ns = start_ns + (uint64_t)(encoded.size() * byte_ns);
+    m_target.stats().bytes_to_host += encoded.size();
+}
+
+void SimLink::set_host_baud_rate(uint32_t baud_rate)
+{
+    m_host_baud_rate = baud_rate;
+}
+
+void SimLink::set_bit_error_rates(double tx_bit_error_rate, double rx_bit_error_rate)
+{
+    m_config.tx_bit_error_rate = tx_bit_error_rate;
+    m_config.rx_bit_error_rate = rx_bit_error_rate;
+}
+
+void SimLink::reset_target(bool download_mode)
+{
+    m_rx.clear();
+    m_host_baud_rate = m_config.baud_rate;
+    m_target.reset(download_mode);
+}
+
+void SimLink::advance_us(uint64_t us)
+{
+    m_now_ns += us * 1000;
+}
@@ -0,0 +1,211 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * In-process model of an Espressif ROM loader / flasher stub and of the link connecting it
+ * to the host. All timing is virtual: writes and reads advance a simulated clock instead of
+ * sleeping, so transfer times of whole images can be measured without hardware in a fraction
+ * of the real time.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+#include "esp_loader.h"
+
+struct sim_link_config_t {
+    uint32_t baud_rate = 115200;        /* Initial transmission rate of both ends */
+    bool baud_limits_bandwidth = true;  /* UART like link, 10 bits on the wire per byte */
+    uint64_t bytes_per_second = 0;      /* Used if baud_limits_bandwidth is false, 0 = unlimited */
+    uint32_t latency_us = 0;            /* One way latency of every byte */
+    double tx_bit_error_rate = 0.0;     /* Host to target */
+    double rx_bit_error_rate = 0.0;     /* Target to host */
+    uint32_t seed = 1;                  /* Seed of the error injection generator */
+};
+
+struct sim_flash_config_t {
+    uint32_t size = 4 * 1024 * 1024;
+    uint32_t sector_erase_us = 0;       /* Time to erase one 4 KiB sector */
+    uint32_t sector_write_us = 0;       /* Time to program 4 KiB of data */
+};
+
+struct sim_target_config_t {
+    target_chip_t chip = ESP32_CHIP;    /* ESP32, ESP32-S3 and ESP32-C3 are modelled */
+    uint32_t rom_command_us = 0;        /* Time the ROM loader takes for every command */
+    uint32_t rom_rx_fifo_size = 128;    /* Bytes the busy ROM buffers, the rest is lost, 0 = unlimited */
+    sim_flash_config_t flash;
+    sim_link_config_t link;
+};
+
+struct sim_stats_t {
+    uint64_t commands = 0;
+    uint64_t frames_dropped = 0;        /* Malformed frames ignored by the target */
+    uint64_t checksum_errors = 0;       /* Data blocks rejected with INVALID_CRC */
+    uint64_t bit_errors = 0;            /* Bits flipped by the error injection */
+    uint64_t bytes_to_target = 0;
+    uint64_t bytes_to_host = 0;
+    uint64_t sectors_erased = 0;
+    uint64_t fifo_overruns = 0;         /* Bytes lost to a full ROM receive FIFO */
+    uint64_t command_count[256] = {};
+};
+
+class SimTarget {
+public:
+    /* Called with a decoded response payload and the time it leaves the target */
+    typedef std::function<void(const std::vector<uint8_t> &payload, uint64_t time_ns)> emit_fn_t;
+
+    SimTarget(const sim_target_config_t &config, emit_fn_t emit);
+    ~SimTarget();
+
+    /* Boots the target either into the ROM download mode or into the application */
+    void reset(bool download_mode);
+
+    /* Feeds one byte of the host stream, arriving at the target at time_ns */
+    void receive(uint8_t byte, uint64_t time_ns);
+
+    std::vector<uint8_t> &flash()
+    {
+        return m_flash;
+    }
+    bool stub_running() const
+    {
+        return m_mode == MODE_STUB;
+    }
+    bool in_download_mode() const
+    {
+        return m_mode != MODE_APP;
+    }
+    uint32_t baud_rate() const
+    {
+        return m_baud_rate;
+    }
+    sim_stats_t &stats()
+    {
+        return m_stats;
+    }
+
+private:
+    enum mode_t { MODE_ROM, MODE_STUB, MODE_APP };
+
+    struct write_state_t {
+        bool active = false;
+        bool deflate = false;
+        uint32_t offset = 0;
+        uint32_t erase_end = 0;
+        uint32_t erased_up_to = 0;
+        uint32_t cursor = 0;
+    };
+
+    struct read_state_t {
+        bool active = false;
+        uint32_t address = 0;
+        uint32_t total = 0;
+        uint32_t packet_size = 0;
+        uint32_t max_inflight = 0;
+        uint32_t sent = 0;
+        uint32_t acked = 0;
+    };
+
+    void handle_frame(uint64_t time_ns);
+    void handle_command(uint8_t command, const uint8_t *params, size_t size, uint32_t checksum,
+                        uint64_t time_ns);
+    void handle_read_ack(uint32_t acked, uint64_t time_ns);
+    void respond(uint8_t command, uint64_t time_ns, uint32_t value = 0,
+                 const std::vector<uint8_t> &data = std::vector<uint8_t>(), uint8_t error = 0);
+    void respond_error(uint8_t command, uint8_t error, uint64_t time_ns);
+
+    uint32_t read_reg(uint32_t address);
+    void write_reg(uint32_t address, uint32_t value, uint32_t mask);
+    void run_spi_command();
+
+    uint64_t erase(uint32_t address, uint32_t size);
+    uint64_t program(const uint8_t *data, size_t size);
+    bool loaded_stub_matches() const;
+    void send_read_packets(uint64_t time_ns);
+
+    sim_target_config_t m_config;
+    emit_fn_t m_emit;
+    mode_t m_mode;
+    uint32_t m_baud_rate;
+    std::vector<uint8_t> m_flash;
+    std::map<uint32_t, uint32_t> m_regs;
+    std::map<uint32_t, uint8_t> m_ram;
+    uint32_t m_mem_cursor;
+    write_state_t m_write;
+    read_state_t m_read;
+    void *m_inflate;
+    uint64_t m_busy_until_ns;
+    uint64_t m_flash_busy_until_ns;
+    std::deque<uint64_t> m_rx_fifo;     /* Times the ROM reads the bytes waiting in its FIFO */
+    std::vector<uint8_t> m_frame;
+    bool m_frame_escape;
+    bool m_frame_invalid;
+    sim_stats_t m_stats;
+};
+
+class SimLink {
+public:
+    explicit SimLink(const sim_target_config_t &config);
+
+    /* Host side of the link, write blocks until the data is on the wire */
+    esp_loader_error_t write(const uint8_t *data, size_t size);
+    esp_loader_error_t read(uint8_t *data, size_t size, uint32_t timeout_ms);
+
+    void set_host_baud_rate(uint32_t baud_rate);
+    void set_bit_error_rates(double tx_bit_error_rate, double rx_bit_error_rate);
+    void reset_target(bool download_mode);
+    void advance_us(uint64_t us);
+
+    uint64_t now_us() const
+    {
+        return m_now_ns / 1000;
+    }
+    SimTarget &target()
+    {
+        return m_target;
+    }
+
+private:
+    struct timed_byte_t {
+        uint8_t value;
+        uint64_t ready_ns;
+    };
+
+    double byte_time_ns() const;
+    uint8_t inject_errors(uint8_t byte, double bit_error_rate);
+    void deliver_to_host(const std::vector<uint8_t> &payload, uint64_t time_ns);
+
+    sim_link_config_t m_config;
+    uint32_t m_host_baud_rate;
+    uint64_t m_now_ns;
+    uint64_t m_tx_free_ns;
+    uint64_t m_rx_free_ns;
+    std::deque<timed_byte_t> m_rx;
+    std::mt19937 m_rng;
+    SimTarget m_target;
+};
+
+/* Frames a response payload the way the target puts it on the wire */
+std::vector<uint8_t> sim_slip_encode(const std::vector<uint8_t> &payload);
+
+/* Accessors of the simulated port, defined in test_sim_port.cpp */
+void sim_port_configure(const sim_target_config_t &config);
+SimLink &sim_port_link();
@@ -0,0 +1,527 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "catch.hpp"
+#include "sim_target.h"
+#include "esp_loader.h"
+#include "esp_loader_io.h"
+#include "md5_hash.h"
+#include "sha256_hash.h"
+extern "C" {
+#include "protocol_prv.h"
+}
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+#if SIM_TARGET_DEFLATE
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+
+#define ESP_ERR_CHECK(exp) REQUIRE( (exp) == ESP_LOADER_SUCCESS )
+
+const uint32_t APP_START_ADDRESS = 0x10000;
+
+static vector<uint8_t> load_image()
+{
+    ifstream file(TEST_DATA_DIR "/hello-world.bin", ios::binary);
+    REQUIRE( file.is_open() );
+
+    return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static vector<uint8_t> image_sha256(const vector<uint8_t> &image)
+{
+    sha256_context_t context;
+    vector<uint8_t> digest(32);
+    sha256_init(&context);
+    sha256_update(&context, image.data(), image.size());
+    sha256_final(&context, digest.data());
+    return digest;
+}
+
+static void flash_image(const vector<uint8_t> &image, uint32_t block_size)
+{
+    ESP_ERR_CHECK( esp_loader_flash_start(APP_START_ADDRESS, image.size(), block_size) );
+
+    for (size_t written = 0; written < image.size(); written += block_size) {
+        const size_t to_write = min<size_t>(block_size, image.size() - written);
+        ESP_ERR_CHECK( esp_loader_flash_write((void *)&image[written], to_write) );
+    }
+}
+
+static bool flash_contains(const vector<uint8_t> &image)
+{
+    const vector<uint8_t> &flash = sim_port_link().target().flash();
+
+    return equal(image.begin(), image.end(), flash.begin() + APP_START_ADDRESS);
+}
+
+static bool sector_erased(const uint8_t *data, uint32_t size)
+{
+    return all_of(data, data + size, [](uint8_t byte) {
+        return byte == 0xFF;
+    });
+}
+
+/* Returns virtual time in microseconds spent flashing the image through the ROM loader */
+static uint64_t rom_flash_time_us(uint32_t baud_rate)
+{
+    sim_target_config_t config;
+    config.flash.sector_erase_us = 30000;
+    config.flash.sector_write_us = 10000;
+    sim_port_configure(config);
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    if (baud_rate != config.link.baud_rate) {
+        ESP_ERR_CHECK( esp_loader_change_transmission_rate(baud_rate) );
+        ESP_ERR_CHECK( loader_port_change_transmission_rate(baud_rate) );
+    }
+
+    const vector<uint8_t> image = load_image();
+    const uint64_t start_us = sim_port_link().now_us();
+    flash_image(image, 1024);
+
+    return sim_port_link().now_us() - start_us;
+}
+
+
+TEST_CASE( "Simulated target can be connected and detected", "[sim]" )
+{
+    const target_chip_t chips[] = { ESP32_CHIP, ESP32S3_CHIP, ESP32C3_CHIP };
+
+    for (target_chip_t chip : chips) {
+        sim_target_config_t config;
+        config.chip = chip;
+        sim_port_configure(config);
+
+        esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+        ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+        REQUIRE( esp_loader_get_target() == chip );
+
+        uint32_t flash_size = 0;
+        ESP_ERR_CHECK( esp_loader_flash_detect_size(&flash_size) );
+        REQUIRE( flash_size == config.flash.size );
+    }
+}
+
+TEST_CASE( "Simulated register sequences are pipelined", "[sim]" )
+{
+    // Round trips dominate, the wire itself takes no time
+    const uint32_t latency_us = 5000;
+    const uint64_t round_trip_us = 2 * latency_us;
+
+    sim_target_config_t config;
+    config.link.baud_limits_bandwidth = false;
+    config.link.latency_us = latency_us;
+    sim_port_configure(config);
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    SimLink &link = sim_port_link();
+    const uint64_t commands = link.target().stats().commands;
+
+    uint64_t start_us = link.now_us();
+    uint8_t mac[6];
+    ESP_ERR_CHECK( esp_loader_read_mac(mac) );
+    const uint8_t expected_mac[] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+    REQUIRE( memcmp(mac, expected_mac, sizeof(mac)) == 0 );
+    REQUIRE( link.now_us() - start_us < 2 * round_trip_us );
+
+    start_us = link.now_us();
+    uint32_t flash_size = 0;
+    ESP_ERR_CHECK( esp_loader_flash_detect_size(&flash_size) );
+    REQUIRE( flash_size == config.flash.size );
+    // A dozen register accesses, sent in a few batches
+    REQUIRE( link.target().stats().commands - commands >= 12 );
+    REQUIRE( link.now_us() - start_us < 4 * round_trip_us );
+
+    esp_loader_reg_op_t ops[] = {
+        { true, 0x3ff00100, 0x12345678 },
+        { false, 0x3ff00100, 0 },
+        { true, 0x3ff00100, 0xC0DBC0DB },   // Escaped on the wire
+        { false, 0x3ff00100, 0 },
+    };
+    ESP_ERR_CHECK( esp_loader_run_register_batch(ops, 4) );
+    REQUIRE( ops[1].value == 0x12345678 );
+    REQUIRE( ops[3].value == 0xC0DBC0DB );
+}
+
+TEST_CASE( "Simulated ROM loader can be flashed and verified", "[sim]" )
+{
+    sim_port_configure(sim_target_config_t());
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 1024);
+
+    REQUIRE( flash_contains(image) );
+    ESP_ERR_CHECK( esp_loader_flash_verify_sha256(image_sha256(image).data()) );
+
+    uint8_t read_back[100];
+    ESP_ERR_CHECK( esp_loader_flash_read(read_back, APP_START_ADDRESS + 10, sizeof(read_back)) );
+    REQUIRE( memcmp(read_back, &image[10], sizeof(read_back)) == 0 );
+}
+
+TEST_CASE( "Simulated stub can be loaded, flashed and read back", "[sim]" )
+{
+    sim_target_config_t config;
+    config.chip = ESP32S3_CHIP;
+    sim_port_configure(config);
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+    REQUIRE( sim_port_link().target().stub_running() );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 4096);
+
+    REQUIRE( flash_contains(image) );
+    ESP_ERR_CHECK( esp_loader_flash_verify_sha256(image_sha256(image).data()) );
+
+    vector<uint8_t> read_back(5000);
+    ESP_ERR_CHECK( esp_loader_flash_read(read_back.data(), APP_START_ADDRESS + 3, read_back.size()) );
+    REQUIRE( equal(read_back.begin(), read_back.end(), image.begin() + 3) );
+
+    esp_loader_reset_target();
+    REQUIRE_FALSE( sim_port_link().target().in_download_mode() );
+}
+
+TEST_CASE( "Simulated flash digests are read from ROM and stub", "[sim]" )
+{
+    sim_target_config_t config;
+    config.chip = ESP32C3_CHIP;
+    sim_port_configure(config);
+
+    const vector<uint8_t> image = load_image();
+    struct MD5Context context;
+    uint8_t expected[16];
+    MD5Init(&context);
+    MD5Update(&context, image.data(), image.size());
+    MD5Final(expected, &context);
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+    flash_image(image, 4096);
+
+    // The ROM answers in hex, the stub with the raw digest
+    uint8_t md5[16];
+    ESP_ERR_CHECK( esp_loader_flash_md5(APP_START_ADDRESS, image.size(), md5) );
+    REQUIRE( memcmp(md5, expected, sizeof(md5)) == 0 );
+
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+    REQUIRE( sim_port_link().target().stub_running() );
+    ESP_ERR_CHECK( esp_loader_flash_md5(APP_START_ADDRESS, image.size(), md5) );
+    REQUIRE( memcmp(md5, expected, sizeof(md5)) == 0 );
+
+    ESP_ERR_CHECK( esp_loader_flash_md5(APP_START_ADDRESS, image.size() - 4, md5) );
+    REQUIRE( memcmp(md5, expected, sizeof(md5)) != 0 );
+
+    esp_loader_reset_target();
+}
+
+TEST_CASE( "Simulated stub left running is reused", "[sim]" )
+{
+    sim_target_config_t config;
+    config.chip = ESP32S3_CHIP;
+    sim_port_configure(config);
+    const sim_stats_t &stats = sim_port_link().target().stats();
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+    const uint64_t stub_blocks = stats.command_count[MEM_DATA];
+    REQUIRE( stub_blocks > 0 );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 4096);
+
+    // The next job on the same target finds the stub and uploads nothing
+    ESP_ERR_CHECK( esp_loader_connect_reuse_stub(&connect_config) );
+    REQUIRE( sim_port_link().target().stub_running() );
+    REQUIRE( esp_loader_get_target() == ESP32S3_CHIP );
+    REQUIRE( stats.command_count[MEM_DATA] == stub_blocks );
+
+    flash_image(image, 4096);
+    REQUIRE( flash_contains(image) );
+    ESP_ERR_CHECK( esp_loader_flash_verify() );
+
+    // Once the application runs, the stub is uploaded again
+    esp_loader_reset_target();
+    ESP_ERR_CHECK( esp_loader_connect_reuse_stub(&connect_config) );
+    REQUIRE( stats.command_count[MEM_DATA] == 2 * stub_blocks );
+
+    // Without being asked to, the stub is never probed for and always uploaded anew
+    const uint64_t erase_regions = stats.command_count[ERASE_REGION];
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+    REQUIRE( stats.command_count[MEM_DATA] == 3 * stub_blocks );
+    REQUIRE( stats.command_count[ERASE_REGION] == erase_regions );
+
+    esp_loader_reset_target();
+}
+
+TEST_CASE( "Simulated ROM receive FIFO is never overrun", "[sim]" )
+{
+    // A slow ROM behind a long link, whatever is sent ahead of its responses waits in the FIFO
+    sim_target_config_t config;
+    config.rom_command_us = 2000;
+    config.link.baud_limits_bandwidth = false;
+    config.link.latency_us = 5000;
+    sim_port_configure(config);
+
+    SimLink &link = sim_port_link();
+    const sim_stats_t &stats = link.target().stats();
+
+    // The model loses what does not fit while the ROM is busy with a command
+    const vector<uint8_t> read_reg = { WRITE_DIRECTION, READ_REG, 4, 0, 0, 0, 0, 0, 0, 0x10, 0, 0x40 };
+    const vector<uint8_t> frame = sim_slip_encode(read_reg);
+    const vector<uint8_t> junk(200, 0x55);
+    ESP_ERR_CHECK( link.write(frame.data(), frame.size()) );
+    ESP_ERR_CHECK( link.write(junk.data(), junk.size()) );
+    REQUIRE( stats.fifo_overruns == junk.size() - config.rom_rx_fifo_size );
+
+    sim_port_configure(config);
+    const sim_stats_t &batch_stats = sim_port_link().target().stats();
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+    uint8_t mac[6];
+    ESP_ERR_CHECK( esp_loader_read_mac(mac) );
+    uint32_t flash_size = 0;
+    ESP_ERR_CHECK( esp_loader_flash_detect_size(&flash_size) );
+    REQUIRE( flash_size == config.flash.size );
+
+    // The stub blocks are far larger than the FIFO
+    esp_loader_reset_target();
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+    REQUIRE( sim_port_link().target().stub_running() );
+    REQUIRE( batch_stats.fifo_overruns == 0 );
+
+    esp_loader_reset_target();
+}
+
+TEST_CASE( "Simulated stub upload is faster than one command per round trip", "[sim]" )
+{
+    sim_target_config_t config;
+    config.rom_command_us = 1000;
+    config.link.latency_us = 2000;
+    sim_port_configure(config);
+
+    SimLink &link = sim_port_link();
+    const sim_stats_t &stats = link.target().stats();
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    const uint64_t commands = stats.commands;
+    const uint64_t bytes = stats.bytes_to_target + stats.bytes_to_host;
+    const uint64_t start_us = link.now_us();
+    ESP_ERR_CHECK( loader_run_stub(esp_loader_get_target()) );
+    const uint64_t time_us = link.now_us() - start_us;
+    REQUIRE( link.target().stub_running() );
+
+    // Sent one by one, every command and its response cross the wire before the next goes out
+    const uint64_t wire_us = (stats.bytes_to_target + stats.bytes_to_host - bytes) * 10 * 1000000 /
+                             config.link.baud_rate;
+    const uint64_t baseline_us = wire_us + (stats.commands - commands) *
+                                 (2 * config.link.latency_us + config.rom_command_us);
+
+    // Each block after the first of a segment overlaps the answer to the previous one
+    REQUIRE( time_us + 2 * config.link.latency_us <= baseline_us );
+
+    esp_loader_reset_target();
+}
+
+TEST_CASE( "Simulated SHA-256 verification catches wrong images and corrupted flash", "[sim]" )
+{
+    sim_target_config_t config;
+    config.chip = ESP32C3_CHIP;
+    sim_port_configure(config);
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 4096);
+
+    // Not the image the caller expects
+    vector<uint8_t> expected = image_sha256(image);
+    expected[0] ^= 0x01;
+    REQUIRE( esp_loader_flash_verify_sha256(expected.data()) == ESP_LOADER_ERROR_INVALID_DIGEST );
+
+    // The target finds its flash differing from the data it was sent, nothing is read back
+    flash_image(image, 4096);
+    sim_port_link().target().flash()[APP_START_ADDRESS + image.size() / 2] ^= 0x10;
+    const uint64_t bytes_to_host = sim_port_link().target().stats().bytes_to_host;
+    REQUIRE( esp_loader_flash_verify_sha256(image_sha256(image).data()) == ESP_LOADER_ERROR_INVALID_MD5 );
+    REQUIRE( sim_port_link().target().stats().bytes_to_host - bytes_to_host < 100 );
+
+    esp_loader_reset_target();
+}
+
+TEST_CASE( "Simulated flashing recovers from bit errors", "[sim]" )
+{
+    sim_port_configure(sim_target_config_t());
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    const vector<uint8_t> image = load_image();
+    ESP_ERR_CHECK( esp_loader_flash_start(APP_START_ADDRESS, image.size(), 1024) );
+
+    sim_port_link().set_bit_error_rates(2e-6, 0.0);
+    for (size_t written = 0; written < image.size(); written += 1024) {
+        const size_t to_write = min<size_t>(1024, image.size() - written);
+        ESP_ERR_CHECK( esp_loader_flash_write((void *)&image[written], to_write) );
+    }
+    sim_port_link().set_bit_error_rates(0.0, 0.0);
+
+    const sim_stats_t &stats = sim_port_link().target().stats();
+    REQUIRE( stats.bit_errors > 0 );
+    REQUIRE( stats.checksum_errors + stats.frames_dropped > 0 );
+    REQUIRE( flash_contains(image) );
+    ESP_ERR_CHECK( esp_loader_flash_verify() );
+}
+
+TEST_CASE( "Simulated erased regions are not transferred", "[sim]" )
+{
+    const uint32_t sector = 4096;
+    vector<uint8_t> image(64 * sector, 0xFF);
+    const vector<uint8_t> code = load_image();
+    copy(code.begin(), code.begin() + 16 * sector, image.begin());
+    fill(image.begin() + 60 * sector, image.begin() + 61 * sector, 0x5A);
+
+    const target_chip_t chips[] = { ESP32_CHIP, ESP32S3_CHIP };
+    for (target_chip_t chip : chips) {
+        sim_target_config_t config;
+        config.chip = chip;
+        sim_port_configure(config);
+        vector<uint8_t> &flash = sim_port_link().target().flash();
+        fill(flash.begin() + APP_START_ADDRESS, flash.begin() + APP_START_ADDRESS + image.size(), 0);
+
+        esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+        if (chip == ESP32S3_CHIP) {
+            ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+        } else {
+            ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+        }
+        const uint64_t bytes_before = sim_port_link().target().stats().bytes_to_target;
+
+        // Runs of erased sectors are erased, the rest is written
+        for (uint32_t start = 0; start < image.size();) {
+            const bool erased = sector_erased(&image[start], sector);
+            uint32_t end = start + sector;
+            while (end < image.size() && sector_erased(&image[end], sector) == erased) {
+                end += sector;
+            }
+
+            if (erased) {
+                ESP_ERR_CHECK( esp_loader_flash_erase_region(APP_START_ADDRESS + start, end - start) );
+            } else {
+                ESP_ERR_CHECK( esp_loader_flash_start(APP_START_ADDRESS + start, end - start, sector) );
+                for (uint32_t offset = start; offset < end; offset += sector) {
+                    ESP_ERR_CHECK( esp_loader_flash_write(&image[offset], sector) );
+                }
+                ESP_ERR_CHECK( esp_loader_flash_verify() );
+            }
+            start = end;
+        }
+
+        REQUIRE( flash_contains(image) );
+        REQUIRE( sim_port_link().target().stats().bytes_to_target - bytes_before < image.size() / 3 );
+        REQUIRE( esp_loader_flash_erase_region(APP_START_ADDRESS + 4, sector) == ESP_LOADER_ERROR_INVALID_PARAM );
+
+        esp_loader_reset_target();
+    }
+}
+
+TEST_CASE( "Simulated transfer time follows the link speed", "[sim]" )
+{
+    const uint64_t slow_us = rom_flash_time_us(115200);
+    const uint64_t fast_us = rom_flash_time_us(921600);
+
+    // Most of the time is spent on the wire at 115200 baud
+    REQUIRE( slow_us > 12000000 );
+    REQUIRE( fast_us < slow_us / 4 );
+}
+
+#if SIM_TARGET_DEFLATE
+TEST_CASE( "Simulated target accepts compressed data", "[sim]" )
+{
+    sim_port_configure(sim_target_config_t());
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    const vector<uint8_t> image = load_image();
+    uLongf compressed_size = compressBound(image.size());
+    vector<uint8_t> compressed(compressed_size);
+    REQUIRE( compress(compressed.data(), &compressed_size, image.data(), image.size()) == Z_OK );
+    compressed.resize(compressed_size);
+
+    const uint32_t block_size = 1024;
+    const uint32_t blocks = (compressed.size() + block_size - 1) / block_size;
+
+    flash_begin_command_t begin_cmd = {};
+    begin_cmd.common.command = FLASH_DEFL_BEGIN;
+    begin_cmd.common.size = sizeof(begin_cmd) - sizeof(command_common_t);
+    begin_cmd.erase_size = image.size();
+    begin_cmd.packet_count = blocks;
+    begin_cmd.packet_size = block_size;
+    begin_cmd.offset = APP_START_ADDRESS;
+
+    send_cmd_config begin_config = {};
+    begin_config.cmd = &begin_cmd;
+    begin_config.cmd_size = sizeof(begin_cmd);
+    loader_port_start_timer(10000);
+    ESP_ERR_CHECK( send_cmd(&begin_config) );
+
+    for (uint32_t block = 0; block < blocks; block++) {
+        const uint32_t offset = block * block_size;
+        const uint32_t size = min<uint32_t>(block_size, compressed.size() - offset);
+
+        uint8_t checksum = 0xEF;
+        for (uint32_t i = 0; i < size; i++) {
+            checksum ^= compressed[offset + i];
+        }
+
+        data_command_t data_cmd = {};
+        data_cmd.common.command = FLASH_DEFL_DATA;
+        data_cmd.common.size = sizeof(data_cmd) - sizeof(command_common_t) + size;
+        data_cmd.common.checksum = checksum;
+        data_cmd.data_size = size;
+        data_cmd.sequence_number = block;
+
+        send_cmd_config data_config = {};
+        data_config.cmd = &data_cmd;
+        data_config.cmd_size = sizeof(data_cmd);
+        data_config.data = &compressed[offset];
+        data_config.data_size = size;
+        loader_port_start_timer(10000);
+        ESP_ERR_CHECK( send_cmd(&data_config) );
+    }
+
+    REQUIRE( flash_contains(image) );
+    REQUIRE( sim_port_link().target().stats().command_count[FLASH_DEFL_DATA] == blocks );
+}
+#endif
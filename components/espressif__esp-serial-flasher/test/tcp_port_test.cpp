@@ -0,0 +1,394 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * End to end tests of port/tcp_port.c against a loopback stand-in of a serial server. The
+ * stand-in speaks either raw TCP or RFC 2217 and serves the simulated target, its DTR and RTS
+ * lines are wired to the target the same way as on development boards.
+ */
+
+#include "catch.hpp"
+#include "sim_target.h"
+#include "esp_loader.h"
+#include "tcp_port.h"
+#include "test_port.h"
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+
+#define ESP_ERR_CHECK(exp) REQUIRE( (exp) == ESP_LOADER_SUCCESS )
+
+const uint32_t APP_START_ADDRESS = 0x10000;
+
+const uint8_t IAC = 255, SB = 250, SE = 240, WILL = 251, WONT = 252, DO = 253;
+const uint8_t OPTION_TTYPE = 24, OPTION_COM_PORT = 44;
+const uint8_t SET_BAUDRATE = 1, SET_CONTROL = 5;
+const uint8_t DTR_ON = 8, DTR_OFF = 9, RTS_ON = 11, RTS_OFF = 12;
+
+class SerialServer {
+public:
+    SerialServer(const sim_target_config_t &config, bool rfc2217)
+        : m_rfc2217(rfc2217), m_stop(false), m_client(-1), m_baud_rate(0), m_dtr(false),
+          m_rts(false), m_refused_ttype(false),
+          m_target(config, [this](const vector<uint8_t> &payload, uint64_t) {
+        send(payload);
+    })
+    {
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE( m_listener >= 0 );
+
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        REQUIRE( bind(m_listener, (struct sockaddr *)&address, sizeof(address)) == 0 );
+        REQUIRE( listen(m_listener, 1) == 0 );
+        REQUIRE( getsockname(m_listener, (struct sockaddr *)&address, &length) == 0 );
+        m_port = ntohs(address.sin_port);
+
+        // Only the modem lines can bring the target into the download mode over RFC 2217
+        if (rfc2217) {
+            m_target.reset(false);
+        }
+
+        m_thread = thread(&SerialServer::serve, this);
+    }
+
+    ~SerialServer()
+    {
+        m_stop = true;
+        m_thread.join();
+        if (m_client >= 0) {
+            close(m_client);
+        }
+        close(m_listener);
+    }
+
+    uint16_t port() const
+    {
+        return m_port;
+    }
+    uint32_t baud_rate() const
+    {
+        return m_baud_rate;
+    }
+    bool refused_ttype() const
+    {
+        return m_refused_ttype;
+    }
+
+    vector<uint8_t> flash(uint32_t address, size_t size)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        const vector<uint8_t> &flash = m_target.flash();
+
+        return vector<uint8_t>(flash.begin() + address, flash.begin() + address + size);
+    }
+
+private:
+    enum state_t { STATE_DATA, STATE_IAC, STATE_OPTION, STATE_SB, STATE_SB_IAC };
+
+    void serve()
+    {
+        while (!m_stop && m_client < 0) {
+            struct pollfd fd = { m_listener, POLLIN, 0 };
+            if (poll(&fd, 1, 10) > 0) {
+                m_client = accept(m_listener, NULL, NULL);
+            }
+        }
+
+        if (m_rfc2217 && m_client >= 0) {
+            // An option the port does not know has to be refused
+            const uint8_t request[] = { IAC, DO, OPTION_TTYPE };
+            write_all(request, sizeof(request));
+        }
+
+        vector<uint8_t> buffer(65536);
+        while (!m_stop && m_client >= 0) {
+            struct pollfd fd = { m_client, POLLIN, 0 };
+            if (poll(&fd, 1, 10) <= 0) {
+                continue;
+            }
+
+            const ssize_t received = recv(m_client, buffer.data(), buffer.size(), 0);
+            if (received <= 0) {
+                break;
+            }
+
+            lock_guard<mutex> lock(m_mutex);
+            const uint64_t now_ns = chrono::duration_cast<chrono::nanoseconds>(
+                                        chrono::steady_clock::now().time_since_epoch()).count();
+            for (ssize_t i = 0; i < received; i++) {
+                if (m_rfc2217) {
+                    receive_telnet(buffer[i], now_ns);
+                } else {
+                    m_target.receive(buffer[i], now_ns);
+                }
+            }
+        }
+    }
+
+    void receive_telnet(uint8_t byte, uint64_t now_ns)
+    {
+        switch (m_state) {
+        case STATE_DATA:
+            if (byte == IAC) {
+                m_state = STATE_IAC;
+            } else {
+                m_target.receive(byte, now_ns);
+            }
+            break;
+        case STATE_IAC:
+            if (byte == IAC) {
+                m_target.receive(byte, now_ns);
+                m_state = STATE_DATA;
+            } else if (byte == SB) {
+                m_subnegotiation.clear();
+                m_state = STATE_SB;
+            } else if (byte >= WILL) {
+                m_verb = byte;
+                m_state = STATE_OPTION;
+            } else {
+                m_state = STATE_DATA;
+            }
+            break;
+        case STATE_OPTION:
+            if (m_verb == WONT && byte == OPTION_TTYPE) {
+                m_refused_ttype = true;
+            }
+            m_state = STATE_DATA;
+            break;
+        case STATE_SB:
+            if (byte == IAC) {
+                m_state = STATE_SB_IAC;
+            } else {
+                m_subnegotiation.push_back(byte);
+            }
+            break;
+        case STATE_SB_IAC:
+            if (byte == SE) {
+                handle_com_port_command();
+                m_state = STATE_DATA;
+            } else {
+                m_subnegotiation.push_back(byte);
+                m_state = STATE_SB;
+            }
+            break;
+        }
+    }
+
+    void handle_com_port_command()
+    {
+        const vector<uint8_t> &sb = m_subnegotiation;
+        if (sb.size() < 3 || sb[0] != OPTION_COM_PORT) {
+            return;
+        }
+
+        if (sb[1] == SET_BAUDRATE && sb.size() == 6) {
+            m_baud_rate = sb[2] << 24 | sb[3] << 16 | sb[4] << 8 | sb[5];
+        } else if (sb[1] == SET_CONTROL) {
+            const bool rts = m_rts;
+            if (sb[2] == DTR_ON || sb[2] == DTR_OFF) {
+                m_dtr = sb[2] == DTR_ON;
+            } else if (sb[2] == RTS_ON || sb[2] == RTS_OFF) {
+                m_rts = sb[2] == RTS_ON;
+            }
+
+            // RTS holds EN low, the target boots once it is released, IO0 is sampled from DTR
+            if (rts && !m_rts) {
+                m_target.reset(m_dtr);
+            }
+        }
+
+        // Servers acknowledge every command with the command code + 100
+        vector<uint8_t> answer = { IAC, SB, OPTION_COM_PORT, (uint8_t)(sb[1] + 100) };
+        answer.insert(answer.end(), sb.begin() + 2, sb.end());
+        answer.insert(answer.end(), { IAC, SE });
+        write_all(answer.data(), answer.size());
+    }
+
+    void send(const vector<uint8_t> &payload)
+    {
+        vector<uint8_t> encoded = sim_slip_encode(payload);
+
+        if (m_rfc2217) {
+            vector<uint8_t> escaped;
+            for (uint8_t byte : encoded) {
+                escaped.push_back(byte);
+                if (byte == IAC) {
+                    escaped.push_back(IAC);
+                }
+            }
+            encoded.swap(escaped);
+        }
+
+        write_all(encoded.data(), encoded.size());
+    }
+
+    void write_all(const uint8_t *data, size_t size)
+    {
+        for (size_t written = 0; written < size;) {
+            const ssize_t result = ::send(m_client, &data[written], size - written, MSG_NOSIGNAL);
+            if (result <= 0) {
+                return;
+            }
+            written += result;
+        }
+    }
+
+    bool m_rfc2217;
+    atomic<bool> m_stop;
+    int m_listener;
+    int m_client;
+    uint16_t m_port;
+    atomic<uint32_t> m_baud_rate;
+    bool m_dtr;
+    bool m_rts;
+    atomic<bool> m_refused_ttype;
+    state_t m_state = STATE_DATA;
+    uint8_t m_verb = 0;
+    vector<uint8_t> m_subnegotiation;
+    mutex m_mutex;
+    SimTarget m_target;
+    thread m_thread;
+};
+
+// Every test case starts its own server, nothing is shared between them
+esp_loader_error_t loader_port_test_init(const loader_serial_config_t *config)
+{
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_test_deinit()
+{
+}
+
+static vector<uint8_t> load_image()
+{
+    ifstream file(TEST_DATA_DIR "/hello-world.bin", ios::binary);
+    REQUIRE( file.is_open() );
+
+    return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static void flash_image(const vector<uint8_t> &image, uint32_t block_size)
+{
+    ESP_ERR_CHECK( esp_loader_flash_start(APP_START_ADDRESS, image.size(), block_size) );
+
+    for (size_t written = 0; written < image.size(); written += block_size) {
+        const size_t to_write = min<size_t>(block_size, image.size() - written);
+        ESP_ERR_CHECK( esp_loader_flash_write((void *)&image[written], to_write) );
+    }
+}
+
+
+TEST_CASE( "TCP port flashes over a raw connection", "[tcp_port]" )
+{
+    SerialServer server(sim_target_config_t(), false);
+
+    const loader_tcp_config_t config = {
+        .host = "127.0.0.1",
+        .port = server.port(),
+        .rfc2217 = false,
+    };
+    ESP_ERR_CHECK( loader_port_tcp_init(&config) );
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect(&connect_config) );
+
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 4096);
+
+    REQUIRE( server.flash(APP_START_ADDRESS, image.size()) == image );
+    ESP_ERR_CHECK( esp_loader_flash_verify() );
+
+    // A raw connection has no way to reach the UART settings of the server
+    REQUIRE( loader_port_change_transmission_rate(921600) == ESP_LOADER_ERROR_UNSUPPORTED_FUNC );
+
+    loader_port_tcp_deinit();
+}
+
+TEST_CASE( "TCP port resets the target and changes the baud rate over RFC 2217", "[tcp_port]" )
+{
+    sim_target_config_t sim_config;
+    sim_config.chip = ESP32C3_CHIP;
+    SerialServer server(sim_config, true);
+
+    const loader_tcp_config_t config = {
+        .host = "localhost",
+        .port = server.port(),
+        .rfc2217 = true,
+        .baudrate = 115200,
+    };
+    ESP_ERR_CHECK( loader_port_tcp_init(&config) );
+
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    ESP_ERR_CHECK( esp_loader_connect_with_stub(&connect_config) );
+    REQUIRE( server.baud_rate() == 115200 );
+    REQUIRE( server.refused_ttype() );
+
+    // 0x00FFFF00 checks the escaping of IAC inside the subnegotiation
+    const uint32_t baudrate = 0xFFFF00;
+    ESP_ERR_CHECK( esp_loader_change_transmission_rate_stub(115200, baudrate) );
+    ESP_ERR_CHECK( loader_port_change_transmission_rate(baudrate) );
+
+    // Flash contents are full of 0xFF, the IAC value, in both directions
+    const vector<uint8_t> image = load_image();
+    flash_image(image, 16384);
+    REQUIRE( server.flash(APP_START_ADDRESS, image.size()) == image );
+    REQUIRE( server.baud_rate() == baudrate );
+
+    vector<uint8_t> read_back(image.size() + 4096);
+    ESP_ERR_CHECK( esp_loader_flash_read(read_back.data(), APP_START_ADDRESS, read_back.size()) );
+    REQUIRE( equal(image.begin(), image.end(), read_back.begin()) );
+    REQUIRE( read_back.back() == 0xFF );
+
+    esp_loader_reset_target();
+    loader_port_tcp_deinit();
+}
+
+TEST_CASE( "TCP port reports unreachable servers", "[tcp_port]" )
+{
+    // Bound but not listening, so the connection is refused
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    REQUIRE( bind(sock, (struct sockaddr *)&address, sizeof(address)) == 0 );
+    REQUIRE( getsockname(sock, (struct sockaddr *)&address, &length) == 0 );
+
+    const loader_tcp_config_t config = {
+        .host = "127.0.0.1",
+        .port = ntohs(address.sin_port),
+        .rfc2217 = true,
+        .baudrate = 115200,
+        .connect_timeout_ms = 500,
+    };
+    REQUIRE( loader_port_tcp_init(&config) != ESP_LOADER_SUCCESS );
+
+    close(sock);
+}
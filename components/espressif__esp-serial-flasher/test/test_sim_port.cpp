@@ -0,0 +1,97 @@
+/* Copyright 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_loader_io.h"
+#include "test_port.h"
+#include "sim_target.h"
+
+#include <memory>
+
+using namespace std;
+
+static unique_ptr<SimLink> s_link;
+static uint64_t s_time_end_us;
+
+
+void sim_port_configure(const sim_target_config_t &config)
+{
+    s_link.reset(new SimLink(config));
+}
+
+SimLink &sim_port_link()
+{
+    return *s_link;
+}
+
+esp_loader_error_t loader_port_test_init(const loader_serial_config_t *config)
+{
+    sim_port_configure(sim_target_config_t());
+
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_test_deinit()
+{
+    s_link.reset();
+}
+
+
+esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return s_link->write(data, size);
+}
+
+esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    return s_link->read(data, size, timeout);
+}
+
+esp_loader_error_t loader_port_change_transmission_rate(uint32_t transmission_rate)
+{
+    s_link->set_host_baud_rate(transmission_rate);
+
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_enter_bootloader()
+{
+    // Same hold times as the hardware ports
+    s_link->reset_target(true);
+    s_link->advance_us(SERIAL_FLASHER_RESET_HOLD_TIME_MS * 1000ULL);
+    s_link->advance_us(SERIAL_FLASHER_BOOT_HOLD_TIME_MS * 1000ULL);
+}
+
+void loader_port_reset_target()
+{
+    s_link->reset_target(false);
+    s_link->advance_us(SERIAL_FLASHER_RESET_HOLD_TIME_MS * 1000ULL);
+}
+
+void loader_port_delay_ms(uint32_t ms)
+{
+    s_link->advance_us(ms * 1000ULL);
+}
+
+void loader_port_start_timer(uint32_t ms)
+{
+    s_time_end_us = s_link->now_us() + ms * 1000ULL;
+}
+
+uint32_t loader_port_remaining_time(void)
+{
+    const uint64_t now_us = s_link->now_us();
+
+    return now_us < s_time_end_us ? (uint32_t)((s_time_end_us - now_us + 999) / 1000) : 0;
+}
@@ -2,87 +2,358 @@
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/event_groups.h>
 #include <dirent.h>
 #include <string.h>
+#include <strings.h>
+#include <esp_timer.h>
+#include <esp_task_wdt.h>
 #include "encoder.h"
 #include "display.h"
 #include "card_reader.h"
 #include "esp32_usb_cdc_acm_port.h"
 #include "esp_loader.h"
+#include "esfpkg.h"
+#include "mbedtls/sha256.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 #define ESPRESSIF_VID 0x303a
 #define ESP_SERIAL_JTAG_PID 0x1001
 
+#define UI_EVENT_QUEUE_LEN 16
+#define FLASH_JOB_QUEUE_LEN 1
+// Below the USB host library (20) and the CDC-ACM driver (19) tasks it feeds, above everything else
+#define FLASH_TASK_PRIORITY 10
+#define FLASH_TASK_CORE 1
+#define FLASH_SECTOR_SIZE 4096
+// Extra watchdog time for single loader calls: connecting, and erasing or hashing per MB of flash
+#define FLASH_WDT_CONNECT_MS 10000
+#define FLASH_WDT_MS_PER_MB 10000
+#define FLASH_WDT_SIZE_MS(size) ((uint32_t)(((uint64_t)(size) * FLASH_WDT_MS_PER_MB) >> 20))
+#define CARD_DETECT_DEBOUNCE_MS 100
+// Spins faster than these, in detents per second, move the selection by 2 and 4 entries per detent
+#define ENCODER_FAST_VELOCITY 15
+#define ENCODER_FASTER_VELOCITY 30
+// Set in s_boot_events once the display and LVGL can be used
+#define BOOT_DISPLAY_READY BIT0
+
 static const char *TAG = "ESF_DEMO";
 static TaskHandle_t usbConnectTaskHandle = NULL;
+static TaskHandle_t cardMountTaskHandle = NULL;
 
 typedef struct {
     bool device_connected;
     bool card_mounted;
 } device_state_t;
 
-static esp_loader_error_t flash_binary(FILE *bin_file, size_t size, size_t address, const char *file_name)
+typedef enum {
+    UI_EVENT_DEVICE_CONNECTED,
+    UI_EVENT_DEVICE_DISCONNECTED,
+    UI_EVENT_CARD_MOUNTED,
+    UI_EVENT_CARD_REMOVED,
+    UI_EVENT_ENCODER,
+    UI_EVENT_FLASH_DONE,
+} ui_event_type_t;
+
+typedef struct {
+    ui_event_type_t type;
+    union {
+        encoder_t encoder;
+        esp_loader_error_t flash_result;
+    };
+} ui_event_t;
+
+typedef struct {
+    char name[CARD_READER_NAME_MAX];    // Project directory or bundle in the root of the card
+} flash_job_t;
+
+// Everything ui_task reacts to arrives here, so it sleeps while nothing happens
+static QueueHandle_t s_ui_events;
+// Jobs for flash_task, the UI only submits them and shows the result
+static QueueHandle_t s_flash_jobs;
+// Written before the corresponding event is posted, so a dropped event loses no state
+static volatile bool s_device_connected;
+static volatile bool s_card_mounted;
+// Peripherals come up in parallel at boot, the tasks using the display wait for it here
+static EventGroupHandle_t s_boot_events;
+
+// Milliseconds since reset, so the boot phases can be compared across restarts
+static void boot_phase_log(const char *phase)
+{
+    ESP_LOGI(TAG, "Boot: %s at %"PRId64" ms", phase, esp_timer_get_time() / 1000);
+}
+
+static void ui_event_post(const ui_event_t *event)
+{
+    if (xPortInIsrContext()) {
+        BaseType_t high_task_wakeup = pdFALSE;
+        xQueueSendFromISR(s_ui_events, event, &high_task_wakeup);
+        portYIELD_FROM_ISR(high_task_wakeup);
+    } else {
+        xQueueSend(s_ui_events, event, 0);
+    }
+}
+
+// Hands out the next part of an image, size is zero at its end
+typedef esp_err_t (*image_source_cb_t)(void *ctx, const uint8_t **data, size_t *size);
+
+// Tells whether the image read so far is the expected one
+typedef bool (*image_check_cb_t)(void *ctx);
+
+// Keeps what is left of a part, so blocks can be cut from it
+typedef struct {
+    image_source_cb_t read;
+    image_check_cb_t check;     // Optional, called once the whole image is read
+    void *ctx;
+    const uint8_t *data;
+    size_t size;
+} image_stream_t;
+
+static esp_err_t stream_read(image_stream_t *stream, size_t max_size, const uint8_t **data, size_t *size)
+{
+    if (stream->size == 0) {
+        esp_err_t ret = stream->read(stream->ctx, &stream->data, &stream->size);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    *data = stream->data;
+    *size = MIN(max_size, stream->size);
+    stream->data += *size;
+    stream->size -= *size;
+    return ESP_OK;
+}
+
+/* Feeds the task watchdog and sets its timeout to the configured one plus extra_ms, so that
+   single loader calls blocking for longer stay supervised. Reset with extra_ms 0 after them */
+static void flash_wdt_allow(uint32_t extra_ms)
+{
+    esp_task_wdt_config_t config = {
+        .timeout_ms = CONFIG_ESP_TASK_WDT_TIMEOUT_S * 1000 + extra_ms,
+        .idle_core_mask = 0,
+        .trigger_panic = false,
+    };
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+    config.idle_core_mask |= BIT(0);
+#endif
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+    config.idle_core_mask |= BIT(1);
+#endif
+#if CONFIG_ESP_TASK_WDT_PANIC
+    config.trigger_panic = true;
+#endif
+    ESP_ERROR_CHECK(esp_task_wdt_reconfigure(&config));
+    esp_task_wdt_reset();
+}
+
+static esp_loader_error_t flash_binary(image_stream_t *stream, size_t size, size_t address, const char *name)
 {
     esp_loader_error_t err;
-    static uint8_t payload[1024];
+    // Collects the parts of blocks that span chunk boundaries, full blocks are written from the chunk
+    static uint8_t block[1024];
+    size_t block_fill = 0;
 
     ESP_LOGI(TAG, "Erasing flash, please wait...");
-    screen_set(FLASHER, "Erasing flash,\nplease wait...");
-    err = esp_loader_flash_start(address, size, sizeof(payload));
+    flasher_screen_text("Erasing flash,\nplease wait...");
+    flasher_screen_progress(0);
+    flash_wdt_allow(FLASH_WDT_SIZE_MS(size));
+    err = esp_loader_flash_start(address, (size + 3) & ~3, sizeof(block));
+    flash_wdt_allow(0);
     if (err != ESP_LOADER_SUCCESS) {
         ESP_LOGI(TAG, "Failed to erase flash");
         return err;
     }
 
-    // Extract name from file which might look like "0x12345678_name.bin"
-    char *name_start = strchr(file_name, '_');
-    char name[32] = {0};
-    if (name_start) {
-        for (int i = 1; i < 32; i++) {
-            if (name_start[i] == '.') {
-                break;
-            }
-            name[i - 1] = name_start[i];
-        }
-    }
-
     char text[64];
     snprintf(text, sizeof(text), "Flashing...\n %s", name);
     ESP_LOGI(TAG, "Flashing %s", name);
-    screen_set(FLASHER, text);
-    size_t written = 0;
-    while (written < size) {
-        size_t read_bytes = fread(payload, sizeof(uint8_t), sizeof(payload), bin_file);
-        err = esp_loader_flash_write(payload, read_bytes);
-        if (err != ESP_LOADER_SUCCESS) {
-            return err;
+    flasher_screen_text(text);
+    size_t received = 0;
+    while (received < size) {
+        const uint8_t *chunk;
+        size_t chunk_size;
+        if (stream_read(stream, size - received, &chunk, &chunk_size) != ESP_OK || chunk_size == 0) {
+            ESP_LOGE(TAG, "Failed to read %s", name);
+            return ESP_LOADER_ERROR_FAIL;
+        }
+        received += chunk_size;
+
+        // Before the last part is written, an image failing its check is erased again
+        if (received == size && stream->check != NULL && !stream->check(stream->ctx)) {
+            ESP_LOGE(TAG, "%s does not match its digest, erasing it", name);
+            const uint32_t start = address & ~(FLASH_SECTOR_SIZE - 1);
+            const uint32_t end = (address + size + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+            flash_wdt_allow(FLASH_WDT_SIZE_MS(end - start));
+            esp_loader_flash_erase_region(start, end - start);
+            flash_wdt_allow(0);
+            return ESP_LOADER_ERROR_INVALID_DIGEST;
         }
 
-        written += read_bytes;
+        while (chunk_size > 0) {
+            if (block_fill == 0 && chunk_size >= sizeof(block)) {
+                err = esp_loader_flash_write((void *)chunk, sizeof(block));
+                if (err != ESP_LOADER_SUCCESS) {
+                    return err;
+                }
+                chunk += sizeof(block);
+                chunk_size -= sizeof(block);
+                continue;
+            }
+
+            size_t part = MIN(sizeof(block) - block_fill, chunk_size);
+            memcpy(&block[block_fill], chunk, part);
+            block_fill += part;
+            chunk += part;
+            chunk_size -= part;
+
+            // Only the last block of the image may be shorter, esp_loader_flash_write() pads it in place
+            if (block_fill == sizeof(block) || (received == size && chunk_size == 0)) {
+                err = esp_loader_flash_write(block, block_fill);
+                if (err != ESP_LOADER_SUCCESS) {
+                    return err;
+                }
+                block_fill = 0;
+            }
+        }
 
-        uint8_t progress = (uint8_t)(((float)written / size) * 100);
+        uint8_t progress = (uint8_t)(((float)received / size) * 100);
         flasher_screen_progress(progress);
-        vTaskDelay(1 / portTICK_PERIOD_MS); // Yield to watchdog reset
+        esp_task_wdt_reset();
     };
+    flash_wdt_allow(FLASH_WDT_SIZE_MS(size));
     err = esp_loader_flash_verify();
+    flash_wdt_allow(0);
     if (err != ESP_LOADER_SUCCESS) {
         return err;
     }
     return ESP_LOADER_SUCCESS;
 }
 
+static esp_loader_error_t erase_extent(uint32_t address, uint32_t size, const char *name)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "Erasing...\n %s", name);
+    ESP_LOGI(TAG, "Erasing %"PRIu32" bytes of %s at 0x%"PRIx32"", size, name, address);
+    flasher_screen_text(text);
+    flash_wdt_allow(FLASH_WDT_SIZE_MS(size));
+    esp_loader_error_t err = esp_loader_flash_erase_region(address, size);
+    flash_wdt_allow(0);
+    return err;
+}
+
+static esp_err_t file_source(void *ctx, const uint8_t **data, size_t *size)
+{
+    return card_reader_image_read(ctx, data, size);
+}
+
+typedef struct {
+    esfpkg_t *pkg;
+    uint32_t index;
+    mbedtls_sha256_context sha256;  // Of the payload handed out so far
+} bundle_image_t;
+
+static esp_err_t bundle_source(void *ctx, const uint8_t **data, size_t *size)
+{
+    bundle_image_t *image = ctx;
+    esp_err_t ret = esfpkg_read_payload(image->pkg, image->index, data, size);
+    if (ret == ESP_OK && *size > 0) {
+        mbedtls_sha256_update(&image->sha256, *data, *size);
+    }
+    return ret;
+}
+
+// The target only confirms what it was sent, the card could have handed out corrupted data
+static bool bundle_check(void *ctx)
+{
+    bundle_image_t *image = ctx;
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&image->sha256, digest);
+    return memcmp(digest, esfpkg_get_image(image->pkg, image->index)->sha256, sizeof(digest)) == 0;
+}
+
+static esp_loader_error_t flash_bundle(const char *file_name)
+{
+    size_t path_len = strlen(MOUNT_POINT) + 1 + strlen(file_name) + 1;
+    char path[path_len];
+    snprintf(path, sizeof(path), "%s/%s", MOUNT_POINT, file_name);
+
+    card_reader_image_t *file;
+    if (card_reader_image_open(path, &file) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open bundle %s", file_name);
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    // The manifest is verified here, the payloads follow in a single pass over the file
+    esfpkg_t *pkg;
+    if (esfpkg_open(file_source, file, &pkg) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid bundle %s", file_name);
+        card_reader_image_close(file);
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    esp_loader_error_t err = ESP_LOADER_SUCCESS;
+    const esfpkg_header_t *header = esfpkg_get_header(pkg);
+    if (header->chip != esp_loader_get_target()) {
+        ESP_LOGE(TAG, "Bundle %s is built for another chip", file_name);
+        err = ESP_LOADER_ERROR_UNSUPPORTED_CHIP;
+    }
+
+    for (uint32_t i = 0; err == ESP_LOADER_SUCCESS && i < header->image_count; i++) {
+        const esfpkg_image_t *image = esfpkg_get_image(pkg, i);
+        if (image->flags & ESFPKG_IMAGE_DEFLATE) {
+            ESP_LOGE(TAG, "Compressed image %s is not supported", image->name);
+            err = ESP_LOADER_ERROR_UNSUPPORTED_FUNC;
+            break;
+        }
+
+        if (image->flags & ESFPKG_IMAGE_ERASED) {
+            err = erase_extent(image->address, image->size, image->name);
+            continue;
+        }
+
+        bundle_image_t source = { .pkg = pkg, .index = i };
+        mbedtls_sha256_init(&source.sha256);
+        mbedtls_sha256_starts(&source.sha256, 0);
+        image_stream_t stream = { .read = bundle_source, .check = bundle_check, .ctx = &source };
+        ESP_LOGI(TAG, "Flashing %s to address 0x%"PRIx32"", image->name, image->address);
+        err = flash_binary(&stream, image->size, image->address, image->name);
+        mbedtls_sha256_free(&source.sha256);
+        if (err != ESP_LOADER_SUCCESS) {
+            ESP_LOGE(TAG, "Failed to flash %s", image->name);
+        }
+    }
+
+    esfpkg_close(pkg);
+    card_reader_image_close(file);
+    return err;
+}
+
 static esp_loader_error_t flash_process(const char *proj_name)
 {
     esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
-    if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS) {
+    flash_wdt_allow(FLASH_WDT_CONNECT_MS);
+    esp_loader_error_t connect_err = esp_loader_connect(&connect_config);
+    flash_wdt_allow(0);
+    if (connect_err != ESP_LOADER_SUCCESS) {
         ESP_LOGE(TAG, "Failed to connect to the device");
         return ESP_LOADER_ERROR_FAIL;
     }
     
     esp_loader_error_t err = ESP_LOADER_SUCCESS;
 
+    const size_t name_len = strlen(proj_name);
+    if (name_len > strlen(BUNDLE_EXTENSION) &&
+            strcasecmp(&proj_name[name_len - strlen(BUNDLE_EXTENSION)], BUNDLE_EXTENSION) == 0) {
+        err = flash_bundle(proj_name);
+        if (err == ESP_LOADER_SUCCESS) {
+            esp_loader_reset_target();
+        }
+        return err;
+    }
+
     uint8_t dir_path_len = strlen(MOUNT_POINT) + 1 + strlen(proj_name) + 1; // +1 for '/' and +1 for null terminator
     char full_dir_path[dir_path_len];
     snprintf(full_dir_path, sizeof(full_dir_path), "%s/%s", MOUNT_POINT, proj_name);
@@ -135,22 +406,29 @@ static esp_loader_error_t flash_process(const char *proj_name)
         }
         snprintf(path_buffer, path_len, "%s/%s", full_dir_path, filename);
         
-        FILE *file = fopen(path_buffer, "rb");
+        // Extract name from file which might look like "0x12345678_name.bin"
+        char name[32] = {0};
+        for (int i = 1; i < 32; i++) {
+            if (underscore_pos[i] == '.' || underscore_pos[i] == '\0') {
+                break;
+            }
+            name[i - 1] = underscore_pos[i];
+        }
+
+        // Sparse images are flashed from bundles, whose manifest lists the erased sectors
+        card_reader_image_t *image;
+        esp_err_t ret = card_reader_image_open(path_buffer, &image);
         free(path_buffer);
 
-        if (file == NULL) {
+        if (ret != ESP_OK) {
             ESP_LOGW(TAG, "Failed to open file %s", filename);
             continue;
         }
 
-        // Get file size
-        fseek(file, 0, SEEK_END);
-        size_t file_size = ftell(file);
-        fseek(file, 0, SEEK_SET);  // Reset file position for reading
-
         ESP_LOGI(TAG, "Flashing %s to address 0x%"PRIx32"", filename, address);
-        err = flash_binary(file, file_size, address, filename);
-        fclose(file);
+        image_stream_t stream = { .read = file_source, .ctx = image };
+        err = flash_binary(&stream, card_reader_image_size(image), address, name);
+        card_reader_image_close(image);
         
         if (err != ESP_LOADER_SUCCESS) {
             ESP_LOGE(TAG, "Failed to flash %s", filename);
@@ -168,6 +446,27 @@ static esp_loader_error_t flash_process(const char *proj_name)
     return err;
 }
 
+static void flash_task(void *arg)
+{
+    while (1) {
+        flash_job_t job;
+        xQueueReceive(s_flash_jobs, &job, portMAX_DELAY);
+        // Shown once per job, the images of the job only change the text and the progress
+        screen_set(FLASHER, "Connecting...");
+
+        // Fed once per chunk and around the long loader calls, only watched while a job runs
+        ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+        const ui_event_t event = {
+            .type = UI_EVENT_FLASH_DONE,
+            .flash_result = flash_process(job.name),
+        };
+        ESP_ERROR_CHECK(esp_task_wdt_delete(NULL));
+
+        // The UI waits for exactly this event, so it must not be dropped
+        xQueueSend(s_ui_events, &event, portMAX_DELAY);
+    }
+}
+
 static void usb_lib_task(void *arg)
 {
     while (1) {
@@ -186,6 +485,9 @@ static void usb_lib_task(void *arg)
 
 static void device_disconnected_callback(void)
 {
+    s_device_connected = false;
+    const ui_event_t event = { .type = UI_EVENT_DEVICE_DISCONNECTED };
+    ui_event_post(&event);
     xTaskResumeFromISR(usbConnectTaskHandle);
 }
 
@@ -217,6 +519,7 @@ static void usb_connect_task(void *arg)
     };
     ESP_LOGI(TAG, "Installing the USB CDC-ACM driver");
     ESP_ERROR_CHECK(cdc_acm_host_install(&cdc_acm_driver_config));
+    boot_phase_log("USB host ready");
 
     while (1) {
         const loader_esp32_usb_cdc_acm_config_t config = {
@@ -231,23 +534,54 @@ static void usb_connect_task(void *arg)
         if (loader_port_esp32_usb_cdc_acm_init(&config) != ESP_LOADER_SUCCESS) {
             continue;
         }
+        s_device_connected = true;
+        const ui_event_t event = { .type = UI_EVENT_DEVICE_CONNECTED };
+        ui_event_post(&event);
         vTaskSuspend(NULL);
+
+        // Resumed by the disconnect callback, the port is closed here rather than from the callback
+        while (loader_port_esp32_usb_cdc_acm_deinit() != ESP_LOADER_SUCCESS) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
     }
 }
 
-static device_state_t check_device_state(void)
+static void encoder_event_callback(encoder_t enc, void *arg)
 {
-    device_state_t state = {0};
-    if (eTaskGetState(usbConnectTaskHandle) == eSuspended) {
-        state.device_connected = true;
+    const ui_event_t event = { .type = UI_EVENT_ENCODER, .encoder = enc };
+    ui_event_post(&event);
+}
+
+static device_state_t get_device_state(void)
+{
+    device_state_t state = {
+        .device_connected = s_device_connected,
+        .card_mounted = s_card_mounted,
+    };
+    return state;
+}
+
+static int32_t encoder_steps(int32_t delta, uint32_t velocity)
+{
+    if (velocity >= ENCODER_FASTER_VELOCITY) {
+        return delta * 4;
+    } else if (velocity >= ENCODER_FAST_VELOCITY) {
+        return delta * 2;
     }
+    return delta;
+}
 
-    DIR *dir = opendir(MOUNT_POINT);
-    if (dir != NULL) {
-        closedir(dir);
-        state.card_mounted = true;
+static void show_device_state(const device_state_t *state)
+{
+    if (state->device_connected && state->card_mounted) {
+        screen_set(SELECTOR, 0);
+    } else if (!state->device_connected && !state->card_mounted) {
+        screen_set(NOT_READY, "Insert SD card\nand connect a device.");
+    } else if (!state->card_mounted) {
+        screen_set(NOT_READY, "Insert SD card");
+    } else if (!state->device_connected) {
+        screen_set(NOT_READY, "Check device connection\nor connect a device.");
     }
-    return state;
 }
 
 static void ui_task(void *pvParameter)
@@ -256,68 +590,177 @@ static void ui_task(void *pvParameter)
         .encoder_a_pin = 40,
         .encoder_b_pin = 41,
         .encoder_btn_pin = 42,
+        .event_cb = encoder_event_callback,
     };
     encoder_init(&enc_config);
 
+    device_state_t state = get_device_state();
+    show_device_state(&state);
+    // Long press switches between moving by one entry and jumping between first letters
+    bool letter_mode = false;
+    enum {
+        UI_SELECTING,
+        UI_FLASHING,    // flash_task works on the submitted job
+        UI_RESULT,      // The result stays on screen until the next click
+    } ui_state = UI_SELECTING;
+    // The rest of the press that dismissed a result must not start a job or switch modes
+    bool ignore_press = false;
+
     while (1) {
-        device_state_t state = check_device_state();
-        if (state.device_connected && state.card_mounted) {
-            screen_set(SELECTOR, 0);
-            encoder_t enc = encoder_get_value();
-            switch (enc) {
-            case ENCODER_MOVE_LEFT:
-                selector_roller_change(UP);
-                break;
-            case ENCODER_MOVE_RIGHT:
-                selector_roller_change(DOWN);
+        ui_event_t event;
+        xQueueReceive(s_ui_events, &event, portMAX_DELAY);
+        state = get_device_state();
+
+        if (event.type == UI_EVENT_CARD_MOUNTED && letter_mode) {
+            letter_mode = false;
+            selector_screen_set_letter_mode(false);
+        }
+
+        if (event.type == UI_EVENT_FLASH_DONE) {
+            if (event.flash_result != ESP_LOADER_SUCCESS) {
+                screen_set(FLASH_ERROR, "Failed to flash");
+            } else {
+                screen_set(FLASH_SUCCESS, "Done!");
+            }
+            ui_state = UI_RESULT;
+            continue;
+        }
+
+        // A device or card lost during a job makes the job fail, which is shown first
+        if (ui_state == UI_FLASHING) {
+            continue;
+        }
+
+        if (ui_state == UI_RESULT) {
+            if (event.type == UI_EVENT_ENCODER && event.encoder == ENCODER_PRESSED) {
+                ui_state = UI_SELECTING;
+                ignore_press = true;
+                // Turns made while the job ran are not meant for the selector
+                encoder_take_delta(NULL);
+                show_device_state(&state);
+            }
+            continue;
+        }
+
+        if (event.type != UI_EVENT_ENCODER) {
+            show_device_state(&state);
+            continue;
+        }
+
+        if (!state.device_connected || !state.card_mounted) {
+            continue;
+        }
+
+        switch (event.encoder) {
+        case ENCODER_MOVE_LEFT:
+        case ENCODER_MOVE_RIGHT: {
+            // Takes all detents turned so far, the events of the rest of them find nothing left
+            uint32_t velocity;
+            int32_t delta = encoder_take_delta(&velocity);
+            if (delta == 0) {
                 break;
-            case ENCODER_CLICKED:
-                char buf[32];
-                screen_set(FLASHER, 0);
-                selector_screen_get_selected(buf, sizeof(buf));
-                if (flash_process(buf) != ESP_LOADER_SUCCESS) {
-                    screen_set(FLASH_ERROR, "Failed to flash");
-                } else {
-                    screen_set(FLASH_SUCCESS, "Done!");
-                }
-                while (encoder_get_value() != ENCODER_CLICKED) {
-                    vTaskDelay(10 / portTICK_PERIOD_MS);
+            }
+            if (letter_mode) {
+                uint32_t selected = selector_screen_get_selected_index();
+                for (; delta != 0; delta += delta > 0 ? -1 : 1) {
+                    selected = card_reader_index_next_group(selected, delta > 0);
                 }
+                selector_screen_select(selected);
+            } else {
+                selector_roller_move(encoder_steps(delta, velocity));
+            }
+            break;
+        }
+        case ENCODER_PRESSED:
+            ignore_press = false;
+            break;
+        case ENCODER_LONG_PRESSED:
+            if (ignore_press) {
+                break;
+            }
+            letter_mode = !letter_mode;
+            selector_screen_set_letter_mode(letter_mode);
+            break;
+        case ENCODER_CLICKED:
+            if (ignore_press) {
+                ignore_press = false;
+                break;
+            }
+            if (letter_mode) {
+                letter_mode = false;
+                selector_screen_set_letter_mode(false);
                 break;
-            default:
+            }
+
+            flash_job_t job;
+            selector_screen_get_selected(job.name, sizeof(job.name));
+            if (job.name[0] == '\0') {
                 break;
             }
-        } else if (!state.device_connected && !state.card_mounted) {
-            screen_set(NOT_READY, "Insert SD card\nand connect a device.");
-        } else if (!state.card_mounted) {
-            screen_set(NOT_READY, "Insert SD card");
-        } else if (!state.device_connected) {
-            screen_set(NOT_READY, "Check device connection\nor connect a device.");
+            // Only one job is in flight at a time, so the queue always has room
+            xQueueSend(s_flash_jobs, &job, portMAX_DELAY);
+            ui_state = UI_FLASHING;
+            break;
+        default:
+            break;
         }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
 }
 
+static esp_err_t selector_entry(uint32_t index, char *buf, size_t buf_size, void *arg)
+{
+    return card_reader_index_get(index, buf, buf_size);
+}
+
+static void card_detect_callback(void *arg)
+{
+    BaseType_t high_task_wakeup = pdFALSE;
+    vTaskNotifyGiveFromISR(cardMountTaskHandle, &high_task_wakeup);
+    portYIELD_FROM_ISR(high_task_wakeup);
+}
+
 static void card_mount_task(void *arg)
 {
     enum {
         SD_CARD_INSERTED,
         SD_CARD_REMOVED
     } static card_state = SD_CARD_REMOVED;
+
+    // The card detect interrupt notifies this task, so the reader is brought up from here
+    card_reader_init(arg);
+    boot_phase_log("SD card reader ready");
+    xTaskNotifyGive(xTaskGetCurrentTaskHandle()); // The card might already be inserted
+
     while (1) {
+        // Sleep until the card detect pin changes, then let it settle
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        do {
+            vTaskDelay(CARD_DETECT_DEBOUNCE_MS / portTICK_PERIOD_MS);
+        } while (ulTaskNotifyTake(pdTRUE, 0) != 0);
+
         if (card_reader_is_card_inserted() && card_state == SD_CARD_REMOVED) {
             card_state = SD_CARD_INSERTED;
             ESP_ERROR_CHECK(card_reader_mount(MOUNT_POINT));
             ESP_LOGI(TAG, "SD card inserted");
-            char *entries = card_reader_get_entries(MOUNT_POINT);
-            selector_screen_set_options(entries);
-            card_reader_free_entries(entries);
+            uint32_t entry_count = 0;
+            if (card_reader_index_build(MOUNT_POINT, &entry_count) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to index the SD card");
+            }
+            // At boot, the card can be indexed before the display is up
+            xEventGroupWaitBits(s_boot_events, BOOT_DISPLAY_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+            selector_screen_set_entries(entry_count, selector_entry, NULL);
+            boot_phase_log("SD card mounted");
+            s_card_mounted = true;
+            const ui_event_t event = { .type = UI_EVENT_CARD_MOUNTED };
+            ui_event_post(&event);
         } else if (!card_reader_is_card_inserted() && card_state == SD_CARD_INSERTED) {
             card_state = SD_CARD_REMOVED;
             ESP_ERROR_CHECK(card_reader_unmount(MOUNT_POINT));
             ESP_LOGI(TAG, "SD card removed");
+            s_card_mounted = false;
+            const ui_event_t event = { .type = UI_EVENT_CARD_REMOVED };
+            ui_event_post(&event);
         }
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 }
 
@@ -334,6 +777,26 @@ void hourly_reset_callback(TimerHandle_t xTimer) {
 
 void app_main(void)
 {
+    boot_phase_log("app_main");
+
+    s_ui_events = xQueueCreate(UI_EVENT_QUEUE_LEN, sizeof(ui_event_t));
+    s_flash_jobs = xQueueCreate(FLASH_JOB_QUEUE_LEN, sizeof(flash_job_t));
+    s_boot_events = xEventGroupCreate();
+
+    /* The USB host and the card reader only post events until the UI runs, so they come up on
+       core 1 while the display is brought up on this core */
+    xTaskCreatePinnedToCore(usb_connect_task, "usb_connect", 4096, NULL, 1, &usbConnectTaskHandle, 1);
+
+    static card_reader_config_t card_reader_config = {
+        .host = SPI2_HOST,
+        .pin_num_miso = 13,
+        .pin_num_mosi = 15,
+        .pin_num_clk = 1,
+        .pin_num_cd = 2,
+        .detect_cb = card_detect_callback,
+    };
+    xTaskCreatePinnedToCore(card_mount_task, "card_mount", 4096, &card_reader_config, 3, &cardMountTaskHandle, 1);
+
     display_config_t display_config = {
         .host = SPI3_HOST,
         .spi_frequency = 40000000,
@@ -349,19 +812,12 @@ void app_main(void)
         .lvgl_task_core = 0,
         .lvgl_task_priority = 4,
     };
+    // Shows the not ready screen, the other screens are built when first shown
     display_init(&display_config, &lvgl_config);
+    xEventGroupSetBits(s_boot_events, BOOT_DISPLAY_READY);
+    boot_phase_log("not ready screen shown");
 
-    card_reader_config_t card_reader_config = {
-        .host = SPI2_HOST,
-        .pin_num_miso = 13,
-        .pin_num_mosi = 15,
-        .pin_num_clk = 1,
-        .pin_num_cd = 2,
-    };
-    card_reader_init(&card_reader_config);
-
-    xTaskCreate(card_mount_task, "card_mount", 4096, NULL, 3, NULL);
-    xTaskCreatePinnedToCore(usb_connect_task, "usb_connect", 4096, NULL, 1, &usbConnectTaskHandle, 1);
+    xTaskCreatePinnedToCore(flash_task, "flash", 4096, NULL, FLASH_TASK_PRIORITY, NULL, FLASH_TASK_CORE);
     xTaskCreatePinnedToCore(ui_task, "ui_task", 4096, NULL, 5, NULL, 0);
 
     // Create timer with 1,5 hour period that resets mcu - temporary workaround
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+#
+# Packs the images of an ESP-IDF build directory into a single .esfpkg bundle,
+# which the demo flashes in one pass. The format is described in
+# components/esfpkg/include/esfpkg.h.
+
+import argparse
+import hashlib
+import json
+import os
+import struct
+import sys
+
+MAGIC = 0x50465345  # "ESFP"
+VERSION = 1
+MAX_IMAGES = 64
+SECTOR_SIZE = 4096
+
+IMAGE_ERASED = 1 << 1
+
+HEADER_FORMAT = '<IHHIIIIII32s32s'
+IMAGE_FORMAT = '<IIIIII16s32s24s'
+
+# target_chip_t of esp-serial-flasher
+CHIPS = {
+    'esp8266': 0,
+    'esp32': 1,
+    'esp32s2': 2,
+    'esp32c3': 3,
+    'esp32s3': 4,
+    'esp32c2': 5,
+    'esp32h2': 7,
+    'esp32c6': 8,
+}
+
+
+def align_up(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+def load_build(build_dir):
+    with open(os.path.join(build_dir, 'flasher_args.json')) as f:
+        flasher_args = json.load(f)
+
+    chip = flasher_args.get('extra_esptool_args', {}).get('chip')
+    if chip not in CHIPS:
+        sys.exit(f'Unsupported chip: {chip}')
+
+    name = None
+    try:
+        with open(os.path.join(build_dir, 'project_description.json')) as f:
+            name = json.load(f).get('project_name')
+    except FileNotFoundError:
+        pass
+
+    images = []
+    for address, path in flasher_args['flash_files'].items():
+        with open(os.path.join(build_dir, path), 'rb') as f:
+            data = f.read()
+        # The loader works with sizes that are a multiple of 4
+        data += b'\xff' * (align_up(len(data), 4) - len(data))
+        image_name = os.path.splitext(os.path.basename(path))[0]
+        images.append((int(address, 0), image_name, data))
+
+    images.sort(key=lambda image: image[0])
+    return CHIPS[chip], name or os.path.basename(os.path.abspath(build_dir)), images
+
+
+def split_erased(address, image_name, data):
+    """Splits an image into entries of data and of whole sectors of 0xFF, which are only erased"""
+    extents = []
+    start = 0
+    while start < len(data):
+        # Sector boundaries are relative to the flash address
+        end = min(len(data), (address + start) // SECTOR_SIZE * SECTOR_SIZE + SECTOR_SIZE - address)
+        erased = (address + start) % SECTOR_SIZE == 0 and end - start == SECTOR_SIZE and \
+            data[start:end] == b'\xff' * SECTOR_SIZE
+        if extents and extents[-1][3] == erased:
+            extents[-1][2] += data[start:end]
+        else:
+            extents.append([address + start, image_name, bytearray(data[start:end]), erased])
+        start = end
+    return [(addr, name, bytes(part), erased) for addr, name, part, erased in extents]
+
+
+def joinable(first, second):
+    """Whether the second entry continues the first one in flash, both of the same image"""
+    return first[1] == second[1] and first[0] + len(first[2]) == second[0]
+
+
+def merge_erased(images):
+    """Stores the smallest erased runs as data again until the bundle holds at most MAX_IMAGES entries"""
+    images = [list(image) for image in images]
+    while len(images) > MAX_IMAGES:
+        runs = [i for i, image in enumerate(images) if image[3] and
+                ((i > 0 and not images[i - 1][3] and joinable(images[i - 1], image)) or
+                 (i + 1 < len(images) and not images[i + 1][3] and joinable(image, images[i + 1])))]
+        if not runs:
+            break
+        run = min(runs, key=lambda i: len(images[i][2]))
+        images[run][3] = False
+        # Joins the following data to the run, then the run to the data in front of it
+        for i in (run + 1, run):
+            if 0 < i < len(images) and not images[i - 1][3] and not images[i][3] and \
+                    joinable(images[i - 1], images[i]):
+                images[i - 1][2] += images[i][2]
+                del images[i]
+    return [tuple(image) for image in images]
+
+
+def pack(chip, name, images, alignment, region_size):
+    if not images or len(images) > MAX_IMAGES:
+        sys.exit(f'A bundle holds between 1 and {MAX_IMAGES} images')
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    table_size = len(images) * struct.calcsize(IMAGE_FORMAT)
+    region_count = sum((len(data) + region_size - 1) // region_size
+                       for _, _, data, erased in images if not erased)
+    manifest_size = table_size + region_count * 16
+
+    table = b''
+    digests = b''
+    offset = align_up(header_size + manifest_size, alignment)
+    payloads = []
+    for address, image_name, data, erased in images:
+        stored = b'' if erased else data
+        table += struct.pack(IMAGE_FORMAT, address, len(data), offset, len(stored),
+                             IMAGE_ERASED if erased else 0, len(digests) // 16,
+                             hashlib.md5(data).digest(), hashlib.sha256(data).digest(),
+                             image_name.encode()[:23])
+        for start in range(0, len(stored), region_size):
+            digests += hashlib.md5(stored[start:start + region_size]).digest()
+        if stored:
+            payloads.append((offset, stored))
+            offset = align_up(offset + len(stored), alignment)
+
+    manifest = table + digests
+    header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(images), chip, alignment, region_size,
+                         len(manifest), 0, 0, name.encode()[:31], hashlib.sha256(manifest).digest())
+
+    bundle = bytearray(header + manifest)
+    for payload_offset, stored in payloads:
+        bundle += b'\xff' * (payload_offset - len(bundle))
+        bundle += stored
+    return bytes(bundle)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pack an ESP-IDF build directory into an .esfpkg bundle')
+    parser.add_argument('build_dir', help='ESP-IDF build directory, containing flasher_args.json')
+    parser.add_argument('-o', '--output', help='Output file, <project name>.esfpkg by default')
+    parser.add_argument('--name', help='Project name shown on the display')
+    parser.add_argument('--align', type=lambda x: int(x, 0), default=4096,
+                        help='Alignment of the payloads, a power of two (default: %(default)s)')
+    parser.add_argument('--region-size', type=lambda x: int(x, 0), default=0x10000,
+                        help='Bytes covered by one region digest (default: %(default)s)')
+    parser.add_argument('--no-sparse', action='store_true',
+                        help='Store sectors of 0xFF as data instead of erase-only entries')
+    args = parser.parse_args()
+
+    if args.align <= 0 or args.align & (args.align - 1):
+        sys.exit('Alignment has to be a power of two')
+    if args.region_size <= 0 or args.region_size % 4:
+        sys.exit('Region size has to be a positive multiple of 4')
+
+    chip, name, images = load_build(args.build_dir)
+    name = args.name or name
+    if args.no_sparse:
+        images = [(address, image_name, data, False) for address, image_name, data in images]
+    else:
+        images = merge_erased([extent for image in images for extent in split_erased(*image)])
+    bundle = pack(chip, name, images, args.align, args.region_size)
+
+    output = args.output or f'{name}.esfpkg'
+    with open(output, 'wb') as f:
+        f.write(bundle)
+
+    for address, image_name, data, erased in images:
+        print(f'0x{address:08x} {len(data):8d} {image_name}{" (erased)" if erased else ""}')
+    print(f'Wrote {output} ({len(bundle)} bytes)')
+
+
+if __name__ == '__main__':
+    main()